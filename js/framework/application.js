@@ -16,6 +16,7 @@ const ModuleFactory = imports.framework.moduleFactory;
 const MoltresEngine = imports.framework.moltresEngine;
 const NoContentDialog = imports.framework.widgets.noContentDialog;
 const Pages = imports.framework.pages;
+const QueryCache = imports.framework.queryCache;
 const SetMap = imports.framework.setMap;
 const Utils = imports.framework.utils;
 
@@ -426,9 +427,9 @@ var Application = new Knowledge.Class({
     },
 
     _initialize_set_map: function () {
-        DModel.Engine.get_default().query(new DModel.Query({
+        QueryCache.get_default().query(new DModel.Query({
             tags_match_all: ['EknSetObject'],
-        }), null)
+        }))
         .then((results) => {
             SetMap.init_map_with_models(results.models);
         })
@@ -1,5 +1,6 @@
 const {DModel, Eknr, Endless, GLib, Gio, GObject} = imports.gi;
 const ByteArray = imports.byteArray;
+const EosKnowledgePrivate = imports.gi.EosKnowledgePrivate;
 const Gettext = imports.gettext;
 
 const Config = imports.framework.config;
@@ -9,6 +10,92 @@ const SetMap = imports.framework.setMap;
 
 let _ = Gettext.dgettext.bind(null, Config.GETTEXT_PACKAGE);
 
+// Fields of the article wrapper template that vary between articles
+const WRAPPER_FIELDS = [
+    'base-uri',
+    'content-metadata',
+    'share-actions',
+    'content',
+    'crosslink-data',
+    'chunk-data',
+];
+const WRAPPER_PLACEHOLDER_REGEX = /@@EKN:([a-z-]+)@@/;
+
+// Shared by all renderers in the process; var so that tests can clear it
+// configuration key -> compiled wrapper; see _get_compiled_wrapper()
+var _compiled_wrappers = new Map();
+let _share_actions_markup = null;
+
+const LINK_INDEX_SAVE_DELAY_SECONDS = 10;
+const LINK_INDEX_SUFFIX = '.gvariant';
+let _link_index = null;
+let _link_index_version = null;
+let _link_index_save_id = 0;
+
+// Outgoing links resolve to the same objects for as long as the content
+// doesn't change, so they're remembered across renders and sessions, in a
+// file per version of the content. When the content changes, the index for
+// the new version is opened instead. Without content there is nothing to key
+// the file by, so the index stays in memory.
+function _get_link_index () {
+    let version = Utils.get_content_version();
+    if (_link_index && version === _link_index_version)
+        return _link_index;
+
+    // Links learned for older content are never used again
+    if (_link_index_save_id) {
+        GLib.source_remove(_link_index_save_id);
+        _link_index_save_id = 0;
+    }
+
+    let file = null;
+    if (version) {
+        let checksum = GLib.compute_checksum_for_string(GLib.ChecksumType.SHA256,
+            version, -1);
+        file = Utils.get_app_cache_dir('link-index')
+            .get_child(checksum + LINK_INDEX_SUFFIX);
+    }
+    _link_index = new EosKnowledgePrivate.LinkIndex({file: file});
+    _link_index_version = version;
+    return _link_index;
+}
+
+// Indexes of older content are deleted once the current one is written
+function _delete_stale_link_indexes (file) {
+    let dir = file.get_parent();
+    try {
+        let enumerator = dir.enumerate_children(Gio.FILE_ATTRIBUTE_STANDARD_NAME,
+            Gio.FileQueryInfoFlags.NONE, null);
+        let info;
+        while ((info = enumerator.next_file(null))) {
+            let name = info.get_name();
+            if (name.endsWith(LINK_INDEX_SUFFIX) && name !== file.get_basename())
+                dir.get_child(name).delete_async(GLib.PRIORITY_LOW, null, null);
+        }
+        enumerator.close(null);
+    } catch (e) {
+        logError(e, 'Could not clean up link index');
+    }
+}
+
+function _queue_link_index_save (index) {
+    if (_link_index_save_id || !index.is_dirty())
+        return;
+    _link_index_save_id = GLib.timeout_add_seconds(GLib.PRIORITY_LOW,
+        LINK_INDEX_SAVE_DELAY_SECONDS, () => {
+            _link_index_save_id = 0;
+            try {
+                index.save();
+            } catch (e) {
+                logError(e, 'Could not save link index');
+                return GLib.SOURCE_REMOVE;
+            }
+            if (index.file)
+                _delete_stale_link_indexes(index.file);
+            return GLib.SOURCE_REMOVE;
+        });
+}
+
 /**
  * Class: ArticleHTMLRenderer
  */
@@ -51,6 +138,20 @@ var ArticleHTMLRenderer = new Knowledge.Class({
         this._custom_js_files = custom_js_files;
     },
 
+    /*
+     * Returns a string that changes whenever something about this renderer
+     * that affects its output changes. Used to key cached documents.
+     */
+    get_cache_key: function () {
+        return JSON.stringify([
+            this.show_title,
+            this.enable_scroll_manager,
+            this._custom_css_files,
+            this._custom_js_files,
+            GLib.get_language_names()[0],
+        ]);
+    },
+
     _get_html: function (model) {
         let data_gbytes;
         if (Utils.is_model_archive(model)) {
@@ -67,6 +168,31 @@ var ArticleHTMLRenderer = new Knowledge.Class({
         return ByteArray.toString(data_uint8array);
     },
 
+    // Opens the article's HTML without reading it, so that it can be read in
+    // a worker thread
+    _get_html_stream: function (model) {
+        if (Utils.is_model_archive(model))
+            return model.get_archive_member_content_stream('index.html');
+        return model.get_content_stream();
+    },
+
+    // Parameters for templating legacy content on the client, or null if the
+    // article is server-templated
+    _get_legacy_params: function (model) {
+        if (model.is_server_templated)
+            return null;
+
+        return new GLib.Variant('a{sv}', {
+            'source': new GLib.Variant('s', model.source || ''),
+            'source-name': new GLib.Variant('s', model.source_name || ''),
+            'original-uri': new GLib.Variant('s', model.original_uri || ''),
+            'license': new GLib.Variant('s', model.license || ''),
+            'title': new GLib.Variant('s', model.title || ''),
+            'show-title': new GLib.Variant('b', this.show_title),
+            'enable-scroll-manager': new GLib.Variant('b', this.enable_scroll_manager),
+        });
+    },
+
     _render_content: function (model) {
         // We have two code paths here. Newer content is server-templated, which means that
         // the HTML content in the web view has been pre-styled and we don't need much
@@ -119,9 +245,15 @@ var ArticleHTMLRenderer = new Knowledge.Class({
     },
 
     _get_crosslink_data: function (model) {
+        if (model.outgoing_links.length === 0)
+            return '[]';
+
         let engine = DModel.Engine.get_default();
-        let links = model.outgoing_links.map((link) => engine.test_link(link));
-        return JSON.stringify(links);
+        let index = _get_link_index();
+        let ids = index.test_links(model.outgoing_links,
+            links => links.map(link => engine.test_link(link) || ''));
+        _queue_link_index_save(index);
+        return JSON.stringify(ids.map(id => id || null));
     },
 
     _get_chunk_data: function (model) {
@@ -176,6 +308,11 @@ var ArticleHTMLRenderer = new Knowledge.Class({
         if (!model.original_uri || model.original_uri === '')
             return '';
 
+        // The buttons are the same for every article, so only read the
+        // icons once
+        if (_share_actions_markup !== null)
+            return _share_actions_markup;
+
         function get_svg (uri) {
             let file = Gio.file_new_for_uri(uri);
 
@@ -203,10 +340,42 @@ var ArticleHTMLRenderer = new Knowledge.Class({
         let twitter = get_button_markup('twitter');
         let whatsapp = get_button_markup('whatsapp');
 
-        return `<div id="default-share-actions" style="visibility: hidden;">${facebook}${twitter}${whatsapp}</div>`;
+        _share_actions_markup = `<div id="default-share-actions" style="visibility: hidden;">${facebook}${twitter}${whatsapp}</div>`;
+        return _share_actions_markup;
+    },
+
+    // The wrapper template is rendered once for each configuration, with
+    // placeholders for the fields that vary between articles, and split up
+    // at the placeholders. The result alternates between static fragments and
+    // names of fields.
+    _get_compiled_wrapper: function () {
+        let key = this.get_cache_key();
+        let compiled = _compiled_wrappers.get(key);
+        if (compiled)
+            return compiled;
+
+        let params = {
+            'system-css-files': new GLib.Variant('as', this._get_system_css_files()),
+            'custom-css-files': new GLib.Variant('as', this._custom_css_files),
+            'system-js-files': new GLib.Variant('as', this._get_system_js_files()),
+            'custom-js-files': new GLib.Variant('as', this._custom_js_files),
+            'copy-button-text': new GLib.Variant('s', _("Copy")),
+        };
+        WRAPPER_FIELDS.forEach(field => {
+            params[field] = new GLib.Variant('s', `@@EKN:${field}@@`);
+        });
+
+        let template = Gio.File.new_for_uri('resource:///com/endlessm/knowledge/data/templates/article-wrapper.mst');
+        let html = this._renderer.render_mustache_document_from_file(template,
+            new GLib.Variant('a{sv}', params));
+        compiled = html.split(WRAPPER_PLACEHOLDER_REGEX);
+        _compiled_wrappers.set(key, compiled);
+        return compiled;
     },
 
-    _render_wrapper: function (content, model) {
+    // Values of the fields that vary between articles, except for the
+    // content itself
+    _get_wrapper_fields: function (model) {
         let base_uri;
 
         if (model.id.startsWith('ekn://')) {
@@ -215,22 +384,31 @@ var ArticleHTMLRenderer = new Knowledge.Class({
             base_uri = `${model.id}`;
         }
 
-        let template = Gio.File.new_for_uri('resource:///com/endlessm/knowledge/data/templates/article-wrapper.mst');
+        return {
+            // This one is in double braces in the template, so it is escaped
+            'base-uri': GLib.markup_escape_text(base_uri, -1),
+            'share-actions': this._get_share_actions_markup(model),
+            'crosslink-data': this._get_crosslink_data(model),
+            'chunk-data': this._get_chunk_data(model),
+            'content-metadata': this._get_metadata(model),
+        };
+    },
 
-        return this._renderer.render_mustache_document_from_file(template, new GLib.Variant('a{sv}', {
-            'id': new GLib.Variant('s', model.id),
-            'base-uri': new GLib.Variant('s', base_uri),
-            'system-css-files': new GLib.Variant('as', this._get_system_css_files()),
-            'custom-css-files': new GLib.Variant('as', this._custom_css_files),
-            'system-js-files': new GLib.Variant('as', this._get_system_js_files()),
-            'custom-js-files': new GLib.Variant('as', this._custom_js_files),
-            'copy-button-text': new GLib.Variant('s', _("Copy")),
-            'share-actions': new GLib.Variant('s', this._get_share_actions_markup(model)),
-            'content': new GLib.Variant('s', content),
-            'crosslink-data': new GLib.Variant('s', this._get_crosslink_data(model)),
-            'chunk-data': new GLib.Variant('s', this._get_chunk_data(model)),
-            'content-metadata': new GLib.Variant('s', this._get_metadata(model)),
-        }));
+    // Returns the wrapped document in two halves, before and after the
+    // content
+    _render_wrapper: function (model) {
+        let fields = this._get_wrapper_fields(model);
+        let halves = [[], []];
+        let half = halves[0];
+        this._get_compiled_wrapper().forEach((piece, ix) => {
+            if (ix % 2 === 0)
+                half.push(piece);
+            else if (piece === 'content')
+                half = halves[1];
+            else
+                half.push(fields[piece]);
+        });
+        return halves.map(pieces => pieces.join(''));
     },
 
     /*
@@ -238,7 +416,31 @@ var ArticleHTMLRenderer = new Knowledge.Class({
      * string of ready to display html.
      */
     render: function (model) {
-        let content = this._render_content(model);
-        return this._render_wrapper(content, model);
+        let [head, tail] = this._render_wrapper(model);
+        return head + this._render_content(model) + tail;
+    },
+
+    /*
+     * Like render(), but the article is read and rendered in a worker thread.
+     * Returns a promise that resolves to ready to display html, as an array
+     * of GLib.Bytes chunks that can be fed to a Gio.MemoryInputStream without
+     * copying them.
+     */
+    render_async: function (model, cancellable=null) {
+        let stream = this._get_html_stream(model);
+        let legacy_params = this._get_legacy_params(model);
+        let [head, tail] = this._render_wrapper(model);
+
+        return new Promise((resolve, reject) => {
+            EosKnowledgePrivate.render_article_async(stream, legacy_params,
+                head, tail, cancellable,
+                (obj, result) => {
+                    try {
+                        resolve(EosKnowledgePrivate.render_article_finish(result));
+                    } catch (e) {
+                        reject(e);
+                    }
+                });
+        });
     },
 });
@@ -6,6 +6,7 @@ const {DModel, Gdk, GObject, Gtk} = imports.gi;
 const Lang = imports.lang;
 
 const Module = imports.framework.interfaces.module;
+const PrerenderService = imports.framework.prerenderService;
 
 /**
  * Interface: Arrangement
@@ -129,6 +130,10 @@ var Arrangement = new Lang.Interface({
             card.connect('clicked', card => {
                 this.emit('card-clicked', card.model);
             });
+            card.connect('enter-notify-event', card => {
+                PrerenderService.get_default().hint(card.model);
+                return Gdk.EVENT_PROPAGATE;
+            });
         }
 
         return card;
@@ -162,20 +167,7 @@ var Arrangement = new Lang.Interface({
         // Add cards for models that we don't have yet.
         this._models.forEach((model) => {
             id_set.add(model.id);
-            let newly_created = false;
-            if (!this._cards_by_id.get(model.id)) {
-                this._create_card(model);
-                newly_created = true;
-            }
-
-            let card = this._cards_by_id.get(model.id);
-            this.pack_card(card);
-            // Fading in a card that already exists on the arrangement looks weird
-            // and is a performance hit.
-            if (this.fade_cards && newly_created)
-                this.fade_card_in(card);
-            else
-                card.show_all();
+            this._pack_card_for_model(model);
         });
 
         // Delete cards for models we don't need anymore
@@ -187,6 +179,47 @@ var Arrangement = new Lang.Interface({
             });
     },
 
+    _pack_card_for_model: function (model) {
+        let newly_created = false;
+        if (!this._cards_by_id.get(model.id)) {
+            this._create_card(model);
+            newly_created = true;
+        }
+
+        let card = this._cards_by_id.get(model.id);
+        this.pack_card(card);
+        // Fading in a card that already exists on the arrangement looks weird
+        // and is a performance hit.
+        if (this.fade_cards && newly_created)
+            this.fade_card_in(card);
+        else
+            card.show_all();
+    },
+
+    /**
+     * Method: append_models
+     * Display more card models after the ones in the arrangement
+     *
+     * Unlike <set_models()>, the cards already in the arrangement are left
+     * packed, and only cards for the new models are created and packed.
+     * Arrangements with a maximum number of cards go through <set_models()>,
+     * since they may lay out all their cards together.
+     *
+     * Parameters:
+     *   models - an array of `DModel.Content`
+     */
+    append_models: function (models) {
+        if (this.get_max_cards() > -1) {
+            this.set_models(this._models.concat(models));
+            return;
+        }
+
+        models.forEach(model => {
+            this._models.push(model);
+            this._pack_card_for_model(model);
+        });
+    },
+
     /**
      * Method: get_models
      * Get all card models in the arrangement
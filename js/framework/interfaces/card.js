@@ -11,6 +11,7 @@ const Mainloop = imports.mainloop;
 const Config = imports.framework.config;
 const FormattableLabel = imports.framework.widgets.formattableLabel;
 const Module = imports.framework.interfaces.module;
+const QueryCache = imports.framework.queryCache;
 const SetMap = imports.framework.setMap;
 const SpaceContainer = imports.framework.widgets.spaceContainer;
 const Utils = imports.framework.utils;
@@ -281,7 +282,7 @@ var Card = new Lang.Interface({
         let query = new DModel.Query({
             tags_match_any: set_obj.child_tags,
         });
-        DModel.Engine.get_default().query(query, null)
+        QueryCache.get_default().query(query)
         .then((results) => {
             let reached_bottom = true;
             results.models.forEach((obj) => {
@@ -68,6 +68,25 @@ var Order = new Lang.Interface({
         return (this.ascending ? 1 : -1) * result;
     },
 
+    /**
+     * Method: sort
+     * Sort an array of models
+     *
+     * The sort is stable.
+     * Implementations may override this with a faster way to sort many
+     * models at once, as long as the result is the same as sorting with
+     * <compare()>.
+     *
+     * Parameters:
+     *   models - an array of `DModel.Content`
+     *
+     * Returns:
+     *   a new array with the same models, sorted
+     */
+    sort: function (models) {
+        return models.slice().sort(this.compare.bind(this));
+    },
+
     /**
      * Method: compare_impl
      * Intended to be implemented
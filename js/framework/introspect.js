@@ -1,5 +1,6 @@
 /* exported introspect_module */
 
+const EosKnowledgePrivate = imports.gi.EosKnowledgePrivate;
 const GObject = imports.gi.GObject;
 
 function _introspect_gtype(gtype) {
@@ -64,7 +65,7 @@ function introspect_module(module) {
         parent: _introspect_gtype(module.__super__.$gtype),
         interfaces: module.prototype.__interfaces__
             .map(iface => _introspect_gtype(iface.$gtype)),
-        properties: GObject.Object.list_properties.call(module)
+        properties: EosKnowledgePrivate.gtype_list_properties(module.$gtype)
             .map(_introspect_param_spec),
         slots: _introspect_slots(module.__slots__),
         references: _introspect_references(module.__references__),
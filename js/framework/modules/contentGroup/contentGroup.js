@@ -294,10 +294,15 @@ var ContentGroup = new Module.Class({
                 this.visible = false;
             }
         } else {
+            let shown = this._arrangement.get_models();
+            let appended = this._are_models_appended(shown, models);
             let max_cards = this._arrangement.get_max_cards();
             if (max_cards > -1)
                 models.splice(max_cards);
-            this._arrangement.set_models(models);
+            if (appended)
+                this._arrangement.append_models(models.slice(shown.length));
+            else
+                this._arrangement.set_models(models);
             let item = HistoryStore.get_default().get_current_item();
             if (item && item.model) {
                 this._arrangement.highlight(item.model);
@@ -307,6 +312,18 @@ var ContentGroup = new Module.Class({
 
     },
 
+    // Whether the selection only added models after the ones the arrangement
+    // already shows, as when loading more, so that the arrangement doesn't
+    // have to pack all its cards again
+    _are_models_appended: function (shown, models) {
+        let {reset, inserted} = this._selection.get_changes();
+        if (reset || inserted.length === 0 ||
+            shown.length + inserted.length !== models.length)
+            return false;
+        return inserted.every((position, ix) => position === shown.length + ix) &&
+            shown.every((model, ix) => model.id === models[ix].id);
+    },
+
     _on_subset_changed: function () {
         let subset = HistoryStore.get_default().current_subset;
         if (subset)
@@ -9,6 +9,21 @@ const Module = imports.framework.interfaces.module;
 const ReadingHistoryModel = imports.framework.readingHistoryModel;
 const Utils = imports.framework.utils;
 
+// Only this many of the most recently read articles are excluded in queries,
+// since the query gets slower with every excluded ID; older read articles are
+// filtered out of the results instead.
+var MAX_EXCLUDED_IDS = 256;
+
+/**
+ * Class: Filter.Unread
+ * Filter that shows only the articles that the user hasn't read
+ *
+ * Inverted, it shows only the articles that the user has read.
+ *
+ * The user's whole reading history can't go into each query, so once it is
+ * longer than <MAX_EXCLUDED_IDS>, queries only exclude the most recently read
+ * articles, and the filter reports that results need filtering afterwards.
+ */
 var Unread = new Module.Class({
     Name: 'Filter.Unread',
     Extends: GObject.Object,
@@ -19,17 +34,29 @@ var Unread = new Module.Class({
         return !ReadingHistoryModel.get_default().is_read_article(model.id);
     },
 
+    // Filter override
+    can_modify_xapian_query: function () {
+        if (this.invert)
+            return true;
+        let history = ReadingHistoryModel.get_default();
+        return history.get_read_articles().size <= MAX_EXCLUDED_IDS;
+    },
+
     // Filter implementation
     modify_xapian_query_impl: function (query) {
-        let id_set = ReadingHistoryModel.get_default().get_read_articles();
+        let history = ReadingHistoryModel.get_default();
         if (this.invert) {
-            let ids = [...id_set];
+            // The whole history goes into the query here. Unlike excluding
+            // IDs, asking for IDs only looks up those articles, so the query
+            // costs about as much as fetching the results would anyway.
+            let ids = [...history.get_read_articles()];
             if (query.ids.length)
                 ids = Utils.intersection(query.ids, ids);
             return DModel.Query.new_from_object(query, {ids});
         }
         return DModel.Query.new_from_object(query, {
-            excluded_ids: Utils.union(query.excluded_ids, [...id_set]),
+            excluded_ids: Utils.union(query.excluded_ids,
+                history.get_recently_read_articles(MAX_EXCLUDED_IDS)),
         });
     },
 });
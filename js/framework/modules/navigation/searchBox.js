@@ -8,6 +8,7 @@ const HistoryStore = imports.framework.historyStore;
 const Module = imports.framework.interfaces.module;
 const Pages = imports.framework.pages;
 const BaseSearchBox = imports.framework.widgets.searchBox;
+const TitleIndex = imports.framework.titleIndex;
 const Utils = imports.framework.utils;
 
 /**
@@ -15,6 +16,10 @@ const Utils = imports.framework.utils;
  *
  * A search bar for querying information in the knowledge apps.
  *
+ * Autocomplete suggestions for titles starting with the search text come
+ * from <TitleIndex>; the database is only queried for matches in the rest of
+ * the content, when there aren't enough of those.
+ *
  * CSS classes:
  * - autocomplete - on the autocomplete popup (not a child of this module)
  */
@@ -35,7 +40,8 @@ var SearchBox = new Module.Class({
         if (props.visible === undefined)
             props.visible = true;
         this.parent(props);
-        this._autocomplete_models = {};
+        this._autocomplete_models = [];
+        this._autocomplete_items = [];
         this._cancellable = null;
         this.add_events(Gdk.EventMask.FOCUS_CHANGE_MASK);
 
@@ -47,6 +53,8 @@ var SearchBox = new Module.Class({
                 this.grab_focus();
         });
         this.connect('focus-in-event', () => {
+            // The title index is only built once it is likely to be needed
+            TitleIndex.get_default().load();
             Dispatcher.get_default().dispatch({
                 action_type: Actions.SEARCH_BOX_FOCUSED,
             });
@@ -61,13 +69,7 @@ var SearchBox = new Module.Class({
             });
         });
         this.connect('menu-item-selected', (entry, id) => {
-            let model = this._autocomplete_models.filter(model => model.id === id)[0];
-            Dispatcher.get_default().dispatch({
-                action_type: Actions.ITEM_CLICKED,
-                search_terms: this.text,
-                model: model,
-                context: this._autocomplete_models,
-            });
+            this._on_menu_item_selected(id);
         });
         this.connect('more-activated', () => {
             Dispatcher.get_default().dispatch({
@@ -83,6 +85,31 @@ var SearchBox = new Module.Class({
         this.set_text_programmatically(search_text);
     },
 
+    _on_menu_item_selected: function (id) {
+        let search_terms = this.text;
+        let dispatch = models => {
+            Dispatcher.get_default().dispatch({
+                action_type: Actions.ITEM_CLICKED,
+                search_terms,
+                model: models.filter(model => model.id === id)[0],
+                context: models,
+            });
+        };
+
+        let ids = this._autocomplete_items.map(item => item.id);
+        let known = new Map(this._autocomplete_models.map(model => [model.id, model]));
+        if (ids.every(id => known.has(id))) {
+            dispatch(ids.map(id => known.get(id)));
+            return;
+        }
+
+        // Suggestions from the title index are only IDs until they're picked
+        let engine = DModel.Engine.get_default();
+        Promise.all(ids.map(id => known.get(id) || engine.get_object(id, null)))
+        .then(dispatch)
+        .catch(logError);
+    },
+
     _on_text_changed: function () {
         if (this._cancellable)
             this._cancellable.cancel();
@@ -93,6 +120,18 @@ var SearchBox = new Module.Class({
         if (search_terms.length === 0)
             return;
 
+        let title_index = TitleIndex.get_default();
+        title_index.load();
+        // Null if the index isn't loaded yet
+        let title_matches = title_index.lookup(this.text,
+            BaseSearchBox.MAX_RESULTS + 1) || [];
+        this._autocomplete_models = [];
+        this._autocomplete_items = title_matches;
+        if (title_matches.length > 0)
+            this.set_menu_items(title_matches);
+        if (title_matches.length > BaseSearchBox.MAX_RESULTS)
+            return;
+
         let query_obj = new DModel.Query({
             search_terms,
             limit: BaseSearchBox.MAX_RESULTS + 1,
@@ -104,13 +143,21 @@ var SearchBox = new Module.Class({
             if (search_terms !== Utils.sanitize_search_terms(this.text))
                 return;
 
+            // Titles that start with the text go first
+            let ids = new Set(title_matches.map(item => item.id));
+            let items = title_matches.concat(results.models
+                .filter(model => !ids.has(model.id))
+                .map(model => {
+                    return {
+                        title: this._get_prefixed_title(model, this.text),
+                        id: model.id,
+                    };
+                }))
+                .slice(0, BaseSearchBox.MAX_RESULTS + 1);
+
             this._autocomplete_models = results.models;
-            this.set_menu_items(this._autocomplete_models.map((model) => {
-                return {
-                    title: this._get_prefixed_title(model, this.text),
-                    id: model.id,
-                };
-            }));
+            this._autocomplete_items = items;
+            this.set_menu_items(items);
         })
         .catch(function (error) {
             if (!error.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
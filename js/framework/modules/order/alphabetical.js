@@ -2,7 +2,7 @@
 
 /* exported Alphabetical */
 
-const {DModel, GObject} = imports.gi;
+const {DModel, EosKnowledgePrivate, GObject} = imports.gi;
 
 const Module = imports.framework.interfaces.module;
 const Order = imports.framework.interfaces.order;
@@ -10,6 +10,11 @@ const Order = imports.framework.interfaces.order;
 /**
  * Class: Alphabetical
  * Order that sorts cards alphabetically by title
+ *
+ * Titles are compared by their collation keys in the current locale, which
+ * are computed once per model and kept for as long as the model is alive, so
+ * sorting large sets such as A-Z index pages doesn't repeat the locale-aware
+ * work for every comparison.
  */
 var Alphabetical = new Module.Class({
     Name: 'Order.Alphabetical',
@@ -22,20 +27,44 @@ var Alphabetical = new Module.Class({
             GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT, false),
     },
 
+    _init: function (props={}) {
+        this.parent(props);
+        this._collate_keys = new WeakMap();
+        this.connect('notify::case-sensitive', () => {
+            this._collate_keys = new WeakMap();
+        });
+    },
+
+    _get_collate_key: function (model) {
+        let key = this._collate_keys.get(model);
+        if (key === undefined) {
+            // We always want uppercase letters to come after lowercase ones
+            // when case sensitive, which the key takes care of
+            key = EosKnowledgePrivate.title_collate_key(model.title || '',
+                this.case_sensitive);
+            this._collate_keys.set(model, key);
+        }
+        return key;
+    },
+
     compare_impl: function (left, right) {
-        let a = left.title;
-        let b = right.title;
-
-        // We always want uppercase letters to come after lowercase ones
-        // which won't happen if we just leave it to localeCompare
-        let first_char_a = a.charAt(0);
-        let first_char_b = b.charAt(0);
-        let is_upper_a = first_char_a == first_char_a.toLocaleUpperCase();
-        let is_upper_b = first_char_b == first_char_b.toLocaleUpperCase();
-
-        if (is_upper_a !== is_upper_b && this.case_sensitive)
-            return a > b ? -1 : 1;
-        return a.localeCompare(b);
+        let a = this._get_collate_key(left);
+        let b = this._get_collate_key(right);
+        if (a < b)
+            return -1;
+        if (a > b)
+            return 1;
+        return 0;
+    },
+
+    sort: function (models) {
+        // Ties are broken by the sub-order, which the native sort can't do
+        if (this._sub_order)
+            return Order.Order.prototype.sort.call(this, models);
+
+        let keys = models.map(model => this._get_collate_key(model));
+        return EosKnowledgePrivate.sort_collate_keys(keys, this.ascending)
+            .map(ix => models[ix]);
     },
 
     modify_xapian_query_impl: function (query) {
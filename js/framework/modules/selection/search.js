@@ -6,6 +6,7 @@ const {DModel} = imports.gi;
 
 const HistoryStore = imports.framework.historyStore;
 const Module = imports.framework.interfaces.module;
+const PrerenderService = imports.framework.prerenderService;
 const Xapian = imports.framework.modules.selection.xapian;
 
 var Search = new Module.Class({
@@ -17,6 +18,12 @@ var Search = new Module.Class({
         HistoryStore.get_default().connect('notify::current-search-terms', () => {
             this._set_needs_refresh(true);
         });
+        // The top result is the one most likely to be opened
+        this.connect('models-changed', () => {
+            let [top_result] = this.get_models();
+            if (top_result)
+                PrerenderService.get_default().hint(top_result);
+        });
     },
 
     construct_query_object: function (limit, query_index) {
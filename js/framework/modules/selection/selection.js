@@ -10,6 +10,14 @@ const Module = imports.framework.interfaces.module;
 
 /**
  * Class: Selection
+ *
+ * Models are kept in order as they are added. Each batch of added models is
+ * sorted with the order's <Order.sort()> and merged into the models already
+ * there, so loading more models costs a sort of the new ones and one pass
+ * over the rest, and <get_models()> doesn't need to sort. After each
+ * models-changed, the positions of the models that were inserted since the
+ * previous one can be had from <get_changes()>, so that views can update only
+ * what changed.
  */
 var Selection = new Module.Class({
     Name: 'Selection',
@@ -63,6 +71,14 @@ var Selection = new Module.Class({
         // If no model is provided upon construction, we must be getting our model from global state.
         this.global = !this.model;
         this._models_by_id = new Map();
+        // The same models, ordered, except for those added since the last
+        // merge; see _merge_added_models()
+        this._ordered_models = [];
+        this._added_models = [];
+        // What changed since the last models-changed, and in it
+        this._inserted_ids = new Set();
+        this._pending_reset = false;
+        this._changes = {reset: false, inserted: []};
         this._order = this.create_submodule('order');
         this._filter = this.create_submodule('filter');
         this._needs_refresh = false;
@@ -109,10 +125,51 @@ var Selection = new Module.Class({
     },
 
     get_models: function () {
-        let models = [...this._models_by_id.values()];
-        if (this._order)
-            models.sort(this._order.compare.bind(this._order));
-        return models;
+        this._merge_added_models();
+        return this._ordered_models.slice();
+    },
+
+    /**
+     * Method: get_changes
+     * What changed in the last models-changed
+     *
+     * Returns:
+     *   An object with *reset*, true if the selection was cleared first, and
+     *   *inserted*, the positions in <get_models()> of the models that were
+     *   added, in ascending order.
+     */
+    get_changes: function () {
+        return {
+            reset: this._changes.reset,
+            inserted: this._changes.inserted.slice(),
+        };
+    },
+
+    // Sorts the models added since the last merge and merges them in after
+    // any models that compare equal, which gives the same order as a stable
+    // sort of all the models in the order they were added
+    _merge_added_models: function () {
+        let added = this._added_models;
+        if (added.length === 0)
+            return;
+        this._added_models = [];
+        if (!this._order) {
+            this._ordered_models.push(...added);
+            return;
+        }
+
+        added = this._order.sort(added);
+        let models = this._ordered_models;
+        let merged = [];
+        let ix = 0;
+        added.forEach(model => {
+            while (ix < models.length && this._order.compare(model, models[ix]) >= 0)
+                merged.push(models[ix++]);
+            merged.push(model);
+        });
+        while (ix < models.length)
+            merged.push(models[ix++]);
+        this._ordered_models = merged;
     },
 
     /* Private, intended to be used from subclasses */
@@ -124,11 +181,32 @@ var Selection = new Module.Class({
             return false;
 
         this._models_by_id.set(model.id, model);
+        this._added_models.push(model);
+        this._inserted_ids.add(model.id);
         return true;
     },
 
     clear: function () {
         this._models_by_id.clear();
+        this._ordered_models = [];
+        this._added_models = [];
+        this._inserted_ids.clear();
+        this._pending_reset = true;
+        this._emit_models_changed();
+    },
+
+    _emit_models_changed: function () {
+        this._merge_added_models();
+        let inserted = [];
+        if (this._inserted_ids.size > 0) {
+            this._ordered_models.forEach((model, ix) => {
+                if (this._inserted_ids.has(model.id))
+                    inserted.push(ix);
+            });
+        }
+        this._changes = {reset: this._pending_reset, inserted};
+        this._inserted_ids.clear();
+        this._pending_reset = false;
         this.emit('models-changed');
     },
 
@@ -141,11 +219,11 @@ var Selection = new Module.Class({
     emit_models_when_not_animating: function () {
         let store = HistoryStore.get_default();
         if (!store.animating) {
-            this.emit('models-changed');
+            this._emit_models_changed();
         } else {
             let id = store.connect('notify::animating', () => {
                 if (!store.animating) {
-                    this.emit('models-changed');
+                    this._emit_models_changed();
                 }
                 store.disconnect(id);
             });
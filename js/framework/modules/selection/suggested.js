@@ -37,18 +37,26 @@ var Suggested = new Module.Class({
     },
 
     get_models: function () {
+        if (this._order)
+            return this.parent();
+
         let models = [...this._models_by_id.values()];
+        // Reseed the pseudorandom function so that we get the same random sequence
+        GLib.random_set_seed(this._hash);
+
+        // Generate a pseudorandom sequence of numbers to use to shuffle the array
+        let rand_sequence = Array.from({length: this._models_by_id.size}, () => GLib.random_double());
+        return Utils.shuffle(models, rand_sequence);
+    },
+
+    get_changes: function () {
+        if (this._order)
+            return this.parent();
 
-        if (this._order) {
-            models.sort(this._order.compare.bind(this._order));
-        } else {
-            // Reseed the pseudorandom function so that we get the same random sequence
-            GLib.random_set_seed(this._hash);
-
-            // Generate a pseudorandom sequence of numbers to use to shuffle the array
-            let rand_sequence = Array.from({length: this._models_by_id.size}, () => GLib.random_double());
-            return Utils.shuffle(models, rand_sequence);
-        }
-        return models;
+        // Shuffling moves every model, so it all has to be redone
+        return {
+            reset: true,
+            inserted: [...this._models_by_id.keys()].map((id, ix) => ix),
+        };
     },
 });
@@ -7,6 +7,7 @@ const {DModel} = imports.gi;
 const Module = imports.framework.interfaces.module;
 const HistoryStore = imports.framework.historyStore;
 const ReadingHistoryModel = imports.framework.readingHistoryModel;
+const Unread = imports.framework.modules.filter.unread;
 const Xapian = imports.framework.modules.selection.xapian;
 
 var Supplementary = new Module.Class({
@@ -29,7 +30,10 @@ var Supplementary = new Module.Class({
         };
         switch (query_index) {
             case 0:
-                query_object_params.excluded_ids = [...ReadingHistoryModel.get_default().get_read_articles()];
+                // Unread articles first; see Filter.Unread for why not all
+                // read articles are excluded here
+                query_object_params.excluded_ids = ReadingHistoryModel.get_default()
+                    .get_recently_read_articles(Unread.MAX_EXCLUDED_IDS);
                 break;
             case 1:
                 break;
@@ -38,4 +42,20 @@ var Supplementary = new Module.Class({
         }
         return new DModel.Query(query_object_params);
     },
+
+    add_model: function (model) {
+        if (this._query_index === 0 &&
+            ReadingHistoryModel.get_default().is_read_article(model.id))
+            return false;
+        return this.parent(model);
+    },
+
+    // Read articles that the query couldn't exclude are rejected in
+    // add_model(), so fetch more to make up for them
+    _needs_post_filtering: function () {
+        if (this._query_index === 0 &&
+            ReadingHistoryModel.get_default().get_read_articles().size > Unread.MAX_EXCLUDED_IDS)
+            return true;
+        return this.parent();
+    },
 });
@@ -2,11 +2,24 @@
 
 // Copyright 2016 Endless Mobile, Inc.
 
-const {DModel} = imports.gi;
+const {DModel, GLib, GObject} = imports.gi;
 
 const Module = imports.framework.interfaces.module;
+const QueryCache = imports.framework.queryCache;
 const Selection = imports.framework.modules.selection.selection;
 
+// When the order or filter can't be done by Xapian, more results are fetched
+// than are needed, by a factor estimated from the fraction of results that
+// the filter accepted so far. Before there is an estimate, the factor is the
+// default one. The estimate is smoothed over fetches with SMOOTHING as the
+// weight of the latest one, and padded by MARGIN so that fetches sized from
+// it rarely come up short.
+const DEFAULT_OVERFETCH_FACTOR = 3;
+const MAX_OVERFETCH_FACTOR = 20;
+const MAX_FETCH_LIMIT = 500;
+const SELECTIVITY_SMOOTHING = 0.5;
+const SELECTIVITY_MARGIN = 1.25;
+
 /**
  * Class: Xapian
  * A general, superclass for populating selection content using xapian
@@ -21,12 +34,33 @@ const Selection = imports.framework.modules.selection.selection;
  * results are required, it will automatically create a new query and fetch
  * more content.
  *
+ * Queries go through the shared <QueryCache>, so selections that ask for the
+ * same content only query the engine once between them.
+ *
+ * When the order or filter can't be done in the query, results are sorted
+ * and filtered after the fact, so more results are fetched than are needed.
+ * How many more is based on the fraction of results that the filter has
+ * accepted so far, so that selective filters don't need many round trips
+ * and loose ones don't fetch much more than they use.
  */
 var Xapian = new Module.Class({
     Name: 'Selection.Xapian',
     Extends: Selection.Selection,
     Abstract: true,
 
+    Properties: {
+        /**
+         * Property: round-trips
+         * Number of queries that the last completed load took
+         *
+         * A load is everything done for one call to <queue_load_more()>,
+         * including the further queries made when the results didn't fill it.
+         */
+        'round-trips': GObject.ParamSpec.uint('round-trips', 'Round trips',
+            'Number of queries that the last completed load took',
+            GObject.ParamFlags.READABLE, 0, GLib.MAXUINT32, 0),
+    },
+
     _init: function (props={}) {
         this._loading = false;
         this._can_load_more = true;
@@ -34,10 +68,19 @@ var Xapian = new Module.Class({
         this._query_index = 0;
         this._error_state = false;
         this._exception = null;
+        // Smoothed fraction of fetched results that the filter accepted, or
+        // null before anything was fetched with post-filtering
+        this._selectivity = null;
+        this._round_trips = 0;
+        this._pending_round_trips = 0;
 
         this.parent(props);
     },
 
+    get round_trips() {
+        return this._round_trips;
+    },
+
     get loading() {
         return this._loading;
     },
@@ -70,7 +113,6 @@ var Xapian = new Module.Class({
         if (this.loading)
             return;
 
-        let engine = DModel.Engine.get_default();
         let query = this._next_query;
 
         if (!query) {
@@ -87,17 +129,18 @@ var Xapian = new Module.Class({
         // results from the database that we can present after sorting and
         // filtering, without having the UI jump around too much as new results
         // come in.
-        // The heuristic of limit * 3 is a guess.
-        if ((this._order && !this._order.can_modify_xapian_query()) ||
-            (this._filter && !this._filter.can_modify_xapian_query())) {
+        let post_filtering = this._needs_post_filtering();
+        if (post_filtering) {
             query = DModel.Query.new_from_object(query, {
-                limit: query.limit * 3,
+                limit: this._get_fetch_limit(num_desired > 0 ? num_desired : query.limit),
             });
         }
 
         this._loading = true;
+        this._pending_round_trips++;
         this.notify('loading');
-        engine.query(query, null)
+        // Other selections often run the same queries, so share their results
+        QueryCache.get_default().query(query)
         .then(({ models, upper_bound }) => {
             this._loading = false;
             this._set_needs_refresh(false);
@@ -122,6 +165,9 @@ var Xapian = new Module.Class({
                 return count;
             }, 0);
 
+            if (post_filtering && offset_for_next_query)
+                this._update_selectivity(num_results_added, offset_for_next_query);
+
             // If we got back less than we even asked for, then obviously there
             // are no more results to be fetched.
             let more_results_query;
@@ -157,14 +203,16 @@ var Xapian = new Module.Class({
                 this.notify('can-load-more');
             }
 
-            if (num_results_added < num_desired && this._can_load_more) {
+            if (num_results_added < num_desired && this._can_load_more)
                 this.queue_load_more(num_desired - num_results_added);
-            }
+            else
+                this._finish_round_trips();
 
             this.emit_models_when_not_animating();
         })
         .catch((error) => {
             logError(error, 'Failed to load content from engine');
+            this._finish_round_trips();
             this._exception = error;
             if (!this._error_state) {
                 this._error_state = true;
@@ -173,8 +221,42 @@ var Xapian = new Module.Class({
         });
     },
 
+    _needs_post_filtering: function () {
+        return (this._order && !this._order.can_modify_xapian_query()) ||
+            (this._filter && !this._filter.can_modify_xapian_query());
+    },
+
+    // Number of results to fetch in order to end up with @wanted of them after
+    // filtering
+    _get_fetch_limit: function (wanted) {
+        let factor = DEFAULT_OVERFETCH_FACTOR;
+        if (this._selectivity !== null) {
+            factor = this._selectivity > 0 ?
+                SELECTIVITY_MARGIN / this._selectivity : MAX_OVERFETCH_FACTOR;
+            factor = Math.min(Math.max(factor, 1), MAX_OVERFETCH_FACTOR);
+        }
+        return Math.max(wanted, Math.min(Math.ceil(wanted * factor),
+            MAX_FETCH_LIMIT));
+    },
+
+    _update_selectivity: function (accepted, examined) {
+        let ratio = accepted / examined;
+        if (this._selectivity === null)
+            this._selectivity = ratio;
+        else
+            this._selectivity = SELECTIVITY_SMOOTHING * ratio +
+                (1 - SELECTIVITY_SMOOTHING) * this._selectivity;
+    },
+
+    _finish_round_trips: function () {
+        this._round_trips = this._pending_round_trips;
+        this._pending_round_trips = 0;
+        this.notify('round-trips');
+    },
+
     clear: function () {
         this._next_query = null;
+        this._pending_round_trips = 0;
         this._query_index = 0;
         let reset_can_load_more = true;
         if (reset_can_load_more !== this._can_load_more) {
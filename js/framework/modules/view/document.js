@@ -15,6 +15,7 @@ const HistoryStore = imports.framework.historyStore;
 const InArticleSearch = imports.framework.widgets.inArticleSearch;
 const Module = imports.framework.interfaces.module;
 const PDFView = imports.framework.widgets.PDFView;
+const PrerenderService = imports.framework.prerenderService;
 const {spinnerReplacement} = imports.framework.widgets;
 const TableOfContents = imports.framework.widgets.tableOfContents;
 const Utils = imports.framework.utils;
@@ -175,14 +176,24 @@ var Document = new Module.Class({
                             article_search.search_mode_enabled));
                 });
 
-                this._webview_load_id = this.content_view.connect('load-changed', (view, status) => {
-                    if (status !== WebKit2.LoadEvent.COMMITTED)
+                // Show the content as soon as its text has been painted, or
+                // when the load is finished in case that never gets signalled
+                let show_content = () => {
+                    if (!this._webview_load_id)
                         return;
                     this._stack.visible_child_name = CONTENT_PAGE_NAME;
                     this._spinner.active = false;
                     this.content_view.disconnect(this._webview_load_id);
+                    this.content_view.disconnect(this._webview_ready_id);
                     this._webview_load_id = 0;
+                    this._webview_ready_id = 0;
                     resolve();
+                };
+                this._webview_ready_id = this.content_view.connect('content-ready',
+                    show_content);
+                this._webview_load_id = this.content_view.connect('load-changed', (view, status) => {
+                    if (status === WebKit2.LoadEvent.FINISHED)
+                        show_content();
                 });
 
                 // FIXME: Consider eventually connecting to load-failed and showing
@@ -268,6 +279,10 @@ var Document = new Module.Class({
 
         webview.renderer.enable_scroll_manager = this.toc.visible;
         webview.renderer.show_title = !this.show_toc;
+        let prerender_service = PrerenderService.get_default();
+        prerender_service.add_renderer(webview.renderer);
+        webview.connect('destroy', () =>
+            prerender_service.remove_renderer(webview.renderer));
 
         webview.connect('notify::uri', function () {
             if (webview.uri.indexOf('#') >= 0) {
@@ -0,0 +1,257 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* exported PrerenderService, get_default */
+
+const {DModel, Gio, GLib, GObject} = imports.gi;
+
+const ArticleHTMLRenderer = imports.framework.articleHTMLRenderer;
+const HistoryStore = imports.framework.historyStore;
+const Knowledge = imports.framework.knowledge;
+const RenderCache = imports.framework.renderCache;
+
+const DEFAULT_MEMORY_BUDGET = 4 * 1024 * 1024;
+const DEFAULT_MAX_CANDIDATES = 3;
+
+/**
+ * Class: PrerenderService
+ * Renders the articles that the user is likely to open next
+ *
+ * Parts of the UI that know what the user might open next give hints with
+ * <hint()>: hovering a card, a search returning its results, and opening an
+ * article from a list all hint at the next article. The most recent hints
+ * are rendered when the main loop is idle, and put in the <RenderCache>, so
+ * that opening the article doesn't have to wait for it to render.
+ *
+ * Documents are cached per renderer configuration, so views that open
+ * articles register their renderers with <add_renderer()>. Each hinted
+ * article is rendered once for each configuration in use, since the hint
+ * doesn't say which view will open it.
+ *
+ * The documents rendered since the last navigation are limited to
+ * <memory-budget> bytes, so that speculative renders don't push out the
+ * documents that the user actually read. Navigating cancels any outstanding
+ * work.
+ */
+var PrerenderService = new Knowledge.Class({
+    Name: 'PrerenderService',
+    Extends: GObject.Object,
+
+    Properties: {
+        /**
+         * Property: cache
+         * The <RenderCache> to put rendered documents in
+         *
+         * If not given, the default one is used.
+         *
+         * Flags:
+         *   Construct only
+         */
+        'cache': GObject.ParamSpec.object('cache', 'Cache',
+            'Cache to put rendered documents in',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT_ONLY,
+            RenderCache.RenderCache),
+        /**
+         * Property: memory-budget
+         * Maximum number of bytes to render between navigations
+         */
+        'memory-budget': GObject.ParamSpec.uint('memory-budget',
+            'Memory budget', 'Maximum number of bytes to render between navigations',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT,
+            0, GLib.MAXUINT32, DEFAULT_MEMORY_BUDGET),
+        /**
+         * Property: max-candidates
+         * Maximum number of hinted articles waiting to be rendered
+         */
+        'max-candidates': GObject.ParamSpec.uint('max-candidates',
+            'Max candidates', 'Maximum number of hinted articles waiting to be rendered',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT,
+            1, GLib.MAXUINT32, DEFAULT_MAX_CANDIDATES),
+    },
+
+    _init: function (props={}) {
+        this.parent(props);
+
+        this._cache = this.cache || RenderCache.get_default();
+        this._renderers = [];
+        this._default_renderer = null;
+        // Most likely first
+        this._candidates = [];
+        this._idle_id = 0;
+        this._busy = false;
+        this._cancellable = new Gio.Cancellable();
+        this._spent = 0;
+    },
+
+    /**
+     * Method: add_renderer
+     * Renders with the configuration of a renderer that articles will be
+     * opened with
+     *
+     * Parameters:
+     *   renderer - an <ArticleHTMLRenderer>
+     */
+    add_renderer: function (renderer) {
+        if (this._renderers.indexOf(renderer) === -1)
+            this._renderers.push(renderer);
+    },
+
+    /**
+     * Method: remove_renderer
+     * Stops rendering for a renderer added with <add_renderer()>
+     *
+     * Parameters:
+     *   renderer - an <ArticleHTMLRenderer>
+     */
+    remove_renderer: function (renderer) {
+        this._renderers = this._renderers.filter(other => other !== renderer);
+    },
+
+    // One renderer for each configuration in use
+    _get_renderers: function () {
+        let renderers = new Map();
+        this._renderers.forEach(renderer => {
+            let key = renderer.get_cache_key();
+            if (!renderers.has(key))
+                renderers.set(key, renderer);
+        });
+        if (renderers.size > 0)
+            return [...renderers.values()];
+
+        if (!this._default_renderer) {
+            // Configured like a new EknWebview's renderer
+            this._default_renderer = new ArticleHTMLRenderer.ArticleHTMLRenderer();
+            let app = Gio.Application.get_default();
+            if (app && app.get_web_css_overrides) {
+                this._default_renderer.set_custom_css_files(app.get_web_css_overrides());
+                this._default_renderer.set_custom_js_files(app.get_web_js_overrides());
+            }
+        }
+        return [this._default_renderer];
+    },
+
+    /**
+     * Method: hint
+     * Hints that the user might open an article soon
+     *
+     * Later hints are taken to be more likely than earlier ones. Models that
+     * aren't articles are ignored.
+     *
+     * Parameters:
+     *   model - a `DModel.Content`
+     */
+    hint: function (model) {
+        if (!(model instanceof DModel.Article))
+            return;
+
+        this._candidates = this._candidates.filter(candidate =>
+            candidate.id !== model.id);
+        this._candidates.unshift(model);
+        this._candidates.splice(this.max_candidates);
+        this._queue_prerender();
+    },
+
+    /**
+     * Method: cancel
+     * Drops all hints and cancels the render in progress, if any
+     *
+     * Also resets the memory budget.
+     */
+    cancel: function () {
+        this._candidates = [];
+        this._cancellable.cancel();
+        this._cancellable = new Gio.Cancellable();
+        this._spent = 0;
+        if (this._idle_id) {
+            GLib.source_remove(this._idle_id);
+            this._idle_id = 0;
+        }
+    },
+
+    /**
+     * Method: watch_history
+     * Hints at articles based on navigation
+     *
+     * Whenever the history changes, outstanding work is cancelled. Then, if
+     * an article was opened from a list, the next one in that list is hinted,
+     * as well as the item to go forward to in the history.
+     *
+     * Parameters:
+     *   history - a <HistoryStore>
+     */
+    watch_history: function (history) {
+        history.connect('changed', () => {
+            this.cancel();
+
+            let item = history.get_current_item();
+            if (item && item.model && item.context) {
+                let ix = item.context.findIndex(model =>
+                    model.id === item.model.id);
+                if (ix !== -1 && ix + 1 < item.context.length)
+                    this.hint(item.context[ix + 1]);
+            }
+
+            let next = history.get_next_item();
+            if (next && next.model)
+                this.hint(next.model);
+        });
+    },
+
+    _queue_prerender: function () {
+        if (this._idle_id || this._busy || this._candidates.length === 0 ||
+            this._spent >= this.memory_budget)
+            return;
+
+        this._idle_id = GLib.idle_add(GLib.PRIORITY_LOW, () => {
+            this._idle_id = 0;
+            this._prerender_next();
+            return GLib.SOURCE_REMOVE;
+        });
+    },
+
+    _prerender_next: function () {
+        let model = this._candidates.shift();
+        if (!model)
+            return;
+
+        let cancellable = this._cancellable;
+        this._busy = true;
+        this._get_renderers().reduce((promise, renderer) => promise.then(() => {
+            if (cancellable.is_cancelled() || this._spent >= this.memory_budget)
+                return;
+            return this._prerender(model, renderer, cancellable);
+        }), Promise.resolve())
+        .catch(e => {
+            if (!e.matches || !e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
+                logError(e, `Could not prerender ${model.id}`);
+        })
+        .then(() => {
+            this._busy = false;
+            this._queue_prerender();
+        });
+    },
+
+    _prerender: function (model, renderer, cancellable) {
+        let key = this._cache.get_key(model, renderer);
+        return this._cache.lookup(key)
+        .then(chunks => {
+            if (chunks || cancellable.is_cancelled())
+                return;
+            return renderer.render_async(model, cancellable)
+            .then(chunks => {
+                this._spent += RenderCache.get_size(chunks);
+                return this._cache.store(key, chunks);
+            });
+        });
+    },
+});
+
+var get_default = (function () {
+    let default_service;
+    return function () {
+        if (!default_service) {
+            default_service = new PrerenderService();
+            default_service.watch_history(HistoryStore.get_default());
+        }
+        return default_service;
+    };
+})();
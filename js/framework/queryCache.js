@@ -0,0 +1,216 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* exported QueryCache, get_default */
+
+const {DModel, EosKnowledgePrivate, GLib, GObject} = imports.gi;
+
+const Knowledge = imports.framework.knowledge;
+
+const DEFAULT_MAX_ENTRIES = 64;
+
+// Query properties whose values are sets, so the order of the elements
+// doesn't change the results
+const SET_PROPERTIES = [
+    'excluded-ids',
+    'excluded-tags',
+    'tags-match-all',
+    'tags-match-any',
+];
+
+/**
+ * Class: QueryCache
+ * Cache of query results in front of `DModel.Engine`
+ *
+ * Many selections on a page run the same queries as each other; a home page
+ * with several content groups, for example, asks for the same sets more than
+ * once. <query()> is a drop-in replacement for `DModel.Engine.query()` that
+ * runs each distinct query only once: a query that is already running
+ * shares its results with the identical queries made while it runs, and the
+ * results of recent queries are kept, up to <max-entries> of them.
+ *
+ * Queries are identified by the values of all their properties, so queries
+ * that are built differently but ask for the same thing share results.
+ *
+ * Results are shared between callers, so they must not be modified.
+ *
+ * All results are thrown away when the engine, its domain, or the domain's
+ * subscriptions change; call <invalidate()> when the content changes in some
+ * other way.
+ */
+var QueryCache = new Knowledge.Class({
+    Name: 'QueryCache',
+    Extends: GObject.Object,
+
+    Properties: {
+        /**
+         * Property: max-entries
+         * Maximum number of query results to keep
+         */
+        'max-entries': GObject.ParamSpec.uint('max-entries', 'Max entries',
+            'Maximum number of query results to keep',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT,
+            0, GLib.MAXUINT32, DEFAULT_MAX_ENTRIES),
+    },
+
+    _init: function (props={}) {
+        this.parent(props);
+
+        // key -> results; least recently used first
+        this._results = new Map();
+        // key -> promise of results
+        this._in_flight = new Map();
+        // What the cached results came from
+        this._engine = null;
+        this._domain = null;
+        this._subscriptions = null;
+
+        this._stats = {
+            hits: 0,
+            in_flight_hits: 0,
+            misses: 0,
+        };
+    },
+
+    /**
+     * Method: get_key
+     * Canonical key of a query
+     *
+     * Parameters:
+     *   query - a `DModel.Query`
+     *
+     * Returns:
+     *   A string that is the same for queries that ask for the same results,
+     *   or null if the query can't be cached.
+     */
+    get_key: function (query) {
+        let values = {};
+        let pspecs = EosKnowledgePrivate.gtype_list_properties(DModel.Query.$gtype);
+        for (let pspec of pspecs) {
+            let value = query[pspec.name.replace(/-/g, '_')];
+            if (Array.isArray(value)) {
+                value = value.slice();
+                if (SET_PROPERTIES.indexOf(pspec.name) !== -1)
+                    value.sort();
+            } else if (value !== null && typeof value === 'object') {
+                return null;
+            }
+            values[pspec.name] = value;
+        }
+        // Property names are in a fixed order, so this is canonical
+        return JSON.stringify(values);
+    },
+
+    /**
+     * Method: get_stats
+     * Hit and miss counters
+     *
+     * Returns:
+     *   An object with the number of queries answered from finished results
+     *   (*hits*), answered by sharing a query that was still running
+     *   (*in_flight_hits*), and sent to the engine (*misses*).
+     */
+    get_stats: function () {
+        return Object.assign({}, this._stats);
+    },
+
+    /**
+     * Method: invalidate
+     * Throws away all results
+     *
+     * Queries that are running when this is called don't have their results
+     * kept.
+     */
+    invalidate: function () {
+        this._results.clear();
+        this._in_flight.clear();
+    },
+
+    _check_engine: function (engine) {
+        let domain = null, subscriptions = '';
+        try {
+            domain = engine.get_domain();
+            subscriptions = domain.get_subscription_ids().join('\n');
+        } catch (e) {
+            // No content, or an engine without domains
+        }
+        if (engine === this._engine && domain === this._domain &&
+            subscriptions === this._subscriptions)
+            return;
+        this.invalidate();
+        this._engine = engine;
+        this._domain = domain;
+        this._subscriptions = subscriptions;
+    },
+
+    _remember: function (key, results) {
+        this._results.delete(key);
+        if (this.max_entries === 0)
+            return;
+        this._results.set(key, results);
+        for (let oldest_key of this._results.keys()) {
+            if (this._results.size <= this.max_entries)
+                break;
+            this._results.delete(oldest_key);
+        }
+    },
+
+    /**
+     * Method: query
+     * Runs a query, or gets its results from the cache
+     *
+     * Parameters:
+     *   query - a `DModel.Query`
+     *
+     * Returns:
+     *   A promise for the results, as from `DModel.Engine.query()`
+     */
+    query: function (query) {
+        let engine = DModel.Engine.get_default();
+        this._check_engine(engine);
+
+        let key = this.get_key(query);
+        if (key === null) {
+            this._stats.misses++;
+            return engine.query(query, null);
+        }
+
+        let results = this._results.get(key);
+        if (results) {
+            this._stats.hits++;
+            this._remember(key, results);
+            return Promise.resolve(results);
+        }
+
+        let promise = this._in_flight.get(key);
+        if (promise) {
+            this._stats.in_flight_hits++;
+            return promise;
+        }
+
+        this._stats.misses++;
+        // Not cancellable, since other callers may come to share it
+        promise = engine.query(query, null)
+        .then(results => {
+            if (this._in_flight.get(key) === promise) {
+                this._in_flight.delete(key);
+                this._remember(key, results);
+            }
+            return results;
+        }, error => {
+            if (this._in_flight.get(key) === promise)
+                this._in_flight.delete(key);
+            throw error;
+        });
+        this._in_flight.set(key, promise);
+        return promise;
+    },
+});
+
+var get_default = (function () {
+    let default_cache;
+    return function () {
+        if (!default_cache)
+            default_cache = new QueryCache();
+        return default_cache;
+    };
+})();
@@ -52,8 +52,10 @@ var ReadingHistoryModel = new Knowledge.Class({
 
         this._pending_operation = null;
         // We store the list of read articles as a set and use set operations to
-        // maintain the list.
+        // maintain the list. The set is in the order the articles were read.
         this._read_articles = new Set();
+        // The latest IDs in the set, worked out when needed
+        this._recently_read = null;
         this._reading_history_file = this.history_file ||
             Gio.File.new_for_path(Gio.Application.get_default().config_dir.get_path() + '/reading_history.json');
         this._load_reading_history_file();
@@ -73,6 +75,7 @@ var ReadingHistoryModel = new Knowledge.Class({
 
         try {
             this._read_articles = new Set(JSON.parse(json_contents));
+            this._recently_read = null;
             if (this._read_articles)
                 this.emit('changed');
         } catch (error) {
@@ -91,7 +94,15 @@ var ReadingHistoryModel = new Knowledge.Class({
     },
 
     mark_article_read: function (article_id) {
+        // Reading an article again moves it to the end
+        this._read_articles.delete(article_id);
         this._read_articles.add(article_id);
+        if (this._recently_read) {
+            let ids = this._recently_read.ids.filter(id => id !== article_id);
+            ids.unshift(article_id);
+            ids.length = Math.min(ids.length, this._recently_read.limit);
+            this._recently_read.ids = ids;
+        }
         this._save_reading_history_file();
         this.emit('changed');
     },
@@ -104,6 +115,23 @@ var ReadingHistoryModel = new Knowledge.Class({
     get_read_articles: function () {
         return this._read_articles;
     },
+
+    /**
+     * Method: get_recently_read_articles
+     * IDs of the articles read most recently, latest first
+     *
+     * Parameters:
+     *   limit - maximum number of IDs to return
+     */
+    get_recently_read_articles: function (limit) {
+        if (!this._recently_read || this._recently_read.limit < limit) {
+            this._recently_read = {
+                limit,
+                ids: [...this._read_articles].slice(-limit).reverse(),
+            };
+        }
+        return this._recently_read.ids.slice(0, limit);
+    },
 });
 
 var get_default = (function () {
@@ -0,0 +1,386 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* exported RenderCache, get_default, get_size, new_input_stream */
+
+const {Gio, GLib, GObject} = imports.gi;
+
+const Knowledge = imports.framework.knowledge;
+const Utils = imports.framework.utils;
+
+const DEFAULT_MEMORY_LIMIT = 8 * 1024 * 1024;
+const DEFAULT_DISK_LIMIT = 64 * 1024 * 1024;
+const FILE_SUFFIX = '.html';
+
+/**
+ * Function: get_size
+ * Total size of a document made of <GLib.Bytes> chunks
+ */
+function get_size (chunks) {
+    return chunks.reduce((size, chunk) => size + chunk.get_size(), 0);
+}
+
+/**
+ * Function: new_input_stream
+ * Stream that reads a document made of <GLib.Bytes> chunks without copying
+ * them
+ */
+function new_input_stream (chunks) {
+    let stream = new Gio.MemoryInputStream();
+    chunks.forEach(chunk => stream.add_bytes(chunk));
+    return stream;
+}
+
+/**
+ * Class: RenderCache
+ * Cache of rendered article HTML
+ *
+ * Keeps the final, wrapped HTML of recently opened articles, so that going
+ * back to an article doesn't run it through <ArticleHTMLRenderer> again.
+ * The most recently used documents are kept in memory, and all of them are
+ * also written to disk so that they survive the app being closed. Each store
+ * is limited to a number of bytes; least recently used documents are thrown
+ * away first.
+ *
+ * Keys are made with <get_key()>, which covers the content version as well
+ * as everything about the renderer that changes the output, so there is no
+ * need to invalidate entries when content is updated.
+ */
+var RenderCache = new Knowledge.Class({
+    Name: 'RenderCache',
+    Extends: GObject.Object,
+
+    Properties: {
+        /**
+         * Property: cache-dir
+         * Directory to store rendered documents in
+         *
+         * If not given, a directory in the user's cache directory is used.
+         *
+         * Flags:
+         *   Construct only
+         */
+        'cache-dir': GObject.ParamSpec.object('cache-dir', 'Cache directory',
+            'Directory to store rendered documents in',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT_ONLY,
+            Gio.File.$gtype),
+        /**
+         * Property: memory-limit
+         * Maximum number of bytes of documents to keep in memory
+         */
+        'memory-limit': GObject.ParamSpec.uint('memory-limit', 'Memory limit',
+            'Maximum number of bytes of documents to keep in memory',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT,
+            0, GLib.MAXUINT32, DEFAULT_MEMORY_LIMIT),
+        /**
+         * Property: disk-limit
+         * Maximum number of bytes of documents to keep on disk
+         */
+        'disk-limit': GObject.ParamSpec.uint('disk-limit', 'Disk limit',
+            'Maximum number of bytes of documents to keep on disk',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT,
+            0, GLib.MAXUINT32, DEFAULT_DISK_LIMIT),
+    },
+
+    _init: function (props={}) {
+        this.parent(props);
+
+        this._cache_dir = this.cache_dir ||
+            Utils.get_app_cache_dir('rendered-articles');
+
+        // Map iterates in insertion order, so the least recently used entries
+        // are at the front of both of these.
+        // key -> document, as an array of GLib.Bytes chunks
+        this._memory = new Map();
+        this._memory_size = 0;
+        // key -> size in bytes; loaded from the directory on first use
+        this._disk = null;
+        this._disk_size = 0;
+        this._disk_index_loaded = null;
+        this._dir_created = false;
+
+        this._stats = {
+            memory_hits: 0,
+            disk_hits: 0,
+            misses: 0,
+        };
+    },
+
+    /**
+     * Method: get_key
+     * Key under which to cache a rendered document
+     *
+     * Parameters:
+     *   model - the <DModel.Article> being rendered
+     *   renderer - the <ArticleHTMLRenderer> rendering it
+     */
+    get_key: function (model, renderer) {
+        let parts = [
+            Utils.get_content_version(),
+            model.id,
+            renderer.get_cache_key(),
+        ];
+        return GLib.compute_checksum_for_string(GLib.ChecksumType.SHA256,
+            JSON.stringify(parts), -1);
+    },
+
+    /**
+     * Method: get_stats
+     * Hit and miss counters
+     *
+     * Returns:
+     *   An object with the number of lookups served from memory
+     *   (*memory_hits*), served from disk (*disk_hits*), and not found
+     *   (*misses*).
+     */
+    get_stats: function () {
+        return Object.assign({}, this._stats);
+    },
+
+    _remember: function (key, chunks) {
+        let old = this._memory.get(key);
+        if (old) {
+            this._memory_size -= get_size(old);
+            this._memory.delete(key);
+        }
+
+        let size = get_size(chunks);
+        if (size > this.memory_limit)
+            return;
+
+        this._memory.set(key, chunks);
+        this._memory_size += size;
+        for (let [oldest_key, oldest] of this._memory) {
+            if (this._memory_size <= this.memory_limit)
+                break;
+            this._memory.delete(oldest_key);
+            this._memory_size -= get_size(oldest);
+        }
+    },
+
+    _get_file: function (key) {
+        return this._cache_dir.get_child(key + FILE_SUFFIX);
+    },
+
+    _load_disk_index: function () {
+        if (this._disk_index_loaded)
+            return this._disk_index_loaded;
+
+        this._disk_index_loaded = new Promise(resolve => {
+            let entries = [];
+            let attributes = [
+                Gio.FILE_ATTRIBUTE_STANDARD_NAME,
+                Gio.FILE_ATTRIBUTE_STANDARD_SIZE,
+                Gio.FILE_ATTRIBUTE_TIME_MODIFIED,
+            ].join(',');
+
+            let done = () => {
+                entries.sort((a, b) => a.mtime - b.mtime);
+                this._disk = new Map();
+                this._disk_size = 0;
+                entries.forEach(({key, size}) => {
+                    this._disk.set(key, size);
+                    this._disk_size += size;
+                });
+                resolve();
+            };
+
+            let next_files = enumerator => {
+                enumerator.next_files_async(100, GLib.PRIORITY_LOW, null,
+                    (obj, res) => {
+                        let infos;
+                        try {
+                            infos = enumerator.next_files_finish(res);
+                        } catch (e) {
+                            logError(e, 'Could not read render cache');
+                            infos = [];
+                        }
+                        if (infos.length === 0) {
+                            enumerator.close_async(GLib.PRIORITY_LOW, null, null);
+                            done();
+                            return;
+                        }
+                        infos.forEach(info => {
+                            let name = info.get_name();
+                            if (!name.endsWith(FILE_SUFFIX))
+                                return;
+                            entries.push({
+                                key: name.slice(0, -FILE_SUFFIX.length),
+                                size: info.get_size(),
+                                mtime: info.get_attribute_uint64(Gio.FILE_ATTRIBUTE_TIME_MODIFIED),
+                            });
+                        });
+                        next_files(enumerator);
+                    });
+            };
+
+            this._cache_dir.enumerate_children_async(attributes,
+                Gio.FileQueryInfoFlags.NONE, GLib.PRIORITY_LOW, null,
+                (obj, res) => {
+                    try {
+                        next_files(this._cache_dir.enumerate_children_finish(res));
+                    } catch (e) {
+                        if (!e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.NOT_FOUND))
+                            logError(e, 'Could not read render cache');
+                        done();
+                    }
+                });
+        });
+        return this._disk_index_loaded;
+    },
+
+    _touch_on_disk: function (key) {
+        let size = this._disk.get(key);
+        this._disk.delete(key);
+        this._disk.set(key, size);
+
+        // Bump the modification time, so that the order of use survives the
+        // index being reloaded
+        let info = new Gio.FileInfo();
+        info.set_attribute_uint64(Gio.FILE_ATTRIBUTE_TIME_MODIFIED,
+            Math.floor(Date.now() / 1000));
+        this._get_file(key).set_attributes_async(info,
+            Gio.FileQueryInfoFlags.NONE, GLib.PRIORITY_LOW, null, null);
+    },
+
+    _trim_disk: function () {
+        for (let [key, size] of this._disk) {
+            if (this._disk_size <= this.disk_limit)
+                break;
+            this._disk.delete(key);
+            this._disk_size -= size;
+            this._get_file(key).delete_async(GLib.PRIORITY_LOW, null, null);
+        }
+    },
+
+    /**
+     * Method: lookup
+     * Looks up a rendered document
+     *
+     * Parameters:
+     *   key - a key from <get_key()>
+     *
+     * Returns:
+     *   A promise that resolves to the document as an array of <GLib.Bytes>
+     *   chunks, or null if it wasn't in the cache.
+     */
+    lookup: function (key) {
+        let chunks = this._memory.get(key);
+        if (chunks) {
+            this._stats.memory_hits++;
+            this._remember(key, chunks);
+            return Promise.resolve(chunks);
+        }
+
+        return this._load_disk_index()
+        .then(() => {
+            if (!this._disk.has(key)) {
+                this._stats.misses++;
+                return null;
+            }
+
+            return new Promise(resolve => {
+                let file = this._get_file(key);
+                file.load_bytes_async(null, (obj, res) => {
+                    try {
+                        let [bytes] = file.load_bytes_finish(res);
+                        this._stats.disk_hits++;
+                        this._touch_on_disk(key);
+                        this._remember(key, [bytes]);
+                        resolve([bytes]);
+                    } catch (e) {
+                        // Deleted behind our back; forget about it
+                        this._disk_size -= this._disk.get(key);
+                        this._disk.delete(key);
+                        this._stats.misses++;
+                        resolve(null);
+                    }
+                });
+            });
+        });
+    },
+
+    _write_to_disk: function (key, chunks) {
+        return new Promise((resolve, reject) => {
+            let file = this._get_file(key);
+            file.replace_async(null, false,
+                Gio.FileCreateFlags.REPLACE_DESTINATION, GLib.PRIORITY_LOW,
+                null, (obj, res) => {
+                    let out;
+                    try {
+                        out = file.replace_finish(res);
+                    } catch (e) {
+                        reject(e);
+                        return;
+                    }
+                    out.splice_async(new_input_stream(chunks),
+                        Gio.OutputStreamSpliceFlags.CLOSE_SOURCE |
+                        Gio.OutputStreamSpliceFlags.CLOSE_TARGET,
+                        GLib.PRIORITY_LOW, null, (obj, res) => {
+                            try {
+                                out.splice_finish(res);
+                                resolve();
+                            } catch (e) {
+                                reject(e);
+                            }
+                        });
+                });
+        });
+    },
+
+    /**
+     * Method: store
+     * Stores a rendered document
+     *
+     * The document is available from memory straight away; writing it to
+     * disk happens in the background.
+     *
+     * Parameters:
+     *   key - a key from <get_key()>
+     *   chunks - the document as an array of <GLib.Bytes> chunks
+     *
+     * Returns:
+     *   A promise that resolves when the document has been written to disk.
+     */
+    store: function (key, chunks) {
+        this._remember(key, chunks);
+
+        let size = get_size(chunks);
+        return this._load_disk_index()
+        .then(() => {
+            if (size > this.disk_limit)
+                return;
+
+            if (!this._dir_created) {
+                try {
+                    this._cache_dir.make_directory_with_parents(null);
+                } catch (e) {
+                    if (!e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.EXISTS)) {
+                        logError(e, 'Could not create render cache');
+                        return;
+                    }
+                }
+                this._dir_created = true;
+            }
+
+            return this._write_to_disk(key, chunks)
+            .then(() => {
+                if (this._disk.has(key))
+                    this._disk_size -= this._disk.get(key);
+                this._disk.delete(key);
+                this._disk.set(key, size);
+                this._disk_size += size;
+                this._trim_disk();
+            })
+            .catch(e => logError(e, 'Could not write to render cache'));
+        });
+    },
+});
+
+var get_default = (function () {
+    let default_cache;
+    return function () {
+        if (!default_cache)
+            default_cache = new RenderCache();
+        return default_cache;
+    };
+})();
@@ -0,0 +1,288 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* exported TitleIndex, fold, get_default, set_default */
+
+const {DModel, EosKnowledgePrivate, Gio, GLib, GObject} = imports.gi;
+
+const Knowledge = imports.framework.knowledge;
+const Utils = imports.framework.utils;
+
+// Bump this when the format of the index file changes
+const INDEX_VERSION = 2;
+const FILE_SUFFIX = '.gvariant';
+// Number of articles to ask for at once when building the index; each batch
+// is twice as big as the one before, up to the maximum, so that a big
+// corpus takes few queries. DModel can only page by offset, which costs more
+// the further in a query starts.
+const BUILD_BATCH_SIZE = 500;
+const MAX_BUILD_BATCH_SIZE = 8000;
+
+/**
+ * Function: fold
+ * Folds text for matching titles
+ *
+ * Removes accents and case, so that "eclair" matches "Éclair".
+ */
+function fold (text) {
+    return EosKnowledgePrivate.TitleIndex.fold(text);
+}
+
+/**
+ * Class: TitleIndex
+ * Index of article titles for autocompletion
+ *
+ * Finds articles whose title starts with some text, ignoring accents and
+ * case, without going to the database. Articles with an original title are
+ * found by either title.
+ *
+ * The index itself is an `EosKnowledgePrivate.TitleIndex`, a sorted table
+ * that is binary-searched natively. It is built the first time it is asked
+ * for with <load()>, in the background, by reading the titles of all
+ * articles; only their IDs and titles are kept. It is written to disk for
+ * the current version of the content, and later runs map that file instead
+ * of building it again. When the content changes, it is loaded again for the
+ * new content.
+ * Until it is loaded, <lookup()> returns null, and callers should query the
+ * database instead.
+ */
+var TitleIndex = new Knowledge.Class({
+    Name: 'TitleIndex',
+    Extends: GObject.Object,
+
+    Properties: {
+        /**
+         * Property: cache-dir
+         * Directory to store the index in
+         *
+         * If not given, a directory in the user's cache directory is used.
+         *
+         * Flags:
+         *   Construct only
+         */
+        'cache-dir': GObject.ParamSpec.object('cache-dir', 'Cache directory',
+            'Directory to store the index in',
+            GObject.ParamFlags.READWRITE | GObject.ParamFlags.CONSTRUCT_ONLY,
+            Gio.File.$gtype),
+    },
+
+    _init: function (props={}) {
+        this.parent(props);
+
+        this._cache_dir = this.cache_dir || Utils.get_app_cache_dir('title-index');
+
+        // Null until the index can be used
+        this._index = null;
+        // Key that the index was loaded, or is being loaded, for
+        this._key = null;
+        this._loading = null;
+        this._cancellable = null;
+    },
+
+    /**
+     * Method: get_key
+     * Key of the index for the current content
+     *
+     * Returns:
+     *   A string, or null if there is no content to index.
+     */
+    get_key: function () {
+        let content_version = Utils.get_content_version();
+        if (!content_version)
+            return null;
+        return GLib.compute_checksum_for_string(GLib.ChecksumType.SHA256,
+            JSON.stringify([INDEX_VERSION, content_version]), -1);
+    },
+
+    /**
+     * Method: build
+     * Builds the index from models
+     *
+     * Replaces anything that was in the index. The index is kept in memory
+     * only.
+     *
+     * Parameters:
+     *   models - an array of `DModel.Content`, or of objects with *id*,
+     *     *title*, and *original_title* properties
+     */
+    build: function (models) {
+        this._cancel_loading();
+        let index = new EosKnowledgePrivate.TitleIndex();
+        this._add_models(index, models);
+        index.save();
+        this._index = index;
+        this._key = this.get_key();
+        this._loading = Promise.resolve();
+    },
+
+    _cancel_loading: function () {
+        if (this._cancellable)
+            this._cancellable.cancel();
+        this._cancellable = null;
+        this._loading = null;
+        this._index = null;
+    },
+
+    _add_models: function (index, models) {
+        let ids = [];
+        let titles = [];
+        models.forEach(({id, title, original_title}) => {
+            if (title) {
+                ids.push(id);
+                titles.push(title);
+            }
+            if (original_title && original_title !== title) {
+                ids.push(id);
+                titles.push(original_title);
+            }
+        });
+        index.add_titles(ids, titles);
+    },
+
+    _get_file: function (key) {
+        return this._cache_dir.get_child(key + FILE_SUFFIX);
+    },
+
+    // Adds the titles of all articles to the index, a batch at a time; the
+    // models of a batch are dropped as soon as their titles are added. Each
+    // batch is asked for when the main loop is idle, so that building doesn't
+    // get in the way of the UI.
+    _add_all_titles: function (index, cancellable) {
+        let engine = DModel.Engine.get_default();
+        let add_batch = (offset, limit) => {
+            let query = new DModel.Query({
+                offset,
+                limit,
+                tags_match_any: ['EknArticleObject'],
+            });
+            return engine.query(query, cancellable)
+            .then(({models}) => {
+                this._add_models(index, models);
+                if (models.length < limit)
+                    return;
+                return new Promise(resolve => {
+                    GLib.idle_add(GLib.PRIORITY_LOW, () => {
+                        resolve(add_batch(offset + models.length,
+                            Math.min(2 * limit, MAX_BUILD_BATCH_SIZE)));
+                        return GLib.SOURCE_REMOVE;
+                    });
+                });
+            });
+        };
+        return add_batch(0, BUILD_BATCH_SIZE);
+    },
+
+    // Indexes of older content are never used again
+    _delete_stale_files: function (key) {
+        try {
+            let enumerator = this._cache_dir.enumerate_children(
+                Gio.FILE_ATTRIBUTE_STANDARD_NAME, Gio.FileQueryInfoFlags.NONE,
+                null);
+            let info;
+            while ((info = enumerator.next_file(null))) {
+                let name = info.get_name();
+                if (name !== key + FILE_SUFFIX)
+                    this._cache_dir.get_child(name).delete_async(GLib.PRIORITY_LOW,
+                        null, null);
+            }
+            enumerator.close(null);
+        } catch (e) {
+            logError(e, 'Could not clean up title index');
+        }
+    },
+
+    /**
+     * Method: load
+     * Loads the index
+     *
+     * Maps the index from disk if it was already built for the current
+     * content, and otherwise builds it and writes it out.
+     * Does nothing if the index is already loaded or loading for the current
+     * content; if the content changed, the index is loaded again.
+     *
+     * Returns:
+     *   A promise that resolves when the index can be used.
+     */
+    load: function () {
+        let key = this.get_key();
+        if (this._loading && key === this._key)
+            return this._loading;
+
+        this._cancel_loading();
+        this._key = key;
+
+        let index = new EosKnowledgePrivate.TitleIndex({
+            file: key ? this._get_file(key) : null,
+        });
+        try {
+            if (key && index.load()) {
+                this._index = index;
+                this._loading = Promise.resolve();
+                return this._loading;
+            }
+        } catch (e) {
+            if (!e.matches(GLib.FileError, GLib.FileError.NOENT))
+                logError(e, 'Could not read title index');
+        }
+
+        let cancellable = new Gio.Cancellable();
+        this._cancellable = cancellable;
+        let loading = this._add_all_titles(index, cancellable)
+        .then(() => {
+            if (cancellable.is_cancelled())
+                return;
+            this._cancellable = null;
+            index.save();
+            this._index = index;
+            if (key)
+                this._delete_stale_files(key);
+        })
+        .catch(e => {
+            if (cancellable.is_cancelled())
+                return;
+            logError(e, 'Could not build title index');
+            // Try again next time
+            this._cancellable = null;
+            if (this._loading === loading)
+                this._loading = null;
+        });
+        this._loading = loading;
+        return this._loading;
+    },
+
+    /**
+     * Method: lookup
+     * Finds articles whose title starts with some text
+     *
+     * Parameters:
+     *   text - the text that the titles start with
+     *   limit - the maximum number of articles to return
+     *
+     * Returns:
+     *   An array of objects with the *id* and the matching *title* of each
+     *   article, in alphabetical order; or null if the index isn't loaded
+     *   yet, or was loaded for content that has since changed.
+     */
+    lookup: function (text, limit) {
+        if (!this._index || this._key !== this.get_key())
+            return null;
+
+        let [ids, titles] = this._index.lookup(text, limit);
+        return ids.map((id, ix) => {
+            return {id, title: titles[ix]};
+        });
+    },
+});
+
+var [get_default, set_default] = (function () {
+    let default_index;
+    return [
+        function () {
+            if (!default_index)
+                default_index = new TitleIndex();
+            return default_index;
+        },
+        function (index) {
+            default_index = index;
+        },
+    ];
+})();
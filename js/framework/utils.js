@@ -1,5 +1,5 @@
-/* exported dbus_object_path_for_webview, get_css_for_title_and_module,
-get_web_plugin_dbus_name, get_web_plugin_dbus_name_for_webview, intersection,
+/* exported get_css_for_title_and_module, get_app_cache_dir,
+get_content_version, intersection,
 record_search_metric, start_content_access_metric, stop_content_access_metric,
 shows_descendant_with_type, split_out_conditional_knobs, union,
 vfunc_draw_background_default, wrap_dbus_implementation_with_fd_list */
@@ -17,7 +17,7 @@ const MockMetricsModule = {
 const Config = imports.framework.config;
 
 const ByteArray = imports.byteArray;
-const {EosKnowledgePrivate, Gdk, GdkPixbuf, Gio, GjsPrivate, GLib, Gtk, Soup} = imports.gi;
+const {DModel, EosKnowledgePrivate, Gdk, GdkPixbuf, Gio, GjsPrivate, GLib, Gtk, Soup} = imports.gi;
 const EosMetrics = Config.metrics_enabled ? imports.gi.EosMetrics : MockMetricsModule;
 const Format = imports.format;
 const Gettext = imports.gettext;
@@ -265,21 +265,6 @@ function dumb_hash (str) {
     return str.split('').reduce((num, chr) => num + chr.charCodeAt(0), 0);
 }
 
-function get_web_plugin_dbus_name () {
-    let app_id = Gio.Application.get_default().application_id;
-    let pid = new Gio.Credentials().get_unix_pid();
-    return app_id + '.id' + pid;
-}
-
-const DBUS_WEBVIEW_EXPORT_PATH = '/com/endlessm/webview/';
-function dbus_object_path_for_webview (view) {
-    return DBUS_WEBVIEW_EXPORT_PATH + view.get_page_id();
-}
-
-function get_web_plugin_dbus_name_for_webview (view) {
-    return get_web_plugin_dbus_name() + '-' + view.get_page_id();
-}
-
 function shows_descendant_with_type (widget, klass) {
     if (widget instanceof klass)
         return true;
@@ -554,6 +539,59 @@ function ensure_directory (dir) {
     }
 }
 
+// Directory in the user's cache directory, specific to the running app, for
+// the cache called @name
+function get_app_cache_dir (name) {
+    let app = Gio.Application.get_default();
+    let app_id = app ? app.application_id : 'eos-knowledge';
+    return Gio.File.new_for_path(GLib.build_filenamev([
+        GLib.get_user_cache_dir(), app_id, name]));
+}
+
+// Shards are replaced as a whole when content is updated, so their paths and
+// modification times identify the version of the content. Empty if there is
+// no content. Only computed again when the engine, its domain, or the
+// domain's subscriptions change, as when QueryCache decides to invalidate.
+let _content_version = null;
+let _content_version_source = null;
+function get_content_version () {
+    let engine = DModel.Engine.get_default();
+    let domain = null, subscriptions = '', shards = [];
+    try {
+        domain = engine.get_domain();
+        subscriptions = domain.get_subscription_ids().join('\n');
+    } catch (e) {
+        // No content, or an engine without domains
+    }
+    let source = _content_version_source;
+    if (_content_version !== null && source.engine === engine &&
+        source.domain === domain && source.subscriptions === subscriptions)
+        return _content_version;
+
+    try {
+        if (domain)
+            shards = domain.get_shards();
+    } catch (e) {
+        logError(e, 'Could not get content version');
+    }
+    _content_version = shards.map(shard => {
+        try {
+            let info = Gio.File.new_for_path(shard.path).query_info(
+                Gio.FILE_ATTRIBUTE_TIME_MODIFIED, Gio.FileQueryInfoFlags.NONE,
+                null);
+            let mtime = info.get_attribute_uint64(Gio.FILE_ATTRIBUTE_TIME_MODIFIED);
+            return `${shard.path}:${mtime}`;
+        } catch (e) {
+            // The path alone still tells this content apart from other
+            // content
+            logError(e, `Could not get modification time of ${shard.path}`);
+            return shard.path;
+        }
+    }).join('\n');
+    _content_version_source = {engine, domain, subscriptions};
+    return _content_version;
+}
+
 // Set-like operations for arrays: union, intersection
 
 function union(a, b) {
@@ -0,0 +1,354 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+/* exported WebExtensionChannel, get_default */
+
+const {Gio, GLib, GObject} = imports.gi;
+
+const Knowledge = imports.framework.knowledge;
+
+const CHANNEL_INTERFACE_NAME = 'com.endlessm.Knowledge.WebExtension';
+// How long to wait for a web process to announce a page before giving up
+const PAGE_ANNOUNCE_TIMEOUT_SECONDS = 30;
+const CHANNEL_OBJECT_PATH = '/com/endlessm/webview';
+const CHANNEL_INTERFACE = `
+    <node>
+        <interface name="${CHANNEL_INTERFACE_NAME}">
+            <method name="GetResourceFiles">
+                <arg name="resource_files" type="ah" direction="out"/>
+            </method>
+            <signal name="PageCreated">
+                <arg name="page_id" type="t"/>
+            </signal>
+            <signal name="PageDestroyed">
+                <arg name="page_id" type="t"/>
+            </signal>
+        </interface>
+    </node>`;
+
+/**
+ * Class: WebExtensionChannel
+ * Private DBus server for talking to our web extensions
+ *
+ * Instead of owning names on the session bus, the web extensions connect to
+ * this server, over one peer-to-peer connection per web process shared by
+ * all the extensions and pages in it. Pass <address> to the extensions in
+ * their initialization data.
+ *
+ * The extensions announce which pages live on each connection, so calls for a
+ * page can be routed without going through the bus daemon. Proxies are kept
+ * for as long as the page exists, so there is no need to rebuild them for
+ * each call. A page is announced again on a new connection if its web process
+ * is replaced, so signals should be connected with <connect_page_signal()>,
+ * which follows the page, rather than on a proxy.
+ *
+ * The channel also hands the app's resource files to the web processes as
+ * open file descriptors; see <set_resource_files()>.
+ */
+var WebExtensionChannel = new Knowledge.Class({
+    Name: 'WebExtensionChannel',
+    Extends: GObject.Object,
+
+    Properties: {
+        /**
+         * Property: address
+         * DBus address that the web extensions should connect to
+         */
+        'address': GObject.ParamSpec.string('address', 'Address',
+            'DBus address that the web extensions should connect to',
+            GObject.ParamFlags.READABLE, ''),
+    },
+
+    _init: function (props={}) {
+        this.parent(props);
+
+        // page ID -> connection
+        this._connections_by_page = new Map();
+        // page ID -> {resolvers, rejecters, timeout_id} waiting for the page
+        this._page_waiters = new Map();
+        // page ID -> array of {interface_xml, signal_name, callback, proxy,
+        // handler_id} for signals that follow the page
+        this._subscriptions_by_page = new Map();
+        // page ID -> Map of interface XML -> proxy
+        this._proxies_by_page = new Map();
+        // interface XML -> proxy constructor
+        this._proxy_wrappers = new Map();
+        this._connections = new Set();
+        // Open streams of the app's resource files, in registration order
+        this._resource_files = [];
+        this._interface_info = Gio.DBusNodeInfo.new_for_xml(CHANNEL_INTERFACE)
+            .lookup_interface(CHANNEL_INTERFACE_NAME);
+
+        let observer = new Gio.DBusAuthObserver();
+        let uid = new Gio.Credentials().get_unix_user();
+        observer.connect('authorize-authenticated-peer', (obs, stream, credentials) =>
+            credentials !== null && credentials.get_unix_user() === uid);
+
+        this._server = Gio.DBusServer.new_sync(`unix:tmpdir=${GLib.get_tmp_dir()}`,
+            Gio.DBusServerFlags.NONE, Gio.dbus_generate_guid(), observer, null);
+        this._server.connect('new-connection', this._on_new_connection.bind(this));
+        this._server.start();
+    },
+
+    get address() {
+        return this._server.get_client_address();
+    },
+
+    _on_new_connection: function (server, connection) {
+        this._connections.add(connection);
+
+        let registration_id = connection.register_object_with_closures(
+            CHANNEL_OBJECT_PATH, this._interface_info,
+            this._on_method_call.bind(this), null, null);
+
+        let pages = new Set();
+        let signal_id = connection.signal_subscribe(null, CHANNEL_INTERFACE_NAME,
+            null, CHANNEL_OBJECT_PATH, null, Gio.DBusSignalFlags.NONE,
+            (conn, sender, path, iface, signal, params) => {
+                let [page_id] = params.deep_unpack();
+                if (signal === 'PageCreated') {
+                    pages.add(page_id);
+                    this._add_page(page_id, connection);
+                } else if (signal === 'PageDestroyed') {
+                    pages.delete(page_id);
+                    this._remove_page(page_id);
+                }
+            });
+
+        connection.connect('closed', () => {
+            connection.signal_unsubscribe(signal_id);
+            connection.unregister_object(registration_id);
+            pages.forEach(page_id => this._remove_page(page_id));
+            this._connections.delete(connection);
+        });
+
+        return true;  // Accept connection
+    },
+
+    _on_method_call: function (connection, sender, path, iface, method, params, invocation) {
+        if (method !== 'GetResourceFiles') {
+            invocation.return_dbus_error('org.freedesktop.DBus.Error.UnknownMethod',
+                `Unknown method ${method}`);
+            return;
+        }
+        // The list duplicates the descriptors, so ours stay open for the next
+        // web process
+        let fd_list = new Gio.UnixFDList();
+        let handles = this._resource_files.map(({stream}) =>
+            fd_list.append(stream.get_fd()));
+        invocation.return_value_with_unix_fd_list(new GLib.Variant('(ah)',
+            [handles]), fd_list);
+    },
+
+    _add_page: function (page_id, connection) {
+        // Proxies of an earlier announcement may be on another connection
+        this._proxies_by_page.delete(page_id);
+        this._connections_by_page.set(page_id, connection);
+
+        let waiters = this._page_waiters.get(page_id);
+        if (waiters) {
+            this._page_waiters.delete(page_id);
+            GLib.source_remove(waiters.timeout_id);
+            waiters.resolvers.forEach(resolve => resolve(connection));
+        }
+
+        (this._subscriptions_by_page.get(page_id) || []).forEach(subscription =>
+            this._subscribe(page_id, subscription));
+    },
+
+    _remove_page: function (page_id) {
+        this._connections_by_page.delete(page_id);
+        this._proxies_by_page.delete(page_id);
+    },
+
+    _reject_waiters: function (page_id, error) {
+        let waiters = this._page_waiters.get(page_id);
+        if (!waiters)
+            return;
+        this._page_waiters.delete(page_id);
+        if (waiters.timeout_id)
+            GLib.source_remove(waiters.timeout_id);
+        waiters.rejecters.forEach(reject => reject(error));
+    },
+
+    _get_connection: function (page_id) {
+        if (this._connections_by_page.has(page_id))
+            return Promise.resolve(this._connections_by_page.get(page_id));
+        return new Promise((resolve, reject) => {
+            if (!this._page_waiters.has(page_id)) {
+                let timeout_id = GLib.timeout_add_seconds(GLib.PRIORITY_DEFAULT,
+                    PAGE_ANNOUNCE_TIMEOUT_SECONDS, () => {
+                        this._page_waiters.get(page_id).timeout_id = 0;
+                        this._reject_waiters(page_id,
+                            new Gio.IOErrorEnum({
+                                code: Gio.IOErrorEnum.TIMED_OUT,
+                                message: `Page ${page_id} was never announced`,
+                            }));
+                        return GLib.SOURCE_REMOVE;
+                    });
+                this._page_waiters.set(page_id,
+                    {resolvers: [], rejecters: [], timeout_id});
+            }
+            let waiters = this._page_waiters.get(page_id);
+            waiters.resolvers.push(resolve);
+            waiters.rejecters.push(reject);
+        });
+    },
+
+    _subscribe: function (page_id, subscription) {
+        this.get_proxy(page_id, subscription.interface_xml).then(proxy => {
+            // Connected again if the page was announced again meanwhile
+            if (subscription.proxy === proxy ||
+                !(this._subscriptions_by_page.get(page_id) || []).includes(subscription))
+                return;
+            if (subscription.proxy)
+                subscription.proxy.disconnectSignal(subscription.handler_id);
+            subscription.proxy = proxy;
+            subscription.handler_id = proxy.connectSignal(subscription.signal_name,
+                subscription.callback);
+        })
+        .catch(e => {
+            if (!e.matches || !e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED))
+                logError(e, `Could not connect to ${subscription.signal_name}`);
+        });
+    },
+
+    _get_proxy_wrapper: function (interface_xml) {
+        if (!this._proxy_wrappers.has(interface_xml))
+            this._proxy_wrappers.set(interface_xml,
+                Gio.DBusProxy.makeProxyWrapper(interface_xml));
+        return this._proxy_wrappers.get(interface_xml);
+    },
+
+    /**
+     * Method: get_proxy
+     * Get a proxy for a web extension object of a page
+     *
+     * Resolves once the page's web process has announced the page. The
+     * proxy is created once and reused until the page goes away. Rejects if
+     * the page isn't announced within a while, or is released first.
+     *
+     * Parameters:
+     *   page_id - ID of the page, see WebKit2.WebView.get_page_id()
+     *   interface_xml - DBus introspection XML of the interface
+     *
+     * Returns:
+     *   A promise for a proxy as from Gio.DBusProxy.makeProxyWrapper()
+     */
+    get_proxy: function (page_id, interface_xml) {
+        return this._get_connection(page_id).then(connection => {
+            if (!this._proxies_by_page.has(page_id))
+                this._proxies_by_page.set(page_id, new Map());
+            let proxies = this._proxies_by_page.get(page_id);
+            if (!proxies.has(interface_xml)) {
+                let ProxyConstructor = this._get_proxy_wrapper(interface_xml);
+                // There's no bus name on a peer-to-peer connection, and the
+                // extensions don't export any properties to load
+                proxies.set(interface_xml, new ProxyConstructor(connection,
+                    null, `${CHANNEL_OBJECT_PATH}/${page_id}`, undefined,
+                    null, Gio.DBusProxyFlags.DO_NOT_LOAD_PROPERTIES));
+            }
+            return proxies.get(interface_xml);
+        });
+    },
+
+    /**
+     * Method: connect_page_signal
+     * Connect to a signal of a web extension object of a page
+     *
+     * Unlike connecting on a proxy from <get_proxy()>, the callback stays
+     * connected when the page is announced again, for example after its web
+     * process crashed and was replaced, until <release_page()> is called.
+     *
+     * Parameters:
+     *   page_id - ID of the page, see WebKit2.WebView.get_page_id()
+     *   interface_xml - DBus introspection XML of the interface
+     *   signal_name - name of the DBus signal
+     *   callback - function called as for the connectSignal() method of a
+     *     proxy
+     */
+    connect_page_signal: function (page_id, interface_xml, signal_name, callback) {
+        if (!this._subscriptions_by_page.has(page_id))
+            this._subscriptions_by_page.set(page_id, []);
+        let subscription = {interface_xml, signal_name, callback, proxy: null,
+            handler_id: 0};
+        this._subscriptions_by_page.get(page_id).push(subscription);
+        this._subscribe(page_id, subscription);
+    },
+
+    /**
+     * Method: release_page
+     * Stop waiting for a page and disconnect its signals
+     *
+     * Call this when the view of a page is destroyed. Promises from
+     * <get_proxy()> that are still waiting for the page are rejected with
+     * Gio.IOErrorEnum.CANCELLED.
+     *
+     * Parameters:
+     *   page_id - ID of the page, see WebKit2.WebView.get_page_id()
+     */
+    release_page: function (page_id) {
+        (this._subscriptions_by_page.get(page_id) || []).forEach(subscription => {
+            if (subscription.proxy)
+                subscription.proxy.disconnectSignal(subscription.handler_id);
+        });
+        this._subscriptions_by_page.delete(page_id);
+        this._reject_waiters(page_id, new Gio.IOErrorEnum({
+            code: Gio.IOErrorEnum.CANCELLED,
+            message: `Page ${page_id} was released`,
+        }));
+    },
+
+    /**
+     * Method: set_resource_files
+     * Set the resource files that the web processes should register
+     *
+     * The files are opened once here, and sent to each web process when it
+     * asks for them. They should be the same paths, in the same order, as are
+     * passed to the web extensions in their initialization data, since the
+     * extensions fall back to loading those paths if they need the resources
+     * before the files arrive.
+     * A file that can't be opened is left out, so the web processes will
+     * receive fewer files than paths and load all of them from the paths
+     * instead.
+     *
+     * Parameters:
+     *   paths - array of paths to gresource files
+     */
+    set_resource_files: function (paths) {
+        let open_files = new Map(this._resource_files.map(file =>
+            [file.path, file]));
+        this._resource_files = [];
+        paths.forEach(path => {
+            if (open_files.has(path)) {
+                this._resource_files.push(open_files.get(path));
+                return;
+            }
+            try {
+                let stream = Gio.File.new_for_path(path).read(null);
+                this._resource_files.push({path, stream});
+            } catch (e) {
+                logError(e, `Could not open resource file ${path}`);
+            }
+        });
+    },
+
+    /**
+     * Method: has_page
+     * Whether a page's web process has announced the page yet
+     *
+     * Parameters:
+     *   page_id - ID of the page, see WebKit2.WebView.get_page_id()
+     */
+    has_page: function (page_id) {
+        return this._connections_by_page.has(page_id);
+    },
+});
+
+var get_default = (function () {
+    let default_channel;
+    return function () {
+        if (!default_channel)
+            default_channel = new WebExtensionChannel();
+        return default_channel;
+    };
+})();
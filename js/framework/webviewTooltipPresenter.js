@@ -3,12 +3,11 @@
 /* exported WebviewTooltipPresenter */
 
 const Gdk = imports.gi.Gdk;
-const Gio = imports.gi.Gio;
 const GObject = imports.gi.GObject;
 const Gtk = imports.gi.Gtk;
 
 const Knowledge = imports.framework.knowledge;
-const Utils = imports.framework.utils;
+const WebExtensionChannel = imports.framework.webExtensionChannel;
 
 const DBUS_TOOLTIP_INTERFACE = '\
     <node> \
@@ -17,9 +16,12 @@ const DBUS_TOOLTIP_INTERFACE = '\
                 <arg name="pointer_coordinates" type="(uu)" direction="in"/> \
                 <arg name="dom_element_rectangle" type="(uuuu)" direction="out"/> \
             </method> \
+            <method name="GetCoordinatesBatch"> \
+                <arg name="pointer_coordinates" type="a(uu)" direction="in"/> \
+                <arg name="link_rectangles" type="a(uuuu)" direction="out"/> \
+            </method> \
         </interface> \
     </node>';
-const WEBVIEW_OBJECT_PATH = '/com/endlessm/webview';
 
 /**
  * Class: WebviewTooltipPresenter
@@ -60,27 +62,22 @@ var WebviewTooltipPresenter = new Knowledge.Class({
             }
             let mouse_position = this._get_mouse_coordinates(view);
 
-            // Wait for the DBus interface to appear on the bus
-            let dbus_name = Utils.get_web_plugin_dbus_name_for_webview(view);
-            let watch_id = Gio.DBus.watch_name(Gio.BusType.SESSION,
-                dbus_name, Gio.BusNameWatcherFlags.NONE,
-                (connection, name, owner) => {
-                    let ProxyConstructor = Gio.DBusProxy.makeProxyWrapper(DBUS_TOOLTIP_INTERFACE);
-                    let proxy = new ProxyConstructor(connection, dbus_name, WEBVIEW_OBJECT_PATH);
-                    proxy.GetCoordinatesRemote(mouse_position, (coordinates, error) => {
-                        // Fall back to just popping up the tooltip at the
-                        // mouse's position if there was an error.
-                        if (error) {
-                            coordinates = [[mouse_position[0],
-                                mouse_position[1], 1, 1]];
-                            logError(error, 'No tooltip coordinates');
-                        }
-                        this._display_link_tooltip(view, coordinates[0], hit_test.link_uri);
-                        Gio.DBus.unwatch_name(watch_id);
-                    });
-                },
-                null // do nothing when name vanishes
-            );
+            // Resolves once the page is known to the web extensions
+            WebExtensionChannel.get_default()
+            .get_proxy(view.get_page_id(), DBUS_TOOLTIP_INTERFACE)
+            .then(proxy => {
+                proxy.GetCoordinatesRemote(mouse_position, (coordinates, error) => {
+                    // Fall back to just popping up the tooltip at the
+                    // mouse's position if there was an error.
+                    if (error) {
+                        coordinates = [[mouse_position[0],
+                            mouse_position[1], 1, 1]];
+                        logError(error, 'No tooltip coordinates');
+                    }
+                    this._display_link_tooltip(view, coordinates[0], hit_test.link_uri);
+                });
+            })
+            .catch(logError);
         });
     },
 
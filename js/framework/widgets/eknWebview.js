@@ -1,11 +1,60 @@
-const {DModel, Endless, Gdk, Gio, GLib, GObject, Gtk, WebKit2, Maxwell} = imports.gi;
 const ByteArray = imports.byteArray;
+const {Endless, Gdk, Gio, GLib, GObject, Gtk, WebKit2, Maxwell} = imports.gi;
 
 const ArticleHTMLRenderer = imports.framework.articleHTMLRenderer;
 const Config = imports.framework.config;
 const EosKnowledgePrivate = imports.gi.EosKnowledgePrivate;
 const Knowledge = imports.framework.knowledge;
+const RenderCache = imports.framework.renderCache;
 const Utils = imports.framework.utils;
+const WebExtensionChannel = imports.framework.webExtensionChannel;
+
+const DBUS_TELEMETRY_INTERFACE = '\
+    <node> \
+        <interface name="com.endlessm.Knowledge.Telemetry"> \
+            <method name="EnableMetrics"/> \
+            <method name="GetMetrics"> \
+                <arg name="uri" type="s" direction="out"/> \
+                <arg name="metrics" type="a{sd}" direction="out"/> \
+            </method> \
+            <method name="GetResourceTimings"> \
+                <arg name="timings" type="a(sdd)" direction="out"/> \
+            </method> \
+            <signal name="MetricsReady"> \
+                <arg name="uri" type="s"/> \
+                <arg name="metrics" type="a{sd}"/> \
+            </signal> \
+        </interface> \
+    </node>';
+
+const DBUS_CONTENT_READY_INTERFACE = '\
+    <node> \
+        <interface name="com.endlessm.Knowledge.ContentReady"> \
+            <signal name="ContentReady"> \
+                <arg name="uri" type="s"/> \
+            </signal> \
+        </interface> \
+    </node>';
+
+const DBUS_MATHJAX_CACHE_INTERFACE = '\
+    <node> \
+        <interface name="com.endlessm.Knowledge.MathJaxCache"> \
+            <method name="SetTypesetMath"> \
+                <arg name="uri" type="s" direction="in"/> \
+                <arg name="output" type="s" direction="in"/> \
+            </method> \
+            <signal name="MathTypeset"> \
+                <arg name="uri" type="s"/> \
+                <arg name="output" type="s"/> \
+            </signal> \
+        </interface> \
+    </node>';
+
+// Bump when the output captured by the MathJax cache web extension changes
+const TYPESET_MATH_VERSION = 1;
+// Longest that loading an article waits for typeset math to be handed to
+// the web extension; after that, the math is typeset again
+const TYPESET_MATH_RESTORE_TIMEOUT_MS = 200;
 
 function should_enable_inspector() {
     if (Config.inspector_enabled)
@@ -17,6 +66,124 @@ function should_enable_inspector() {
     return false;
 }
 
+// One license viewer is shared by all webviews in the process. It is hidden
+// rather than destroyed when closed, so that its web process keeps running
+// and licenses open without delay.
+let _license_viewer = null;
+// The webview that last opened the license viewer
+let _license_viewer_opener = null;
+let _license_viewer_prewarm_scheduled = false;
+
+function get_license_viewer() {
+    if (!_license_viewer) {
+        _license_viewer = new EosKnowledgePrivate.RuntimeDocumentViewer();
+        _license_viewer.maximize();
+        _license_viewer.connect('delete-event', () => _license_viewer.hide_on_delete());
+    }
+    return _license_viewer;
+}
+
+// Creates the license viewer and starts its web process once the first
+// article has loaded, when there is nothing more urgent to do.
+function prewarm_license_viewer() {
+    if (_license_viewer_prewarm_scheduled)
+        return;
+    _license_viewer_prewarm_scheduled = true;
+    GLib.idle_add(GLib.PRIORITY_LOW, () => {
+        get_license_viewer().prewarm();
+        return GLib.SOURCE_REMOVE;
+    });
+}
+
+// MathJax output captured by the MathJax cache web extension, so that
+// articles with math only need to be typeset on the first visit. The output
+// is stored as one chunk of JSON.
+let _typeset_math_cache = null;
+
+function get_typeset_math_cache() {
+    if (!_typeset_math_cache) {
+        _typeset_math_cache = new RenderCache.RenderCache({
+            cache_dir: Utils.get_app_cache_dir('typeset-math'),
+            memory_limit: 2 * 1024 * 1024,
+            disk_limit: 32 * 1024 * 1024,
+        });
+    }
+    return _typeset_math_cache;
+}
+
+function get_typeset_math_key(model, renderer) {
+    let key = get_typeset_math_cache().get_key(model, renderer);
+    return GLib.compute_checksum_for_string(GLib.ChecksumType.SHA256,
+        `${key}:${TYPESET_MATH_VERSION}`, -1);
+}
+
+// How many web processes serve the article views. By default all of them
+// share one process, which is what uses the least memory; set
+// EKN_WEB_PROCESS_MODEL=multiple to give views their own processes, up to
+// EKN_WEB_PROCESS_LIMIT of them.
+function get_process_model() {
+    if (GLib.getenv('EKN_WEB_PROCESS_MODEL') === 'multiple')
+        return WebKit2.ProcessModel.MULTIPLE_SECONDARY_PROCESSES;
+    return WebKit2.ProcessModel.SHARED_SECONDARY_PROCESS;
+}
+
+function get_process_count_limit() {
+    let limit = Number.parseInt(GLib.getenv('EKN_WEB_PROCESS_LIMIT'), 10);
+    return Number.isNaN(limit) ? 0 : limit;  // 0 means no limit
+}
+
+// Articles are rendered by the view that asked for them, since how an
+// article is rendered depends on the view
+function route_article_request(req, model) {
+    let view = req.get_web_view();
+    if (!view || !('_load_article' in view)) {
+        req.finish_error(new Gio.IOErrorEnum({
+            message: `No view to handle ${req.get_uri()}`,
+            code: Gio.IOErrorEnum.NOT_FOUND,
+        }));
+        return;
+    }
+    view._load_article(req, model);
+}
+
+// All webviews share one context, so that they share web processes, and the
+// URI schemes and web extensions are only set up once.
+let _web_context = null;
+
+function get_web_context() {
+    if (_web_context)
+        return _web_context;
+
+    let context = new WebKit2.WebContext();
+    context.set_process_model(get_process_model());
+    context.set_web_process_count_limit(get_process_count_limit());
+
+    // Need to handle this signal before we make a webview
+    context.connect('initialize-web-extensions', () => {
+        let application = Gio.Application.get_default();
+        context.set_web_extensions_directory(Config.WEB_EXTENSION_DIR);
+        let channel = WebExtensionChannel.get_default();
+        let resource_paths = application.get_all_resource_paths();
+        channel.set_resource_files(resource_paths);
+        let web_extension_data = new GLib.Variant(
+            '(sas)',
+            [
+                channel.address,
+                resource_paths,
+            ],
+        );
+        context.set_web_extensions_initialization_user_data(web_extension_data);
+    });
+    // Everything but articles is served from C, off the main thread
+    let handler = new EosKnowledgePrivate.UriSchemeHandler();
+    handler.connect('article-requested', (handler, req, model) =>
+        route_article_request(req, model));
+    handler.register(context);
+
+    _web_context = context;
+    return _web_context;
+}
+
 /**
  * Class: EknWebview
  * WebKit WebView subclass which provides utility functions for loading
@@ -28,6 +195,10 @@ function should_enable_inspector() {
  * pages in this webview will have the given JS or CSS injected only when the
  * HTML document has finished loading
  *
+ * All EknWebviews share one WebKit context. The number of web processes
+ * behind them can be set with the environment variables
+ * EKN_WEB_PROCESS_MODEL and EKN_WEB_PROCESS_LIMIT.
+ *
  * Parent class:
  *     Maxwell.WebView
  */
@@ -45,6 +216,15 @@ var EknWebview = new Knowledge.Class({
             ArticleHTMLRenderer.ArticleHTMLRenderer),
     },
 
+    Signals: {
+        /**
+         * Event: content-ready
+         * Emitted when the text of the document being loaded has been laid
+         * out and painted, usually well before the load finishes
+         */
+        'content-ready': {},
+    },
+
     // List of the URL schemes we defer to other applications (e.g. a browser).
     EXTERNALLY_HANDLED_SCHEMES: [
         'http',
@@ -54,29 +234,10 @@ var EknWebview = new Knowledge.Class({
     ],
 
     _init: function (params) {
-        let context = new WebKit2.WebContext();
-        params.web_context = context;
+        params.web_context = get_web_context();
 
         let application = Gio.Application.get_default();
 
-        // Need to handle this signal before we make a webview
-        context.connect('initialize-web-extensions', () => {
-            context.set_web_extensions_directory(Config.WEB_EXTENSION_DIR);
-            let web_extension_data = new GLib.Variant(
-                '(sas)',
-                [
-                    Utils.get_web_plugin_dbus_name(),
-                    application.get_all_resource_paths(),
-                ],
-            );
-            context.set_web_extensions_initialization_user_data(web_extension_data);
-        });
-        context.get_security_manager().register_uri_scheme_as_local('ekn');
-        context.register_uri_scheme('ekn', this._load_ekn_uri.bind(this));
-
-        context.get_security_manager().register_uri_scheme_as_local('ekn+zim');
-        context.register_uri_scheme('ekn+zim', this._load_zim_uri.bind(this));
-
         this.parent(params);
         this.renderer = new ArticleHTMLRenderer.ArticleHTMLRenderer();
         this.renderer.set_custom_css_files(application.get_web_css_overrides());
@@ -100,14 +261,86 @@ var EknWebview = new Knowledge.Class({
             GObject.signal_stop_emission_by_name(this, 'query-tooltip');
             return false;
         });
+        this.connect('load-changed', (view, load_event) => {
+            if (load_event === WebKit2.LoadEvent.FINISHED)
+                prewarm_license_viewer();
+        });
         this.connect('unmap', () => {
-            // Destroy License viewer when the view gets hidden
-            if (this._license_view) {
-                this._license_view.destroy();
-                delete this._license_view;
-            }
+            // Hide the license viewer when the view that opened it gets
+            // hidden; other views share the same toplevel
+            if (_license_viewer && _license_viewer_opener === this)
+                _license_viewer.hide();
         });
         gtk_settings.connect('notify::gtk-xft-dpi', this._updateFontSizeFromGtkSettings.bind(this));
+
+        // The page's signals follow it to a new web process if the old one
+        // crashes, until the view goes away
+        let channel = WebExtensionChannel.get_default();
+        let page_id = this.get_page_id();
+        this.connect('destroy', () => {
+            channel.release_page(page_id);
+            if (_license_viewer_opener === this)
+                _license_viewer_opener = null;
+        });
+
+        channel.connect_page_signal(page_id, DBUS_CONTENT_READY_INTERFACE,
+            'ContentReady', (proxy, sender, [uri]) => {
+                if (uri === this.uri)
+                    this.emit('content-ready');
+            });
+
+        // URI and cache key of the article whose math should be captured
+        this._typeset_math_pending = null;
+        channel.connect_page_signal(page_id, DBUS_MATHJAX_CACHE_INTERFACE,
+            'MathTypeset', (proxy, sender, [uri, output]) => {
+                let pending = this._typeset_math_pending;
+                if (!pending || pending.uri !== uri)
+                    return;
+                this._typeset_math_pending = null;
+                get_typeset_math_cache().store(pending.key,
+                    [ByteArray.toGBytes(ByteArray.fromString(output))]);
+            });
+    },
+
+    _get_mathjax_cache_proxy: function () {
+        return WebExtensionChannel.get_default()
+            .get_proxy(this.get_page_id(), DBUS_MATHJAX_CACHE_INTERFACE);
+    },
+
+    // Hands any math typeset on an earlier visit to the web extension, before
+    // the article is loaded. Never waits for a web process that hasn't
+    // announced the page, nor for long on one that has.
+    _restore_typeset_math: function (uri, model) {
+        let cache = get_typeset_math_cache();
+        let key = get_typeset_math_key(model, this.renderer);
+        this._typeset_math_pending = {uri, key};
+        return cache.lookup(key)
+        .then(chunks => {
+            if (!chunks)
+                return;
+            if (!WebExtensionChannel.get_default().has_page(this.get_page_id()))
+                return;
+            this._typeset_math_pending = null;
+            let output = ByteArray.toString(ByteArray.fromGBytes(chunks[0]));
+            let restored = this._get_mathjax_cache_proxy()
+            .then(proxy => new Promise((resolve, reject) => {
+                proxy.SetTypesetMathRemote(uri, output, (result, error) => {
+                    if (error)
+                        reject(error);
+                    else
+                        resolve();
+                });
+            }));
+            let timeout = new Promise(resolve => {
+                GLib.timeout_add(GLib.PRIORITY_DEFAULT,
+                    TYPESET_MATH_RESTORE_TIMEOUT_MS, () => {
+                        resolve();
+                        return GLib.SOURCE_REMOVE;
+                    });
+            });
+            return Promise.race([restored, timeout]);
+        })
+        .catch(logError);
     },
 
     _load_context_menu: function (webview, context_menu, event) {
@@ -122,86 +355,37 @@ var EknWebview = new Knowledge.Class({
         });
     },
 
-    _load_object: function (id, memberName) {
-        return DModel.Engine.get_default().get_object(id, null)
-        .then((model) => {
-            if (!memberName) {
-                if (model instanceof DModel.Article) {
-                    let html = this.renderer.render(model);
-                    let stream = Gio.MemoryInputStream.new_from_bytes(
-                        ByteArray.fromString(html)
-                    );
-                    return [stream, 'text/html; charset=utf-8'];
-                } else {
-                    let stream = model.get_content_stream();
-                    return [stream, null];
-                }
-            } else {
-                let stream = model.get_archive_member_content_stream(memberName);
-                return [stream, null];
-            }
-        });
-    },
-
-    _load_ekn_uri: function (req) {
-        let fail_with_error = (error) => {
-            logError(error);
-            req.finish_error(new Gio.IOErrorEnum({
-                message: error.message,
-                code: 0,
-            }));
-        };
-
-        let cancellable = null;
-
-        let id = req.get_uri();
-
-        if (id.startsWith('ekn://')) {
-            let components = Utils.components_from_id(id);
-            this._load_object(
-                `ekn:///${components[0]}`,
-                components.length === 1 ? null : components[1],
-            ).then(([stream, content_type]) => {
-                req.finish(stream, -1, content_type);
-            }).catch(function (error) {
-                fail_with_error(error);
+    _load_article: function (req, model) {
+        let cache = RenderCache.get_default();
+        let key = cache.get_key(model, this.renderer);
+        let rendered = cache.lookup(key)
+        .then(chunks => {
+            if (chunks)
+                return chunks;
+            return this.renderer.render_async(model)
+            .then(chunks => {
+                cache.store(key, chunks);
+                return chunks;
             });
-        } else {
-            try {
-                let file = Gio.File.new_for_uri(id);
-                let stream = file.read(cancellable);
-                let info = file.query_info(Gio.FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE, Gio.FileQueryInfoFlags.NONE, cancellable);
-                req.finish(stream, -1, info.get_content_type());
-            } catch (error) {
-                fail_with_error(error);
-            }
-        }
-    },
-
-    _load_zim_uri: function (req) {
-        let fail_with_error = (error) => {
+        });
+        Promise.all([rendered, this._restore_typeset_math(req.get_uri(), model)])
+        .then(([chunks]) => {
+            req.finish(RenderCache.new_input_stream(chunks),
+                RenderCache.get_size(chunks), 'text/html; charset=utf-8');
+        })
+        .catch(error => {
             logError(error);
             req.finish_error(new Gio.IOErrorEnum({
                 message: error.message,
                 code: 0,
             }));
-        };
-
-        let id = req.get_uri();
-
-        this._load_object(id)
-            .then(([stream, content_type]) => {
-                req.finish(stream, -1, content_type);
-            })
-            .catch(function (error) {
-                fail_with_error(error);
-            });
+        });
     },
 
     // Tell MathJax to stop any processing; should improve performance when
     // navigating to another page before processing is finished.
     _stop_mathjax: function () {
-        this.run_javascript('if (typeof MathJax !== "undefined") MathJax.Hub.queue.Suspend();',
+        this.run_javascript('if (typeof MathJax !== "undefined" && MathJax.Hub) MathJax.Hub.queue.Suspend();',
             null, null);
     },
 
@@ -211,19 +395,12 @@ var EknWebview = new Knowledge.Class({
             let scheme = GLib.uri_parse_scheme(uri);
             if (scheme !== null && this.EXTERNALLY_HANDLED_SCHEMES.indexOf(scheme) !== -1) {
                 if (scheme === 'license') {
-                    // Create a license viewer
-                    if (!this._license_view) {
-                        this._license_view = new EosKnowledgePrivate.RuntimeDocumentViewer({
-                            transient_for: this.get_toplevel(),
-                        });
-                        this._license_view.maximize();
-                        this._license_view.connect('destroy', () => {
-                            this._license_view = null;
-                        });
-                    }
+                    let license_view = get_license_viewer();
+                    license_view.transient_for = this.get_toplevel();
+                    _license_viewer_opener = this;
 
                     let license = GLib.uri_unescape_string(uri.replace('license://', ''), null);
-                    this._license_view.index_uri = Endless.get_license_file(license).get_uri();
+                    license_view.index_uri = Endless.get_license_file(license).get_uri();
                 } else {
                     Gtk.show_uri(null, uri, Gdk.CURRENT_TIME);
                 }
@@ -245,5 +422,81 @@ var EknWebview = new Knowledge.Class({
     _normalizeFontSize: function (size, dpi) {
         // 96 is the base DPI when no font scaling is applied.
         return size * dpi / 96;
-    }
+    },
+
+    _get_telemetry_proxy: function () {
+        return WebExtensionChannel.get_default()
+            .get_proxy(this.get_page_id(), DBUS_TELEMETRY_INTERFACE);
+    },
+
+    /**
+     * Method: enable_load_metrics
+     * Start recording load metrics
+     *
+     * Recording them costs some time while loading, so the telemetry web
+     * extension only does it for pages that ask. Documents loaded after the
+     * returned promise resolves have their metrics recorded.
+     *
+     * Returns:
+     *   A promise that resolves when the page records metrics.
+     */
+    enable_load_metrics: function () {
+        return this._get_telemetry_proxy().then(proxy => new Promise((resolve, reject) => {
+            proxy.EnableMetricsRemote((result, error) => {
+                if (error) {
+                    reject(error);
+                    return;
+                }
+                resolve();
+            });
+        }));
+    },
+
+    /**
+     * Method: get_load_metrics
+     * Get load metrics for the document currently shown
+     *
+     * The metrics are recorded by the telemetry web extension once they are
+     * enabled with <enable_load_metrics()>; times are in milliseconds since
+     * the start of navigation. See lib/web-extensions/telemetryplugin.c for
+     * the full list. Metrics that haven't been recorded yet are missing, so
+     * use <connect_load_metrics()> to get them when the load is complete.
+     *
+     * Returns:
+     *   A promise for an object with the document's `uri` and its `metrics`,
+     *   an object mapping metric names to numbers
+     */
+    get_load_metrics: function () {
+        return this._get_telemetry_proxy().then(proxy => new Promise((resolve, reject) => {
+            proxy.GetMetricsRemote((result, error) => {
+                if (error) {
+                    reject(error);
+                    return;
+                }
+                let [uri, metrics] = result;
+                resolve({uri, metrics});
+            });
+        }));
+    },
+
+    /**
+     * Method: connect_load_metrics
+     * Get load metrics for each document once it is completely loaded
+     *
+     * Also enables the metrics, see <enable_load_metrics()>; load documents
+     * once the returned promise resolves.
+     *
+     * Parameters:
+     *   callback - function called with the document's URI and its metrics,
+     *     as in <get_load_metrics()>
+     *
+     * Returns:
+     *   A promise that resolves when the page records metrics.
+     */
+    connect_load_metrics: function (callback) {
+        WebExtensionChannel.get_default().connect_page_signal(this.get_page_id(),
+            DBUS_TELEMETRY_INTERFACE, 'MetricsReady',
+            (proxy, sender, [uri, metrics]) => callback(uri, metrics));
+        return this.enable_load_metrics();
+    },
 });
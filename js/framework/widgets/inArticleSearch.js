@@ -1,12 +1,29 @@
 // Copyright 2015 Endless Mobile, Inc.
 
 const Gtk = imports.gi.Gtk;
-const WebKit2 = imports.gi.WebKit2;
 
 const Knowledge = imports.framework.knowledge;
 const Utils = imports.framework.utils;
-
-const ARTICLE_SEARCH_MAX_RESULTS = 200;
+const WebExtensionChannel = imports.framework.webExtensionChannel;
+
+// Matches beyond this many are not highlighted, but can still be selected
+const ARTICLE_SEARCH_MAX_HIGHLIGHTS = 200;
+const DBUS_FIND_INTERFACE = '\
+    <node> \
+        <interface name="com.endlessm.Knowledge.FindInArticle"> \
+            <method name="Search"> \
+                <arg name="query" type="s" direction="in"/> \
+                <arg name="max_highlights" type="u" direction="in"/> \
+                <arg name="match_count" type="u" direction="out"/> \
+                <arg name="match_rectangles" type="a(uuuu)" direction="out"/> \
+            </method> \
+            <method name="SelectMatch"> \
+                <arg name="index" type="u" direction="in"/> \
+                <arg name="match_rectangle" type="(uuuu)" direction="out"/> \
+            </method> \
+            <method name="Finish"/> \
+        </interface> \
+    </node>';
 
 var InArticleSearch = new Knowledge.Class({
     Name: 'InArticleSearch',
@@ -19,6 +36,12 @@ var InArticleSearch = new Knowledge.Class({
         });
 
         this._web_view = web_view;
+        // Matches are found and highlighted by the find web extension, which
+        // keeps an index of the article's text
+        this._match_count = 0;
+        this._match_rects = [];
+        this._current_match = -1;
+        this._search_serial = 0;
 
         this._search_entry = new Gtk.SearchEntry({
             hexpand: true,
@@ -60,26 +83,68 @@ var InArticleSearch = new Knowledge.Class({
             this._on_search_mode_changed.bind(this));
     },
 
+    _get_proxy: function () {
+        return WebExtensionChannel.get_default()
+            .get_proxy(this._web_view.get_page_id(), DBUS_FIND_INTERFACE);
+    },
+
     search_changed: function() {
-        this._findController.search(this._search_entry.text,
-                                    WebKit2.FindOptions.CASE_INSENSITIVE |
-                                    WebKit2.FindOptions.WRAP_AROUND,
-                                    ARTICLE_SEARCH_MAX_RESULTS);
+        let serial = ++this._search_serial;
+        let query = this._search_entry.text;
+        this._get_proxy().then(proxy => {
+            proxy.SearchRemote(query, ARTICLE_SEARCH_MAX_HIGHLIGHTS, (result, error) => {
+                // Ignore results for queries that have since been extended
+                if (serial !== this._search_serial)
+                    return;
+                if (error) {
+                    logError(error, 'In-article search failed');
+                    return;
+                }
+                [this._match_count, this._match_rects] = result;
+                this._current_match = -1;
+                if (this._match_count > 0)
+                    this._select_match(0);
+            });
+        })
+        .catch(logError);
+    },
+
+    _select_match: function (index) {
+        // Only the first matches are highlighted, but any can be selected
+        if (this._match_count === 0)
+            return;
+        this._current_match = (index + this._match_count) % this._match_count;
+        this._get_proxy().then(proxy => {
+            proxy.SelectMatchRemote(this._current_match, (result, error) => {
+                if (error)
+                    logError(error, 'Could not select match');
+            });
+        })
+        .catch(logError);
     },
 
     search_next: function() {
-        this._findController.search_next();
+        this._select_match(this._current_match + 1);
     },
 
     search_previous: function() {
-        this._findController.search_previous();
+        this._select_match(this._current_match - 1);
     },
 
     _on_search_mode_changed: function () {
         this.visible = this.search_mode_enabled;
         if (this.search_mode_enabled)
-            this._findController = this._web_view.get_find_controller();
-        else
-            this._findController.search_finish();
+            return;
+        this._search_serial++;
+        this._match_count = 0;
+        this._match_rects = [];
+        this._current_match = -1;
+        this._get_proxy().then(proxy => {
+            proxy.FinishRemote((result, error) => {
+                if (error)
+                    logError(error, 'Could not finish in-article search');
+            });
+        })
+        .catch(logError);
     },
 });
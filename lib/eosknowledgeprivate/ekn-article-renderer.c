@@ -0,0 +1,201 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "config.h"
+#include "ekn-article-renderer.h"
+
+#include <eknr.h>
+#include <string.h>
+
+/* Reading an article's HTML out of the shard and templating it can take
+ * long enough on big articles to drop frames, so that work is done in a
+ * worker thread. Nothing the worker touches is shared with the main thread:
+ * each render gets its own renderer, and the parameters are copies.
+ *
+ * The article wrapper is filled in on the main thread, where the data for it
+ * lives; only the content is rendered here. The document is handed back as
+ * a list of chunks, the two halves of the wrapper with the content in
+ * between, so that it never has to be copied into one buffer. Server-templated
+ * content goes from the shard to the web view as it is, without being
+ * copied or validated again. */
+
+typedef struct {
+  GInputStream *html_stream;  /* owned */
+  GVariant *legacy_params;  /* owned, nullable */
+  gchar *document_head;  /* owned */
+  gchar *document_tail;  /* owned */
+} RenderData;
+
+static void
+render_data_free (RenderData *data)
+{
+  g_clear_object (&data->html_stream);
+  g_clear_pointer (&data->legacy_params, g_variant_unref);
+  g_free (data->document_head);
+  g_free (data->document_tail);
+  g_slice_free (RenderData, data);
+}
+
+/* Reads the whole stream into memory, nul-terminated if asked for */
+static GBytes *
+read_all (GInputStream  *stream,
+          gboolean       nul_terminate,
+          GCancellable  *cancellable,
+          GError       **error)
+{
+  g_autoptr(GOutputStream) out = g_memory_output_stream_new_resizable ();
+
+  if (g_output_stream_splice (out, stream,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+                              cancellable, error) < 0)
+    return NULL;
+  if (nul_terminate &&
+      !g_output_stream_write_all (out, "", 1, NULL, cancellable, error))
+    return NULL;
+  if (!g_output_stream_close (out, cancellable, error))
+    return NULL;
+
+  return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (out));
+}
+
+static GBytes *
+bytes_new_take_string (gchar *string)
+{
+  return g_bytes_new_take (string, strlen (string));
+}
+
+static gchar *
+render_legacy_content (EknrRenderer *renderer,
+                       const gchar  *html,
+                       GVariant     *params)
+{
+  const gchar *source = "", *source_name = "", *original_uri = "",
+    *license = "", *title = "";
+  gboolean show_title = FALSE, enable_scroll_manager = FALSE;
+
+  g_variant_lookup (params, "source", "&s", &source);
+  g_variant_lookup (params, "source-name", "&s", &source_name);
+  g_variant_lookup (params, "original-uri", "&s", &original_uri);
+  g_variant_lookup (params, "license", "&s", &license);
+  g_variant_lookup (params, "title", "&s", &title);
+  g_variant_lookup (params, "show-title", "b", &show_title);
+  g_variant_lookup (params, "enable-scroll-manager", "b",
+                    &enable_scroll_manager);
+
+  return eknr_renderer_render_legacy_content (renderer, html, source,
+                                              source_name, original_uri,
+                                              license, title, show_title,
+                                              enable_scroll_manager);
+}
+
+static void
+render_in_thread (GTask        *task,
+                  gpointer      source_object,
+                  RenderData   *data,
+                  GCancellable *cancellable)
+{
+  GError *error = NULL;
+  gboolean is_legacy = data->legacy_params != NULL;
+
+  g_autoptr(GBytes) html = read_all (data->html_stream, is_legacy,
+                                     cancellable, &error);
+  if (html == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  g_autoptr(GBytes) content = NULL;
+  if (is_legacy)
+    {
+      g_autoptr(EknrRenderer) renderer = eknr_renderer_new ();
+      const gchar *html_string = g_bytes_get_data (html, NULL);
+      content =
+        bytes_new_take_string (render_legacy_content (renderer, html_string,
+                                                      data->legacy_params));
+    }
+  else
+    {
+      content = g_steal_pointer (&html);
+    }
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  GPtrArray *chunks = g_ptr_array_new_full (3, (GDestroyNotify) g_bytes_unref);
+  g_ptr_array_add (chunks,
+                   bytes_new_take_string (g_steal_pointer (&data->document_head)));
+  g_ptr_array_add (chunks, g_steal_pointer (&content));
+  g_ptr_array_add (chunks,
+                   bytes_new_take_string (g_steal_pointer (&data->document_tail)));
+
+  g_task_return_pointer (task, chunks, (GDestroyNotify) g_ptr_array_unref);
+}
+
+/**
+ * ekn_render_article_async:
+ * @html_stream: stream of the article's HTML
+ * @legacy_params: (nullable): a{sv} of parameters for templating legacy
+ *   content, or %NULL if the article is server-templated
+ * @document_head: the article wrapper, up to where the content goes
+ * @document_tail: the rest of the article wrapper
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: (scope async): function to call when the article is rendered
+ * @user_data: (closure): data for @callback
+ *
+ * Reads and renders an article in a worker thread, so that the main loop
+ * keeps running while big articles are rendered.
+ *
+ * @legacy_params may hold the strings "source", "source-name",
+ * "original-uri", "license" and "title", and the booleans "show-title" and
+ * "enable-scroll-manager".
+ * The rendered content goes in between @document_head and @document_tail.
+ */
+void
+ekn_render_article_async (GInputStream        *html_stream,
+                          GVariant            *legacy_params,
+                          const gchar         *document_head,
+                          const gchar         *document_tail,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  g_return_if_fail (G_IS_INPUT_STREAM (html_stream));
+  g_return_if_fail (document_head != NULL);
+  g_return_if_fail (document_tail != NULL);
+
+  RenderData *data = g_slice_new0 (RenderData);
+  data->html_stream = g_object_ref (html_stream);
+  if (legacy_params != NULL)
+    data->legacy_params = g_variant_ref_sink (legacy_params);
+  data->document_head = g_strdup (document_head);
+  data->document_tail = g_strdup (document_tail);
+
+  g_autoptr(GTask) task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ekn_render_article_async);
+  g_task_set_task_data (task, data, (GDestroyNotify) render_data_free);
+  g_task_run_in_thread (task, (GTaskThreadFunc) render_in_thread);
+}
+
+/**
+ * ekn_render_article_finish:
+ * @result: a #GAsyncResult
+ * @error: return location for an error, or %NULL
+ *
+ * Finishes a call to ekn_render_article_async().
+ *
+ * The rendered document is returned in chunks, which can be fed to a
+ * #GMemoryInputStream without copying them.
+ *
+ * Returns: (transfer full) (element-type GBytes): the chunks of the rendered
+ *   HTML document, or %NULL on error
+ */
+GPtrArray *
+ekn_render_article_finish (GAsyncResult  *result,
+                           GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
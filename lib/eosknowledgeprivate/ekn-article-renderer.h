@@ -0,0 +1,25 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#ifndef EKN_ARTICLE_RENDERER_H
+#define EKN_ARTICLE_RENDERER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+void ekn_render_article_async (GInputStream        *html_stream,
+                               GVariant            *legacy_params,
+                               const gchar         *document_head,
+                               const gchar         *document_tail,
+                               GCancellable        *cancellable,
+                               GAsyncReadyCallback  callback,
+                               gpointer             user_data);
+
+GPtrArray *ekn_render_article_finish (GAsyncResult  *result,
+                                      GError       **error);
+
+G_END_DECLS
+
+#endif /* EKN_ARTICLE_RENDERER_H */
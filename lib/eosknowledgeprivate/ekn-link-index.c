@@ -0,0 +1,392 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "config.h"
+#include "ekn-link-index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * SECTION:link-index
+ * @title: Link index
+ * @short_description: Index of which links point to which objects
+ *
+ * Remembers which object each outgoing link of an article resolves to, so
+ * that every link has to be looked up in the content only once. Links are
+ * resolved in batches, so that rendering an article with hundreds of links
+ * takes one pass over them.
+ *
+ * The index is kept in a file as a serialized #GVariant of type a(ss),
+ * sorted by link. That file is mapped into memory as it is and searched in
+ * place, so opening even a big index costs next to nothing. New entries are
+ * kept in memory until ekn_link_index_save() is called.
+ *
+ * Nothing is ever removed from the index, so the file must be specific to
+ * the version of the content.
+ */
+
+struct _EknLinkIndex
+{
+  GObject parent_instance;
+
+  GFile *file;  /* owned, nullable */
+  gboolean loaded;
+  GMappedFile *mapped;  /* owned, nullable */
+  GVariant *table;  /* a(ss) sorted by link, owned, nullable */
+  GHashTable *added;  /* link -> ID, both owned */
+};
+
+enum
+{
+  PROP_0,
+
+  PROP_FILE,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE (EknLinkIndex, ekn_link_index, G_TYPE_OBJECT);
+
+#define TABLE_TYPE G_VARIANT_TYPE ("a(ss)")
+
+static void
+ekn_link_index_init (EknLinkIndex *self)
+{
+  self->added = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       g_free);
+}
+
+static void
+ekn_link_index_set_property (GObject      *object,
+                             guint         prop_id,
+                             const GValue *value,
+                             GParamSpec   *pspec)
+{
+  EknLinkIndex *self = EKN_LINK_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      self->file = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+ekn_link_index_get_property (GObject    *object,
+                             guint       prop_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  EknLinkIndex *self = EKN_LINK_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+unload_table (EknLinkIndex *self)
+{
+  g_clear_pointer (&self->table, g_variant_unref);
+  g_clear_pointer (&self->mapped, g_mapped_file_unref);
+}
+
+static void
+ekn_link_index_finalize (GObject *object)
+{
+  EknLinkIndex *self = EKN_LINK_INDEX (object);
+
+  unload_table (self);
+  g_clear_object (&self->file);
+  g_hash_table_unref (self->added);
+
+  G_OBJECT_CLASS (ekn_link_index_parent_class)->finalize (object);
+}
+
+static void
+ekn_link_index_class_init (EknLinkIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = ekn_link_index_set_property;
+  object_class->get_property = ekn_link_index_get_property;
+  object_class->finalize = ekn_link_index_finalize;
+
+  /**
+   * EknLinkIndex:file:
+   *
+   * File that the index is kept in, or %NULL to keep it in memory only
+   */
+  properties[PROP_FILE] =
+    g_param_spec_object ("file", "File", "File that the index is kept in",
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+ensure_loaded (EknLinkIndex *self)
+{
+  g_autoptr(GError) error = NULL;
+
+  if (self->loaded)
+    return;
+  self->loaded = TRUE;
+
+  if (self->file == NULL)
+    return;
+
+  g_autofree gchar *path = g_file_get_path (self->file);
+  self->mapped = g_mapped_file_new (path, FALSE, &error);
+  if (self->mapped == NULL)
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Couldn't open link index %s: %s", path, error->message);
+      return;
+    }
+
+  /* Not trusted, so that a damaged file can't make us read out of bounds */
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes (self->mapped);
+  self->table = g_variant_ref_sink (g_variant_new_from_bytes (TABLE_TYPE,
+                                                              bytes, FALSE));
+}
+
+/* Binary search of the mapped table */
+static gboolean
+lookup_in_table (EknLinkIndex  *self,
+                 const gchar   *link,
+                 const gchar  **id)
+{
+  if (self->table == NULL)
+    return FALSE;
+
+  gsize low = 0, high = g_variant_n_children (self->table);
+  while (low < high)
+    {
+      gsize middle = low + (high - low) / 2;
+      const gchar *key, *value;
+
+      g_variant_get_child (self->table, middle, "(&s&s)", &key, &value);
+      int cmp = strcmp (link, key);
+      if (cmp == 0)
+        {
+          *id = value;
+          return TRUE;
+        }
+      if (cmp < 0)
+        high = middle;
+      else
+        low = middle + 1;
+    }
+  return FALSE;
+}
+
+static gboolean
+lookup (EknLinkIndex  *self,
+        const gchar   *link,
+        const gchar  **id)
+{
+  const gchar *value = g_hash_table_lookup (self->added, link);
+  if (value != NULL)
+    {
+      *id = value;
+      return TRUE;
+    }
+  return lookup_in_table (self, link, id);
+}
+
+/**
+ * ekn_link_index_new:
+ * @file: (nullable): file that the index is kept in, or %NULL to keep it in
+ *   memory only
+ *
+ * Returns: (transfer full): a new #EknLinkIndex
+ */
+EknLinkIndex *
+ekn_link_index_new (GFile *file)
+{
+  return g_object_new (EKN_TYPE_LINK_INDEX, "file", file, NULL);
+}
+
+/**
+ * ekn_link_index_test_links:
+ * @self: the index
+ * @links: (array zero-terminated=1): links to resolve
+ * @resolve: (scope call): function that resolves the links that aren't in
+ *   the index yet
+ * @user_data: (closure): data for @resolve
+ *
+ * Looks up which object each of @links points to. All the links that the
+ * index doesn't know about are passed to @resolve in one call, and its
+ * answers are added to the index.
+ *
+ * Returns: (array zero-terminated=1) (transfer full): the ID of the object
+ *   that each link points to, or an empty string for links that don't point
+ *   to any object, in the same order as @links
+ */
+gchar **
+ekn_link_index_test_links (EknLinkIndex            *self,
+                           const gchar * const     *links,
+                           EknLinkIndexResolveFunc  resolve,
+                           gpointer                 user_data)
+{
+  g_return_val_if_fail (EKN_IS_LINK_INDEX (self), NULL);
+  g_return_val_if_fail (links != NULL, NULL);
+  g_return_val_if_fail (resolve != NULL, NULL);
+
+  ensure_loaded (self);
+
+  guint n_links = g_strv_length ((gchar **) links);
+  gchar **ids = g_new0 (gchar *, n_links + 1);
+  g_autoptr(GHashTable) missing = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GPtrArray) to_resolve = g_ptr_array_new ();
+
+  for (guint ix = 0; ix < n_links; ix++)
+    {
+      const gchar *id;
+      if (lookup (self, links[ix], &id))
+        ids[ix] = g_strdup (id);
+      else if (g_hash_table_add (missing, (gpointer) links[ix]))
+        g_ptr_array_add (to_resolve, (gpointer) links[ix]);
+    }
+
+  if (to_resolve->len == 0)
+    return ids;
+
+  g_ptr_array_add (to_resolve, NULL);
+  g_auto(GStrv) resolved = resolve ((const gchar * const *) to_resolve->pdata,
+                                    user_data);
+
+  guint n_resolved = resolved ? g_strv_length (resolved) : 0;
+  for (guint ix = 0; ix < to_resolve->len - 1; ix++)
+    {
+      const gchar *id = ix < n_resolved ? resolved[ix] : "";
+      g_hash_table_insert (self->added, g_strdup (to_resolve->pdata[ix]),
+                           g_strdup (id));
+    }
+
+  for (guint ix = 0; ix < n_links; ix++)
+    {
+      if (ids[ix] == NULL)
+        ids[ix] = g_strdup (g_hash_table_lookup (self->added, links[ix]));
+    }
+
+  return ids;
+}
+
+/**
+ * ekn_link_index_is_dirty:
+ * @self: the index
+ *
+ * Returns: %TRUE if links have been added since the index was last saved
+ */
+gboolean
+ekn_link_index_is_dirty (EknLinkIndex *self)
+{
+  g_return_val_if_fail (EKN_IS_LINK_INDEX (self), FALSE);
+
+  return g_hash_table_size (self->added) > 0;
+}
+
+static int
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+  return strcmp (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+/**
+ * ekn_link_index_save:
+ * @self: the index
+ * @error: return location for an error, or %NULL
+ *
+ * Writes the links that have been added to the index to its file, if it
+ * has one.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+ekn_link_index_save (EknLinkIndex  *self,
+                     GError       **error)
+{
+  g_return_val_if_fail (EKN_IS_LINK_INDEX (self), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (self->file == NULL || !ekn_link_index_is_dirty (self))
+    return TRUE;
+
+  ensure_loaded (self);
+
+  guint n_added;
+  g_autofree const gchar **added =
+    (const gchar **) g_hash_table_get_keys_as_array (self->added, &n_added);
+  qsort (added, n_added, sizeof (gchar *), compare_strings);
+
+  /* Merge the new links into the sorted table */
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, TABLE_TYPE);
+  gsize n_table = self->table ? g_variant_n_children (self->table) : 0;
+  gsize table_ix = 0;
+  guint added_ix = 0;
+  while (table_ix < n_table || added_ix < n_added)
+    {
+      const gchar *key = NULL, *value = NULL;
+      if (table_ix < n_table)
+        g_variant_get_child (self->table, table_ix, "(&s&s)", &key, &value);
+
+      int cmp = key == NULL ? 1 : added_ix == n_added ? -1 :
+        strcmp (key, added[added_ix]);
+      if (cmp < 0)
+        {
+          g_variant_builder_add (&builder, "(ss)", key, value);
+          table_ix++;
+          continue;
+        }
+      if (cmp == 0)
+        table_ix++;
+      g_variant_builder_add (&builder, "(ss)", added[added_ix],
+                             g_hash_table_lookup (self->added,
+                                                  added[added_ix]));
+      added_ix++;
+    }
+  g_autoptr(GVariant) table = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  g_autoptr(GFile) parent = g_file_get_parent (self->file);
+  g_autoptr(GError) mkdir_error = NULL;
+  if (!g_file_make_directory_with_parents (parent, NULL, &mkdir_error) &&
+      !g_error_matches (mkdir_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+    {
+      g_propagate_error (error, g_steal_pointer (&mkdir_error));
+      return FALSE;
+    }
+
+  /* Replaced atomically, so other processes with the old file mapped keep
+   * seeing the old contents */
+  if (!g_file_replace_contents (self->file, g_variant_get_data (table),
+                                g_variant_get_size (table), NULL, FALSE,
+                                G_FILE_CREATE_REPLACE_DESTINATION, NULL,
+                                NULL, error))
+    return FALSE;
+
+  unload_table (self);
+  self->table = g_steal_pointer (&table);
+  g_hash_table_remove_all (self->added);
+  return TRUE;
+}
@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#ifndef EKN_LINK_INDEX_H
+#define EKN_LINK_INDEX_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define EKN_TYPE_LINK_INDEX (ekn_link_index_get_type ())
+G_DECLARE_FINAL_TYPE (EknLinkIndex, ekn_link_index, EKN, LINK_INDEX, GObject)
+
+/**
+ * EknLinkIndexResolveFunc:
+ * @links: (array zero-terminated=1): links that aren't in the index yet
+ * @user_data: (closure): data passed to ekn_link_index_test_links()
+ *
+ * Resolves links that the index doesn't know about yet.
+ *
+ * Returns: (array zero-terminated=1) (transfer full): the ID of the object
+ *   that each link points to, or an empty string for links that don't point
+ *   to any object, in the same order as @links
+ */
+typedef gchar **(*EknLinkIndexResolveFunc) (const gchar * const *links,
+                                            gpointer             user_data);
+
+EknLinkIndex *ekn_link_index_new        (GFile                   *file);
+
+gchar       **ekn_link_index_test_links (EknLinkIndex            *self,
+                                         const gchar * const     *links,
+                                         EknLinkIndexResolveFunc  resolve,
+                                         gpointer                 user_data);
+
+gboolean      ekn_link_index_is_dirty   (EknLinkIndex            *self);
+
+gboolean      ekn_link_index_save       (EknLinkIndex            *self,
+                                         GError                 **error);
+
+G_END_DECLS
+
+#endif /* EKN_LINK_INDEX_H */
@@ -24,12 +24,42 @@
 
 #include "ekn-runtime-document-viewer.h"
 
+#define DEFAULT_CACHE_SIZE 4
+#define CONTENT_READY_HANDLER "eknContentReady"
+
+/* Tells us when the document's text has been laid out and painted: on the
+ * second animation frame after DOMContentLoaded, or after a short timeout,
+ * since animation frames don't run while the window is hidden */
+static const gchar content_ready_script[] =
+  "document.addEventListener('DOMContentLoaded', function () {"
+  "  var notified = false;"
+  "  function ready() {"
+  "    if (notified)"
+  "      return;"
+  "    notified = true;"
+  "    window.webkit.messageHandlers." CONTENT_READY_HANDLER ".postMessage(null);"
+  "  }"
+  "  requestAnimationFrame(function () { requestAnimationFrame(ready); });"
+  "  setTimeout(ready, 100);"
+  "});";
+
+typedef struct
+{
+  gchar  *uri;
+  gchar  *mime_type;
+  GBytes *contents;
+} CachedDocument;
+
 typedef struct
 {
   gchar *index_uri;
   gchar *index_scheme;
   gboolean show_on_load;
 
+  GQueue       *cache;  /* CachedDocument, most recently used first */
+  guint         cache_size;
+  GCancellable *cancellable;
+
   WebKitWebView *webview;
   GtkHeaderBar  *headerbar;
   GtkWidget     *back;
@@ -47,6 +77,7 @@ enum
 
   PROP_INDEX_URI,
   PROP_SHOW_ON_LOAD,
+  PROP_CACHE_SIZE,
   N_PROPERTIES
 };
 
@@ -58,6 +89,135 @@ G_DEFINE_TYPE_WITH_PRIVATE (EknRuntimeDocumentViewer,
 
 #define ERDV_PRIVATE(d) ((EknRuntimeDocumentViewerPrivate *) ekn_runtime_document_viewer_get_instance_private(d))
 
+static void
+cached_document_free (CachedDocument *doc)
+{
+  g_free (doc->uri);
+  g_free (doc->mime_type);
+  g_bytes_unref (doc->contents);
+  g_slice_free (CachedDocument, doc);
+}
+
+static void
+document_cache_trim (EknRuntimeDocumentViewerPrivate *priv)
+{
+  while (g_queue_get_length (priv->cache) > priv->cache_size)
+    cached_document_free (g_queue_pop_tail (priv->cache));
+}
+
+static CachedDocument *
+document_cache_lookup (EknRuntimeDocumentViewerPrivate *priv,
+                       const gchar                     *uri)
+{
+  GList *l;
+
+  for (l = priv->cache->head; l; l = l->next)
+    {
+      CachedDocument *doc = l->data;
+
+      if (g_str_equal (doc->uri, uri))
+        {
+          /* Move to the front, so that it gets evicted last */
+          g_queue_unlink (priv->cache, l);
+          g_queue_push_head_link (priv->cache, l);
+          return doc;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+document_cache_insert (EknRuntimeDocumentViewerPrivate *priv,
+                       const gchar                     *uri,
+                       const gchar                     *mime_type,
+                       GBytes                          *contents)
+{
+  CachedDocument *doc;
+
+  if (priv->cache_size == 0 || document_cache_lookup (priv, uri))
+    return;
+
+  doc = g_slice_new (CachedDocument);
+  doc->uri = g_strdup (uri);
+  doc->mime_type = g_strdup (mime_type);
+  doc->contents = g_bytes_ref (contents);
+  g_queue_push_head (priv->cache, doc);
+
+  document_cache_trim (priv);
+}
+
+static void
+on_document_contents_loaded (GFile        *file,
+                             GAsyncResult *result,
+                             gpointer      data)
+{
+  g_autoptr(EknRuntimeDocumentViewer) dialog = data;
+  EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (dialog);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *uri = g_file_get_uri (file);
+  g_autofree gchar *content_type = NULL;
+  g_autofree gchar *mime_type = NULL;
+  g_autoptr(GBytes) contents = NULL;
+  gchar *data_contents;
+  gsize length;
+
+  if (!g_file_load_contents_finish (file, result, &data_contents, &length,
+                                    NULL, &error))
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return;
+
+      /* Let WebKit try, and report the error if there is one */
+      webkit_web_view_load_uri (priv->webview, uri);
+      return;
+    }
+
+  contents = g_bytes_new_take (data_contents, length);
+  content_type = g_content_type_guess (uri, (const guchar *) data_contents,
+                                       length, NULL);
+  mime_type = g_content_type_get_mime_type (content_type);
+  if (mime_type == NULL)
+    mime_type = g_strdup ("text/html");
+
+  document_cache_insert (priv, uri, mime_type, contents);
+  webkit_web_view_load_bytes (priv->webview, contents, mime_type, NULL, uri);
+}
+
+static void
+load_document (EknRuntimeDocumentViewer *dialog,
+               const gchar              *uri)
+{
+  EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (dialog);
+  CachedDocument *doc;
+
+  g_cancellable_cancel (priv->cancellable);
+  g_clear_object (&priv->cancellable);
+
+  if ((doc = document_cache_lookup (priv, uri)))
+    {
+      webkit_web_view_load_bytes (priv->webview, doc->contents, doc->mime_type,
+                                  NULL, uri);
+      return;
+    }
+
+  /* Only local documents are worth keeping around; anything else goes
+   * straight to WebKit */
+  if (priv->cache_size == 0 ||
+      !(g_strcmp0 (priv->index_scheme, "file") == 0 ||
+        g_strcmp0 (priv->index_scheme, "resource") == 0))
+    {
+      webkit_web_view_load_uri (priv->webview, uri);
+      return;
+    }
+
+  g_autoptr(GFile) file = g_file_new_for_uri (uri);
+  priv->cancellable = g_cancellable_new ();
+  g_file_load_contents_async (file, priv->cancellable,
+                              (GAsyncReadyCallback) on_document_contents_loaded,
+                              g_object_ref (dialog));
+}
+
 static void
 on_back_forward_list_changed (WebKitBackForwardList     *list,
                               WebKitBackForwardListItem *items_added,
@@ -70,12 +230,41 @@ on_back_forward_list_changed (WebKitBackForwardList     *list,
   gtk_widget_set_sensitive (priv->forward, webkit_web_view_can_go_forward (priv->webview));
 }
 
+static void
+present_loaded_document (EknRuntimeDocumentViewer *dialog)
+{
+  EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (dialog);
+
+  /* index_uri is unset while prewarming, see ekn_runtime_document_viewer_prewarm() */
+  if (priv->show_on_load && priv->index_uri != NULL &&
+      !gtk_widget_get_visible (GTK_WIDGET (dialog)))
+    {
+      /* Presenting the window once the content has been painted avoids
+       * showing a blank webview for a split second, without waiting for
+       * every image to load.
+       */
+      gtk_window_present (GTK_WINDOW (dialog));
+    }
+}
+
+static void
+on_content_ready (WebKitUserContentManager *manager,
+                  WebKitJavascriptResult   *result,
+                  EknRuntimeDocumentViewer *dialog)
+{
+  present_loaded_document (dialog);
+}
+
 static void
 ekn_runtime_document_viewer_init (EknRuntimeDocumentViewer *dialog)
 {
   EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (dialog);
+  WebKitUserContentManager *manager;
+  WebKitUserScript *script;
 
   priv->show_on_load = TRUE;
+  priv->cache = g_queue_new ();
+  priv->cache_size = DEFAULT_CACHE_SIZE;
 
   gtk_widget_init_template (GTK_WIDGET (dialog));
 
@@ -85,6 +274,35 @@ ekn_runtime_document_viewer_init (EknRuntimeDocumentViewer *dialog)
                     "changed",
                     G_CALLBACK (on_back_forward_list_changed),
                     dialog);
+
+  /* This webview doesn't load our web extensions, so use a user script to
+   * find out when the content is ready */
+  manager = webkit_web_view_get_user_content_manager (priv->webview);
+  webkit_user_content_manager_register_script_message_handler (manager,
+                                                               CONTENT_READY_HANDLER);
+  g_signal_connect (manager, "script-message-received::" CONTENT_READY_HANDLER,
+                    G_CALLBACK (on_content_ready), dialog);
+  script = webkit_user_script_new (content_ready_script,
+                                   WEBKIT_USER_CONTENT_INJECT_TOP_FRAME,
+                                   WEBKIT_USER_SCRIPT_INJECT_AT_DOCUMENT_START,
+                                   NULL, NULL);
+  webkit_user_content_manager_add_script (manager, script);
+  webkit_user_script_unref (script);
+}
+
+static void
+ekn_runtime_document_viewer_dispose (GObject *object)
+{
+  EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (EKN_RUNTIME_DOCUMENT_VIEWER (object));
+
+  g_cancellable_cancel (priv->cancellable);
+  g_clear_object (&priv->cancellable);
+
+  if (priv->webview != NULL)
+    g_signal_handlers_disconnect_by_data (webkit_web_view_get_user_content_manager (priv->webview),
+                                          object);
+
+  G_OBJECT_CLASS (ekn_runtime_document_viewer_parent_class)->dispose (object);
 }
 
 static void
@@ -94,6 +312,7 @@ ekn_runtime_document_viewer_finalize (GObject *object)
 
   g_clear_pointer (&priv->index_uri, g_free);
   g_clear_pointer (&priv->index_scheme, g_free);
+  g_queue_free_full (priv->cache, (GDestroyNotify) cached_document_free);
 
   G_OBJECT_CLASS (ekn_runtime_document_viewer_parent_class)->finalize (object);
 }
@@ -116,6 +335,10 @@ ekn_runtime_document_viewer_set_property (GObject      *object,
         ekn_runtime_document_viewer_set_show_on_load (EKN_RUNTIME_DOCUMENT_VIEWER (object),
                                                       g_value_get_boolean (value));
       break;
+      case PROP_CACHE_SIZE:
+        ekn_runtime_document_viewer_set_cache_size (EKN_RUNTIME_DOCUMENT_VIEWER (object),
+                                                    g_value_get_uint (value));
+      break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -141,6 +364,9 @@ ekn_runtime_document_viewer_get_property (GObject    *object,
       case PROP_SHOW_ON_LOAD:
         g_value_set_boolean (value, priv->show_on_load);
       break;
+      case PROP_CACHE_SIZE:
+        g_value_set_uint (value, priv->cache_size);
+      break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -206,16 +432,9 @@ on_webview_load_changed (WebKitWebView            *webview,
                          WebKitLoadEvent           load_event,
                          EknRuntimeDocumentViewer *dialog)
 {
-  EknRuntimeDocumentViewerPrivate *priv = ERDV_PRIVATE (dialog);
-
-  if (load_event == WEBKIT_LOAD_FINISHED && priv->show_on_load &&
-      !gtk_widget_get_visible (GTK_WIDGET (dialog)))
-    {
-      /* Presenting the window at this point of the webview load avoids showing
-       * a blank webview for a split second!
-       */
-      gtk_window_present (GTK_WINDOW (dialog));
-    }
+  /* In case the content was never signalled ready */
+  if (load_event == WEBKIT_LOAD_FINISHED)
+    present_loaded_document (dialog);
 }
 
 static void
@@ -224,6 +443,7 @@ ekn_runtime_document_viewer_class_init (EknRuntimeDocumentViewerClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = ekn_runtime_document_viewer_dispose;
   object_class->finalize = ekn_runtime_document_viewer_finalize;
   object_class->set_property = ekn_runtime_document_viewer_set_property;
   object_class->get_property = ekn_runtime_document_viewer_get_property;
@@ -243,6 +463,13 @@ ekn_runtime_document_viewer_class_init (EknRuntimeDocumentViewerClass *klass)
                           TRUE,
                           G_PARAM_READWRITE);
 
+  properties[PROP_CACHE_SIZE] =
+    g_param_spec_uint ("cache-size",
+                       "Cache size",
+                       "Number of recently displayed local documents to keep in memory",
+                       0, G_MAXUINT, DEFAULT_CACHE_SIZE,
+                       G_PARAM_READWRITE);
+
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 
   /* Template */
@@ -283,6 +510,11 @@ ekn_runtime_document_viewer_get_index_uri (EknRuntimeDocumentViewer *dialog)
  *
  * Sets the index URI to display in the web view.
  *
+ * If the web view is already showing @uri, it is not reloaded; the dialog is
+ * just presented again if #EknRuntimeDocumentViewer:show-on-load is set.
+ * Recently displayed local documents are served from memory, see
+ * #EknRuntimeDocumentViewer:cache-size.
+ *
  */
 void
 ekn_runtime_document_viewer_set_index_uri (EknRuntimeDocumentViewer *dialog,
@@ -297,14 +529,26 @@ ekn_runtime_document_viewer_set_index_uri (EknRuntimeDocumentViewer *dialog,
   if (g_strcmp0 (priv->index_uri, uri))
     {
       g_free (priv->index_uri);
+      g_free (priv->index_scheme);
 
       priv->index_uri = g_strdup (uri);
       priv->index_scheme = g_uri_parse_scheme (uri);
 
       g_object_notify_by_pspec (G_OBJECT (dialog), properties[PROP_INDEX_URI]);
     }
+  else if (g_strcmp0 (webkit_web_view_get_uri (priv->webview), uri) == 0)
+    {
+      /* Same document, either loaded or loading; load-changed takes care of
+       * presenting the dialog in the latter case */
+      if (priv->show_on_load && !webkit_web_view_is_loading (priv->webview))
+        gtk_window_present (GTK_WINDOW (dialog));
+      return;
+    }
+
+  if (uri == NULL)
+    return;
 
-    webkit_web_view_load_uri (priv->webview, uri);
+  load_document (dialog, uri);
 }
 
 
@@ -346,3 +590,74 @@ ekn_runtime_document_viewer_set_show_on_load (EknRuntimeDocumentViewer *dialog,
       g_object_notify_by_pspec (G_OBJECT (dialog), properties[PROP_SHOW_ON_LOAD]);
     }
 }
+
+/**
+ * ekn_runtime_document_viewer_get_cache_size:
+ * @dialog: a #EknRuntimeDocumentViewer
+ *
+ * Returns the number of recently displayed documents kept in memory.
+ *
+ */
+guint
+ekn_runtime_document_viewer_get_cache_size (EknRuntimeDocumentViewer *dialog)
+{
+  g_return_val_if_fail (EKN_IS_RUNTIME_DOCUMENT_VIEWER (dialog), 0);
+  return ERDV_PRIVATE (dialog)->cache_size;
+}
+
+/**
+ * ekn_runtime_document_viewer_set_cache_size:
+ * @dialog: a #EknRuntimeDocumentViewer
+ * @cache_size:
+ *
+ * Sets the number of recently displayed local documents kept in memory, so
+ * that displaying them again does not need to hit the disk. Zero disables
+ * the cache.
+ *
+ */
+void
+ekn_runtime_document_viewer_set_cache_size (EknRuntimeDocumentViewer *dialog,
+                                            guint                     cache_size)
+{
+  EknRuntimeDocumentViewerPrivate *priv;
+
+  g_return_if_fail (EKN_IS_RUNTIME_DOCUMENT_VIEWER (dialog));
+
+  priv = ERDV_PRIVATE (dialog);
+
+  if (priv->cache_size != cache_size)
+    {
+      priv->cache_size = cache_size;
+      document_cache_trim (priv);
+      g_object_notify_by_pspec (G_OBJECT (dialog), properties[PROP_CACHE_SIZE]);
+    }
+}
+
+/**
+ * ekn_runtime_document_viewer_prewarm:
+ * @dialog: a #EknRuntimeDocumentViewer
+ *
+ * Gets the dialog ready to display a document without showing it: realizes
+ * the window and starts the web process by loading a blank page. Does
+ * nothing if a document has already been set.
+ *
+ * Call this at idle priority ahead of time, so that setting
+ * #EknRuntimeDocumentViewer:index-uri later on displays the document
+ * without delay.
+ *
+ */
+void
+ekn_runtime_document_viewer_prewarm (EknRuntimeDocumentViewer *dialog)
+{
+  EknRuntimeDocumentViewerPrivate *priv;
+
+  g_return_if_fail (EKN_IS_RUNTIME_DOCUMENT_VIEWER (dialog));
+
+  priv = ERDV_PRIVATE (dialog);
+
+  if (priv->index_uri != NULL || webkit_web_view_get_uri (priv->webview) != NULL)
+    return;
+
+  gtk_widget_realize (GTK_WIDGET (dialog));
+  webkit_web_view_load_uri (priv->webview, "about:blank");
+}
@@ -40,6 +40,12 @@ gboolean       ekn_runtime_document_viewer_get_show_on_load (EknRuntimeDocumentV
 void           ekn_runtime_document_viewer_set_show_on_load (EknRuntimeDocumentViewer *dialog,
                                                              gboolean                  show_on_load);
 
+guint          ekn_runtime_document_viewer_get_cache_size (EknRuntimeDocumentViewer *dialog);
+void           ekn_runtime_document_viewer_set_cache_size (EknRuntimeDocumentViewer *dialog,
+                                                           guint                     cache_size);
+
+void           ekn_runtime_document_viewer_prewarm (EknRuntimeDocumentViewer *dialog);
+
 G_END_DECLS
 
 #endif /* _EKN_RUNTIME_DOCUMENT_VIEWER_H_ */
@@ -0,0 +1,447 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "config.h"
+#include "ekn-title-index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * SECTION:title-index
+ * @title: Title index
+ * @short_description: Index of article titles for autocompletion
+ *
+ * Finds articles whose title starts with some text, ignoring accents and
+ * case, without going to the database.
+ *
+ * The index is kept in a file as a serialized #GVariant of type a(sss),
+ * holding the folded title, the title, and the ID of each entry, sorted by
+ * folded title. That file is mapped into memory as it is and binary-searched
+ * in place, so opening even a big index costs next to nothing. Titles added
+ * with ekn_title_index_add_titles() can't be found until
+ * ekn_title_index_save() is called.
+ */
+
+typedef struct
+{
+  gchar *key;
+  gchar *title;
+  gchar *id;
+} TitleEntry;
+
+struct _EknTitleIndex
+{
+  GObject parent_instance;
+
+  GFile *file;  /* owned, nullable */
+  GMappedFile *mapped;  /* owned, nullable */
+  GVariant *table;  /* a(sss) sorted by folded title, owned, nullable */
+  GPtrArray *added;  /* TitleEntry, owned */
+};
+
+enum
+{
+  PROP_0,
+
+  PROP_FILE,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE (EknTitleIndex, ekn_title_index, G_TYPE_OBJECT);
+
+#define TABLE_TYPE G_VARIANT_TYPE ("a(sss)")
+
+static void
+title_entry_free (TitleEntry *entry)
+{
+  g_free (entry->key);
+  g_free (entry->title);
+  g_free (entry->id);
+  g_free (entry);
+}
+
+static void
+ekn_title_index_init (EknTitleIndex *self)
+{
+  self->added = g_ptr_array_new_with_free_func ((GDestroyNotify) title_entry_free);
+}
+
+static void
+ekn_title_index_set_property (GObject      *object,
+                              guint         prop_id,
+                              const GValue *value,
+                              GParamSpec   *pspec)
+{
+  EknTitleIndex *self = EKN_TITLE_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      self->file = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+ekn_title_index_get_property (GObject    *object,
+                              guint       prop_id,
+                              GValue     *value,
+                              GParamSpec *pspec)
+{
+  EknTitleIndex *self = EKN_TITLE_INDEX (object);
+
+  switch (prop_id)
+    {
+    case PROP_FILE:
+      g_value_set_object (value, self->file);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+unload_table (EknTitleIndex *self)
+{
+  g_clear_pointer (&self->table, g_variant_unref);
+  g_clear_pointer (&self->mapped, g_mapped_file_unref);
+}
+
+static void
+ekn_title_index_finalize (GObject *object)
+{
+  EknTitleIndex *self = EKN_TITLE_INDEX (object);
+
+  unload_table (self);
+  g_clear_object (&self->file);
+  g_ptr_array_unref (self->added);
+
+  G_OBJECT_CLASS (ekn_title_index_parent_class)->finalize (object);
+}
+
+static void
+ekn_title_index_class_init (EknTitleIndexClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = ekn_title_index_set_property;
+  object_class->get_property = ekn_title_index_get_property;
+  object_class->finalize = ekn_title_index_finalize;
+
+  /**
+   * EknTitleIndex:file:
+   *
+   * File that the index is kept in, or %NULL to keep it in memory only
+   */
+  properties[PROP_FILE] =
+    g_param_spec_object ("file", "File", "File that the index is kept in",
+                         G_TYPE_FILE,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+/**
+ * ekn_title_index_new:
+ * @file: (nullable): file that the index is kept in, or %NULL to keep it in
+ *   memory only
+ *
+ * Returns: (transfer full): a new #EknTitleIndex
+ */
+EknTitleIndex *
+ekn_title_index_new (GFile *file)
+{
+  return g_object_new (EKN_TYPE_TITLE_INDEX, "file", file, NULL);
+}
+
+/**
+ * ekn_title_index_fold:
+ * @text: text to fold
+ *
+ * Folds text for matching titles: removes accents and case, so that
+ * "eclair" matches "Éclair".
+ *
+ * Returns: (transfer full): the folded text
+ */
+gchar *
+ekn_title_index_fold (const gchar *text)
+{
+  g_return_val_if_fail (text != NULL, NULL);
+
+  g_autofree gchar *decomposed = g_utf8_normalize (text, -1,
+                                                   G_NORMALIZE_ALL);
+  if (decomposed == NULL)
+    return g_strdup ("");
+
+  GString *folded = g_string_sized_new (strlen (decomposed));
+  for (const gchar *p = decomposed; *p != '\0'; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+      if (g_unichar_combining_class (c) != 0)
+        continue;
+      g_string_append_unichar (folded, g_unichar_tolower (c));
+    }
+  return g_string_free (folded, FALSE);
+}
+
+/**
+ * ekn_title_index_load:
+ * @self: the index
+ * @error: return location for an error, or %NULL
+ *
+ * Maps the index from its file. If the file doesn't exist, fails with
+ * %G_FILE_ERROR_NOENT, and the index must be built with
+ * ekn_title_index_add_titles() and ekn_title_index_save().
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+ekn_title_index_load (EknTitleIndex  *self,
+                      GError        **error)
+{
+  g_return_val_if_fail (EKN_IS_TITLE_INDEX (self), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (self->file == NULL)
+    {
+      g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+                           "Title index has no file");
+      return FALSE;
+    }
+
+  g_autofree gchar *path = g_file_get_path (self->file);
+  GMappedFile *mapped = g_mapped_file_new (path, FALSE, error);
+  if (mapped == NULL)
+    return FALSE;
+
+  unload_table (self);
+  self->mapped = mapped;
+
+  /* Not trusted, so that a damaged file can't make us read out of bounds */
+  g_autoptr(GBytes) bytes = g_mapped_file_get_bytes (self->mapped);
+  self->table = g_variant_ref_sink (g_variant_new_from_bytes (TABLE_TYPE,
+                                                              bytes, FALSE));
+  return TRUE;
+}
+
+static void
+add_title (EknTitleIndex *self,
+           const gchar   *id,
+           const gchar   *title)
+{
+  TitleEntry *entry = g_new (TitleEntry, 1);
+  entry->key = ekn_title_index_fold (title);
+  entry->title = g_strdup (title);
+  entry->id = g_strdup (id);
+  g_ptr_array_add (self->added, entry);
+}
+
+/**
+ * ekn_title_index_add_titles:
+ * @self: the index
+ * @ids: (array zero-terminated=1): IDs of articles
+ * @titles: (array zero-terminated=1): a title of each article in @ids, in
+ *   the same order
+ *
+ * Adds titles to the index. An article can be added more than once, with
+ * each of its titles; it is found by any of them. Empty titles are left out.
+ */
+void
+ekn_title_index_add_titles (EknTitleIndex       *self,
+                            const gchar * const *ids,
+                            const gchar * const *titles)
+{
+  g_return_if_fail (EKN_IS_TITLE_INDEX (self));
+  g_return_if_fail (ids != NULL);
+  g_return_if_fail (titles != NULL);
+
+  for (guint ix = 0; ids[ix] != NULL && titles[ix] != NULL; ix++)
+    {
+      if (*titles[ix] != '\0')
+        add_title (self, ids[ix], titles[ix]);
+    }
+}
+
+static int
+compare_entries (gconstpointer a,
+                 gconstpointer b)
+{
+  const TitleEntry *entry_a = *(const TitleEntry * const *) a;
+  const TitleEntry *entry_b = *(const TitleEntry * const *) b;
+  int cmp = strcmp (entry_a->key, entry_b->key);
+  if (cmp != 0)
+    return cmp;
+  cmp = strcmp (entry_a->title, entry_b->title);
+  if (cmp != 0)
+    return cmp;
+  return strcmp (entry_a->id, entry_b->id);
+}
+
+/**
+ * ekn_title_index_save:
+ * @self: the index
+ * @error: return location for an error, or %NULL
+ *
+ * Sorts the titles that have been added into the index, so that they can be
+ * found, and writes the index to its file, if it has one.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+ekn_title_index_save (EknTitleIndex  *self,
+                      GError        **error)
+{
+  g_return_val_if_fail (EKN_IS_TITLE_INDEX (self), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* Entries already in the table are borrowed from it */
+  gsize n_table = self->table ? g_variant_n_children (self->table) : 0;
+  g_autoptr(GPtrArray) entries = g_ptr_array_new_full (n_table + self->added->len,
+                                                       g_free);
+  for (gsize ix = 0; ix < n_table; ix++)
+    {
+      TitleEntry *entry = g_new (TitleEntry, 1);
+      g_variant_get_child (self->table, ix, "(&s&s&s)", &entry->key,
+                           &entry->title, &entry->id);
+      g_ptr_array_add (entries, entry);
+    }
+  for (guint ix = 0; ix < self->added->len; ix++)
+    {
+      TitleEntry *entry = g_new (TitleEntry, 1);
+      *entry = *(TitleEntry *) g_ptr_array_index (self->added, ix);
+      g_ptr_array_add (entries, entry);
+    }
+  g_ptr_array_sort (entries, compare_entries);
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, TABLE_TYPE);
+  const TitleEntry *previous = NULL;
+  for (guint ix = 0; ix < entries->len; ix++)
+    {
+      const TitleEntry *entry = g_ptr_array_index (entries, ix);
+      if (previous != NULL && compare_entries (&previous, &entry) == 0)
+        continue;
+      g_variant_builder_add (&builder, "(sss)", entry->key, entry->title,
+                             entry->id);
+      previous = entry;
+    }
+  g_autoptr(GVariant) table = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (self->file != NULL)
+    {
+      g_autoptr(GFile) parent = g_file_get_parent (self->file);
+      g_autoptr(GError) mkdir_error = NULL;
+      if (!g_file_make_directory_with_parents (parent, NULL, &mkdir_error) &&
+          !g_error_matches (mkdir_error, G_IO_ERROR, G_IO_ERROR_EXISTS))
+        {
+          g_propagate_error (error, g_steal_pointer (&mkdir_error));
+          return FALSE;
+        }
+
+      /* Replaced atomically, so other processes with the old file mapped
+       * keep seeing the old contents */
+      if (!g_file_replace_contents (self->file, g_variant_get_data (table),
+                                    g_variant_get_size (table), NULL, FALSE,
+                                    G_FILE_CREATE_REPLACE_DESTINATION, NULL,
+                                    NULL, error))
+        return FALSE;
+    }
+
+  /* The borrowed entries point into the old table */
+  g_clear_pointer (&entries, g_ptr_array_unref);
+  unload_table (self);
+  self->table = g_steal_pointer (&table);
+  g_ptr_array_set_size (self->added, 0);
+  return TRUE;
+}
+
+static const gchar *
+skip_spaces (const gchar *text)
+{
+  while (*text != '\0' && g_unichar_isspace (g_utf8_get_char (text)))
+    text = g_utf8_next_char (text);
+  return text;
+}
+
+/**
+ * ekn_title_index_lookup:
+ * @self: the index
+ * @text: the text that the titles start with
+ * @limit: the maximum number of articles to return
+ * @ids: (out) (array zero-terminated=1) (transfer full): return location for
+ *   the IDs of the articles found
+ * @titles: (out) (array zero-terminated=1) (transfer full): return location
+ *   for the matching title of each article in @ids
+ *
+ * Finds articles whose title starts with @text, ignoring accents, case, and
+ * leading whitespace. Articles are returned once each, in alphabetical order
+ * of the matching title.
+ */
+void
+ekn_title_index_lookup (EknTitleIndex   *self,
+                        const gchar     *text,
+                        guint            limit,
+                        gchar         ***ids,
+                        gchar         ***titles)
+{
+  g_return_if_fail (EKN_IS_TITLE_INDEX (self));
+  g_return_if_fail (text != NULL);
+  g_return_if_fail (ids != NULL);
+  g_return_if_fail (titles != NULL);
+
+  GPtrArray *found_ids = g_ptr_array_new ();
+  GPtrArray *found_titles = g_ptr_array_new ();
+  g_autofree gchar *folded = ekn_title_index_fold (text);
+  const gchar *prefix = skip_spaces (folded);
+
+  if (self->table != NULL && *prefix != '\0' && limit > 0)
+    {
+      /* Binary search for the first key not less than the prefix */
+      gsize n_table = g_variant_n_children (self->table);
+      gsize low = 0, high = n_table;
+      while (low < high)
+        {
+          gsize middle = low + (high - low) / 2;
+          const gchar *key;
+
+          g_variant_get_child (self->table, middle, "(&s&s&s)", &key, NULL,
+                               NULL);
+          if (strcmp (key, prefix) < 0)
+            low = middle + 1;
+          else
+            high = middle;
+        }
+
+      g_autoptr(GHashTable) seen_ids = g_hash_table_new (g_str_hash,
+                                                         g_str_equal);
+      for (gsize ix = low; ix < n_table && found_ids->len < limit; ix++)
+        {
+          const gchar *key, *title, *id;
+
+          g_variant_get_child (self->table, ix, "(&s&s&s)", &key, &title,
+                               &id);
+          if (!g_str_has_prefix (key, prefix))
+            break;
+          if (!g_hash_table_add (seen_ids, (gpointer) id))
+            continue;
+          g_ptr_array_add (found_ids, g_strdup (id));
+          g_ptr_array_add (found_titles, g_strdup (title));
+        }
+    }
+
+  g_ptr_array_add (found_ids, NULL);
+  g_ptr_array_add (found_titles, NULL);
+  *ids = (gchar **) g_ptr_array_free (found_ids, FALSE);
+  *titles = (gchar **) g_ptr_array_free (found_titles, FALSE);
+}
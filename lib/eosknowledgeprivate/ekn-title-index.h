@@ -0,0 +1,37 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#ifndef EKN_TITLE_INDEX_H
+#define EKN_TITLE_INDEX_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define EKN_TYPE_TITLE_INDEX (ekn_title_index_get_type ())
+G_DECLARE_FINAL_TYPE (EknTitleIndex, ekn_title_index, EKN, TITLE_INDEX, GObject)
+
+EknTitleIndex *ekn_title_index_new        (GFile                *file);
+
+gchar         *ekn_title_index_fold       (const gchar          *text);
+
+gboolean       ekn_title_index_load       (EknTitleIndex        *self,
+                                           GError              **error);
+
+void           ekn_title_index_add_titles (EknTitleIndex        *self,
+                                           const gchar * const  *ids,
+                                           const gchar * const  *titles);
+
+gboolean       ekn_title_index_save       (EknTitleIndex        *self,
+                                           GError              **error);
+
+void           ekn_title_index_lookup     (EknTitleIndex        *self,
+                                           const gchar          *text,
+                                           guint                 limit,
+                                           gchar              ***ids,
+                                           gchar              ***titles);
+
+G_END_DECLS
+
+#endif /* EKN_TITLE_INDEX_H */
@@ -0,0 +1,483 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#include "config.h"
+#include "ekn-uri-scheme-handler.h"
+
+#include <dmodel.h>
+#include <string.h>
+
+/**
+ * SECTION:uri-scheme-handler
+ * @title: URI scheme handler
+ * @short_description: Serves ekn:// and ekn+zim:// requests
+ *
+ * Serves content from the knowledge engine to web views: images,
+ * stylesheets, archive members, media, and so on. Objects are looked up
+ * with the engine's async API, and their streams are opened and measured in
+ * worker threads, so a page with many subresources doesn't keep the main
+ * loop busy.
+ *
+ * Responses report their length when the stream is seekable, and byte
+ * ranges are served for requests that ask for them, so that media can be
+ * streamed and seeked.
+ *
+ * Articles themselves need to be rendered before they are shown; requests
+ * for them are handed to the #EknUriSchemeHandler::article-requested signal.
+ */
+
+#define EKN_SCHEME "ekn"
+#define ZIM_SCHEME "ekn+zim"
+
+/* Stream that ends after a number of bytes of its base stream */
+
+#define EKN_TYPE_LIMITED_INPUT_STREAM (ekn_limited_input_stream_get_type ())
+G_DECLARE_FINAL_TYPE (EknLimitedInputStream, ekn_limited_input_stream, EKN, LIMITED_INPUT_STREAM, GFilterInputStream)
+
+struct _EknLimitedInputStream
+{
+  GFilterInputStream parent_instance;
+
+  goffset remaining;
+};
+
+G_DEFINE_TYPE (EknLimitedInputStream, ekn_limited_input_stream,
+               G_TYPE_FILTER_INPUT_STREAM);
+
+static gssize
+ekn_limited_input_stream_read (GInputStream  *stream,
+                               void          *buffer,
+                               gsize          count,
+                               GCancellable  *cancellable,
+                               GError       **error)
+{
+  EknLimitedInputStream *self = EKN_LIMITED_INPUT_STREAM (stream);
+  GInputStream *base = g_filter_input_stream_get_base_stream (G_FILTER_INPUT_STREAM (stream));
+
+  count = MIN (count, (gsize) self->remaining);
+  if (count == 0)
+    return 0;
+
+  gssize n_read = g_input_stream_read (base, buffer, count, cancellable,
+                                       error);
+  if (n_read > 0)
+    self->remaining -= n_read;
+  return n_read;
+}
+
+static void
+ekn_limited_input_stream_init (EknLimitedInputStream *self)
+{
+}
+
+static void
+ekn_limited_input_stream_class_init (EknLimitedInputStreamClass *klass)
+{
+  GInputStreamClass *stream_class = G_INPUT_STREAM_CLASS (klass);
+
+  stream_class->read_fn = ekn_limited_input_stream_read;
+}
+
+static GInputStream *
+ekn_limited_input_stream_new (GInputStream *base,
+                              goffset       length)
+{
+  EknLimitedInputStream *self =
+    g_object_new (EKN_TYPE_LIMITED_INPUT_STREAM, "base-stream", base, NULL);
+  self->remaining = length;
+  return G_INPUT_STREAM (self);
+}
+
+/* Handler */
+
+struct _EknUriSchemeHandler
+{
+  GObject parent_instance;
+};
+
+enum
+{
+  SIGNAL_ARTICLE_REQUESTED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE (EknUriSchemeHandler, ekn_uri_scheme_handler, G_TYPE_OBJECT);
+
+typedef struct
+{
+  EknUriSchemeHandler *handler;  /* owned */
+  WebKitURISchemeRequest *request;  /* owned */
+  gchar *member;  /* owned, nullable */
+  gchar *range_header;  /* owned, nullable */
+  DmContent *content;  /* owned */
+
+  /* Results from the worker thread */
+  GInputStream *stream;  /* owned */
+  gint64 length;  /* -1 if unknown */
+  goffset total_length;  /* -1 if unknown */
+  EknByteRange range;
+  goffset range_start;
+  goffset range_end;  /* inclusive */
+} RequestData;
+
+static void
+request_data_free (RequestData *data)
+{
+  g_clear_object (&data->handler);
+  g_clear_object (&data->request);
+  g_free (data->member);
+  g_free (data->range_header);
+  g_clear_object (&data->content);
+  g_clear_object (&data->stream);
+  g_slice_free (RequestData, data);
+}
+
+static void
+ekn_uri_scheme_handler_init (EknUriSchemeHandler *self)
+{
+}
+
+static void
+ekn_uri_scheme_handler_class_init (EknUriSchemeHandlerClass *klass)
+{
+  /**
+   * EknUriSchemeHandler::article-requested:
+   * @handler: the handler
+   * @request: the request for the article
+   * @article: the requested article
+   *
+   * Emitted when a web view asks for an article, which has to be rendered
+   * before it can be shown. The handler must finish @request.
+   *
+   * If nothing is connected to this signal, the article's content is
+   * served as it is.
+   */
+  signals[SIGNAL_ARTICLE_REQUESTED] =
+    g_signal_new ("article-requested", G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2,
+                  WEBKIT_TYPE_URI_SCHEME_REQUEST, DM_TYPE_ARTICLE);
+}
+
+static void
+finish_with_error (WebKitURISchemeRequest *request,
+                   GError                 *error)
+{
+  g_warning ("Couldn't load %s: %s",
+             webkit_uri_scheme_request_get_uri (request), error->message);
+  webkit_uri_scheme_request_finish_error (request, error);
+}
+
+/**
+ * ekn_uri_scheme_handler_parse_range:
+ * @header: (nullable): value of a request's Range header
+ * @total_length: length of the content in bytes
+ * @start: (out): return location for the first byte of the range
+ * @end: (out): return location for the last byte of the range, inclusive
+ *
+ * Parses a single "bytes=" range against the total length. Multiple ranges
+ * are answered with the whole content. @start and @end are 0 unless the
+ * range is satisfiable.
+ *
+ * Returns: whether there is a range, and whether it can be served
+ */
+EknByteRange
+ekn_uri_scheme_handler_parse_range (const gchar *header,
+                                    goffset      total_length,
+                                    goffset     *start,
+                                    goffset     *end)
+{
+  *start = 0;
+  *end = 0;
+
+  if (header == NULL || !g_str_has_prefix (header, "bytes="))
+    return EKN_BYTE_RANGE_NONE;
+
+  const gchar *spec = header + strlen ("bytes=");
+  if (strchr (spec, ',') != NULL)
+    return EKN_BYTE_RANGE_NONE;
+
+  gchar *rest;
+  if (*spec == '-')
+    {
+      /* Suffix range: the last N bytes */
+      guint64 suffix = g_ascii_strtoull (spec + 1, &rest, 10);
+      if (rest == spec + 1 || *rest != '\0' || suffix == 0 ||
+          total_length == 0)
+        return EKN_BYTE_RANGE_UNSATISFIABLE;
+      *start = total_length - MIN ((goffset) suffix, total_length);
+      *end = total_length - 1;
+      return EKN_BYTE_RANGE_SATISFIABLE;
+    }
+
+  guint64 first = g_ascii_strtoull (spec, &rest, 10);
+  if (rest == spec || *rest != '-')
+    return EKN_BYTE_RANGE_NONE;
+  if ((goffset) first >= total_length)
+    return EKN_BYTE_RANGE_UNSATISFIABLE;
+
+  const gchar *last_spec = rest + 1;
+  guint64 last = total_length - 1;
+  if (*last_spec != '\0')
+    {
+      last = g_ascii_strtoull (last_spec, &rest, 10);
+      if (*rest != '\0' || last < first)
+        return EKN_BYTE_RANGE_NONE;
+      last = MIN (last, (guint64) total_length - 1);
+    }
+
+  *start = first;
+  *end = last;
+  return EKN_BYTE_RANGE_SATISFIABLE;
+}
+
+static void
+open_stream_in_thread (GTask        *task,
+                       gpointer      source_object,
+                       RequestData  *data,
+                       GCancellable *cancellable)
+{
+  GError *error = NULL;
+  GInputStream *stream;
+
+  if (data->member != NULL)
+    stream = dm_content_get_archive_member_content_stream (data->content,
+                                                           data->member,
+                                                           &error);
+  else
+    stream = G_INPUT_STREAM (dm_content_get_content_stream (data->content,
+                                                            &error));
+  if (stream == NULL)
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  data->stream = stream;
+  data->length = -1;
+  data->total_length = -1;
+  data->range = EKN_BYTE_RANGE_NONE;
+
+  /* Without seeking, the length isn't known until the whole stream has been
+   * read, so leave it unknown */
+  if (!G_IS_SEEKABLE (stream) || !g_seekable_can_seek (G_SEEKABLE (stream)))
+    {
+      g_task_return_boolean (task, TRUE);
+      return;
+    }
+
+  GSeekable *seekable = G_SEEKABLE (stream);
+  if (!g_seekable_seek (seekable, 0, G_SEEK_END, cancellable, &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+  data->total_length = g_seekable_tell (seekable);
+  data->length = data->total_length;
+
+  data->range = ekn_uri_scheme_handler_parse_range (data->range_header,
+                                                    data->total_length,
+                                                    &data->range_start,
+                                                    &data->range_end);
+  goffset start = data->range == EKN_BYTE_RANGE_SATISFIABLE ? data->range_start : 0;
+  if (!g_seekable_seek (seekable, start, G_SEEK_SET, cancellable, &error))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
+
+  if (data->range == EKN_BYTE_RANGE_SATISFIABLE)
+    {
+      data->length = data->range_end - data->range_start + 1;
+      data->stream = ekn_limited_input_stream_new (stream, data->length);
+      g_object_unref (stream);
+    }
+  else if (data->range == EKN_BYTE_RANGE_UNSATISFIABLE)
+    {
+      data->length = 0;
+      g_clear_object (&data->stream);
+      data->stream = g_memory_input_stream_new ();
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+on_stream_opened (EknUriSchemeHandler *self,
+                  GAsyncResult        *result,
+                  RequestData         *data)
+{
+  GError *error = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      finish_with_error (data->request, error);
+      g_clear_error (&error);
+      return;
+    }
+
+  /* Archive members don't have a content type of their own; let WebKit
+   * sniff it */
+  const gchar *content_type = NULL;
+  if (data->member == NULL)
+    content_type = dm_content_get_content_type (data->content);
+
+#if WEBKIT_CHECK_VERSION (2, 36, 0)
+  g_autoptr(WebKitURISchemeResponse) response =
+    webkit_uri_scheme_response_new (data->stream, data->length);
+  webkit_uri_scheme_response_set_content_type (response, content_type);
+
+  SoupMessageHeaders *headers =
+    soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+  if (data->total_length >= 0)
+    soup_message_headers_append (headers, "Accept-Ranges", "bytes");
+
+  if (data->range == EKN_BYTE_RANGE_SATISFIABLE)
+    {
+      webkit_uri_scheme_response_set_status (response, 206, NULL);
+      soup_message_headers_set_content_range (headers, data->range_start,
+                                              data->range_end,
+                                              data->total_length);
+    }
+  else if (data->range == EKN_BYTE_RANGE_UNSATISFIABLE)
+    {
+      g_autofree gchar *content_range =
+        g_strdup_printf ("bytes */%" G_GOFFSET_FORMAT, data->total_length);
+      webkit_uri_scheme_response_set_status (response, 416, NULL);
+      soup_message_headers_append (headers, "Content-Range", content_range);
+    }
+
+  webkit_uri_scheme_response_set_http_headers (response, headers);
+  webkit_uri_scheme_request_finish_with_response (data->request, response);
+#else
+  /* Responses with a status can't be made with this WebKit, so ranges are
+   * answered with the whole content */
+  webkit_uri_scheme_request_finish (data->request, data->stream, data->length,
+                                    content_type);
+#endif
+}
+
+static void
+on_object_loaded (DmEngine     *engine,
+                  GAsyncResult *result,
+                  RequestData  *data)
+{
+  GError *error = NULL;
+
+  data->content = dm_engine_get_object_finish (engine, result, &error);
+  if (data->content == NULL)
+    {
+      finish_with_error (data->request, error);
+      g_clear_error (&error);
+      request_data_free (data);
+      return;
+    }
+
+  if (data->member == NULL && DM_IS_ARTICLE (data->content) &&
+      g_signal_has_handler_pending (data->handler,
+                                    signals[SIGNAL_ARTICLE_REQUESTED], 0,
+                                    FALSE))
+    {
+      g_signal_emit (data->handler, signals[SIGNAL_ARTICLE_REQUESTED], 0,
+                     data->request, data->content);
+      request_data_free (data);
+      return;
+    }
+
+  g_autoptr(GTask) task = g_task_new (data->handler, NULL,
+                                      (GAsyncReadyCallback) on_stream_opened,
+                                      data);
+  g_task_set_source_tag (task, on_object_loaded);
+  g_task_set_task_data (task, data, (GDestroyNotify) request_data_free);
+  g_task_run_in_thread (task, (GTaskThreadFunc) open_stream_in_thread);
+}
+
+static void
+on_request (WebKitURISchemeRequest *request,
+            EknUriSchemeHandler    *self)
+{
+  const gchar *uri = webkit_uri_scheme_request_get_uri (request);
+  RequestData *data = g_slice_new0 (RequestData);
+  data->handler = g_object_ref (self);
+  data->request = g_object_ref (request);
+
+#if WEBKIT_CHECK_VERSION (2, 36, 0)
+  SoupMessageHeaders *headers =
+    webkit_uri_scheme_request_get_http_headers (request);
+  if (headers != NULL)
+    data->range_header = g_strdup (soup_message_headers_get_one (headers,
+                                                                 "Range"));
+#endif
+
+  g_autofree gchar *id = NULL;
+  if (g_str_equal (webkit_uri_scheme_request_get_scheme (request), EKN_SCHEME))
+    {
+      /* The URI is of the form ekn://domain/hash[/member]; the domain is
+       * only there for legacy content */
+      g_auto(GStrv) components = NULL;
+      if (g_str_has_prefix (uri, EKN_SCHEME "://"))
+        components = g_strsplit (uri + strlen (EKN_SCHEME "://"), "/", 4);
+      if (components == NULL || components[0] == NULL ||
+          components[1] == NULL)
+        {
+          g_autoptr(GError) error =
+            g_error_new (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                         "Bad ekn:// URI %s", uri);
+          finish_with_error (request, error);
+          request_data_free (data);
+          return;
+        }
+      id = g_strconcat (EKN_SCHEME ":///", components[1], NULL);
+      if (components[2] != NULL && *components[2] != '\0')
+        data->member = g_strdup (components[2]);
+    }
+  else
+    {
+      id = g_strdup (uri);
+    }
+
+  dm_engine_get_object (dm_engine_get_default (), id, NULL,
+                        (GAsyncReadyCallback) on_object_loaded, data);
+}
+
+/**
+ * ekn_uri_scheme_handler_new:
+ *
+ * Returns: (transfer full): a new #EknUriSchemeHandler
+ */
+EknUriSchemeHandler *
+ekn_uri_scheme_handler_new (void)
+{
+  return g_object_new (EKN_TYPE_URI_SCHEME_HANDLER, NULL);
+}
+
+/**
+ * ekn_uri_scheme_handler_register:
+ * @self: the handler
+ * @context: a #WebKitWebContext
+ *
+ * Makes @self serve the ekn:// and ekn+zim:// URIs of web views using
+ * @context.
+ */
+void
+ekn_uri_scheme_handler_register (EknUriSchemeHandler *self,
+                                 WebKitWebContext    *context)
+{
+  g_return_if_fail (EKN_IS_URI_SCHEME_HANDLER (self));
+  g_return_if_fail (WEBKIT_IS_WEB_CONTEXT (context));
+
+  WebKitSecurityManager *security = webkit_web_context_get_security_manager (context);
+  const gchar *schemes[] = { EKN_SCHEME, ZIM_SCHEME };
+
+  for (gsize ix = 0; ix < G_N_ELEMENTS (schemes); ix++)
+    {
+      webkit_security_manager_register_uri_scheme_as_local (security,
+                                                            schemes[ix]);
+      webkit_web_context_register_uri_scheme (context, schemes[ix],
+                                              (WebKitURISchemeRequestCallback) on_request,
+                                              g_object_ref (self),
+                                              g_object_unref);
+    }
+}
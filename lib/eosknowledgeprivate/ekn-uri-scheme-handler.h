@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/* Copyright 2018 Endless Mobile, Inc. */
+
+#ifndef EKN_URI_SCHEME_HANDLER_H
+#define EKN_URI_SCHEME_HANDLER_H
+
+#include <webkit2/webkit2.h>
+
+G_BEGIN_DECLS
+
+/**
+ * EknByteRange:
+ * @EKN_BYTE_RANGE_NONE: no single byte range was asked for, so the whole
+ *   content is served
+ * @EKN_BYTE_RANGE_SATISFIABLE: the range is within the content
+ * @EKN_BYTE_RANGE_UNSATISFIABLE: the range is past the end of the content
+ *
+ * Result of ekn_uri_scheme_handler_parse_range().
+ */
+typedef enum
+{
+  EKN_BYTE_RANGE_NONE,
+  EKN_BYTE_RANGE_SATISFIABLE,
+  EKN_BYTE_RANGE_UNSATISFIABLE,
+} EknByteRange;
+
+#define EKN_TYPE_URI_SCHEME_HANDLER (ekn_uri_scheme_handler_get_type ())
+G_DECLARE_FINAL_TYPE (EknUriSchemeHandler, ekn_uri_scheme_handler, EKN, URI_SCHEME_HANDLER, GObject)
+
+EknUriSchemeHandler *ekn_uri_scheme_handler_new      (void);
+
+void                 ekn_uri_scheme_handler_register (EknUriSchemeHandler *self,
+                                                      WebKitWebContext    *context);
+
+EknByteRange         ekn_uri_scheme_handler_parse_range (const gchar *header,
+                                                         goffset      total_length,
+                                                         goffset     *start,
+                                                         goffset     *end);
+
+G_END_DECLS
+
+#endif /* EKN_URI_SCHEME_HANDLER_H */
@@ -1,6 +1,8 @@
 #include "config.h"
 #include "ekn-util.h"
 
+#include <string.h>
+
 /**
  * ekn_private_new_input_output_window:
  * @widget: the widget to create the window for
@@ -34,6 +36,15 @@ ekn_private_new_input_output_window (GtkWidget *widget)
                          &attributes, attributes_mask);
 }
 
+/* Overrides of interface properties have the value type of the interface's
+ * param spec, but not its class */
+static GParamSpec *
+resolve_override (GParamSpec *pspec)
+{
+  GParamSpec *target = g_param_spec_get_redirect_target (pspec);
+  return target != NULL ? target : pspec;
+}
+
 /**
  * ekn_param_spec_is_enum:
  * @pspec: a GParamSpec
@@ -44,7 +55,7 @@ ekn_private_new_input_output_window (GtkWidget *widget)
 gboolean
 ekn_param_spec_is_enum (GParamSpec *pspec)
 {
-  return G_IS_PARAM_SPEC_ENUM (pspec);
+  return G_IS_PARAM_SPEC_ENUM (resolve_override (pspec));
 }
 
 /**
@@ -62,10 +73,12 @@ ekn_param_spec_is_enum (GParamSpec *pspec)
 gboolean
 ekn_param_spec_enum_value_from_string (GParamSpecEnum *pspec, const gchar *name, gint *value)
 {
+  GEnumClass *enum_class =
+    G_PARAM_SPEC_ENUM (resolve_override (G_PARAM_SPEC (pspec)))->enum_class;
   GEnumValue *enum_value = NULL;
-  enum_value = g_enum_get_value_by_name (pspec->enum_class, name);
+  enum_value = g_enum_get_value_by_name (enum_class, name);
   if (!enum_value)
-    enum_value = g_enum_get_value_by_nick (pspec->enum_class, name);
+    enum_value = g_enum_get_value_by_nick (enum_class, name);
   if (enum_value)
     {
       *value = enum_value->value;
@@ -291,6 +304,133 @@ ekn_extract_pixbuf_dominant_color (GdkPixbuf *pixbuf)
                           (gint) (b * rgb_range));
 }
 
+/* Flattened property metadata for a GType: a class's own properties plus
+ * those of every interface it implements, or an interface's own properties.
+ * Tables are built on first use and live for the rest of the process, since
+ * GTypes are never unregistered. */
+typedef struct
+{
+  GParamSpec **pspecs;
+  unsigned n_pspecs;
+  GHashTable *by_name;  /* canonical name -> GParamSpec */
+} EknPropertyTable;
+
+G_LOCK_DEFINE_STATIC (property_tables);
+static GHashTable *property_tables;  /* GType -> EknPropertyTable */
+
+static void
+property_table_add (EknPropertyTable *table,
+                    GPtrArray        *array,
+                    GParamSpec      **pspecs,
+                    unsigned          n_pspecs)
+{
+  for (unsigned ix = 0; ix < n_pspecs; ix++)
+    {
+      GParamSpec *pspec = pspecs[ix];
+
+      /* A class's override of an interface property comes first and is kept,
+       * so that the class is reported as its owner, as GObject does */
+      if (g_hash_table_contains (table->by_name, pspec->name))
+        continue;
+
+      g_param_spec_ref (pspec);
+      g_hash_table_insert (table->by_name, (gpointer) pspec->name, pspec);
+      g_ptr_array_add (array, pspec);
+    }
+}
+
+static void
+property_table_add_interface (EknPropertyTable *table,
+                              GPtrArray        *array,
+                              GType             iface_type)
+{
+  /* The reference is deliberately kept, the table points into the vtable */
+  gpointer g_iface = g_type_default_interface_ref (iface_type);
+  unsigned n_pspecs;
+  g_autofree GParamSpec **pspecs =
+    g_object_interface_list_properties (g_iface, &n_pspecs);
+  property_table_add (table, array, pspecs, n_pspecs);
+}
+
+static EknPropertyTable *
+property_table_new (GType gtype)
+{
+  EknPropertyTable *table = g_new0 (EknPropertyTable, 1);
+  GPtrArray *array = g_ptr_array_new ();
+  g_autofree GType *ifaces = NULL;
+  unsigned n_ifaces = 0;
+
+  table->by_name = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (G_TYPE_IS_INTERFACE (gtype))
+    {
+      property_table_add_interface (table, array, gtype);
+    }
+  else if (G_TYPE_IS_OBJECT (gtype))
+    {
+      /* As above, the class reference is kept for the lifetime of the table */
+      GObjectClass *klass = g_type_class_ref (gtype);
+      unsigned n_pspecs;
+      g_autofree GParamSpec **pspecs =
+        g_object_class_list_properties (klass, &n_pspecs);
+      property_table_add (table, array, pspecs, n_pspecs);
+      ifaces = g_type_interfaces (gtype, &n_ifaces);
+    }
+
+  for (unsigned ix = 0; ix < n_ifaces; ix++)
+    {
+      if (G_TYPE_IS_INTERFACE (ifaces[ix]))
+        property_table_add_interface (table, array, ifaces[ix]);
+    }
+
+  table->n_pspecs = array->len;
+  g_ptr_array_add (array, NULL);
+  table->pspecs = (GParamSpec **) g_ptr_array_free (array, FALSE);
+  return table;
+}
+
+static void
+property_table_free (EknPropertyTable *table)
+{
+  for (unsigned ix = 0; ix < table->n_pspecs; ix++)
+    g_param_spec_unref (table->pspecs[ix]);
+  g_free (table->pspecs);
+  g_hash_table_unref (table->by_name);
+  g_free (table);
+}
+
+static EknPropertyTable *
+property_table_lookup (GType gtype)
+{
+  EknPropertyTable *table, *existing;
+
+  G_LOCK (property_tables);
+  if (G_UNLIKELY (property_tables == NULL))
+    property_tables = g_hash_table_new (NULL, NULL);
+  table = g_hash_table_lookup (property_tables, GSIZE_TO_POINTER (gtype));
+  G_UNLOCK (property_tables);
+
+  if (G_LIKELY (table != NULL))
+    return table;
+
+  /* Build outside the lock; referencing the class may run class_init, which
+   * in GJS can call back into this function for other types. */
+  table = property_table_new (gtype);
+
+  G_LOCK (property_tables);
+  existing = g_hash_table_lookup (property_tables, GSIZE_TO_POINTER (gtype));
+  if (existing == NULL)
+    g_hash_table_insert (property_tables, GSIZE_TO_POINTER (gtype), table);
+  G_UNLOCK (property_tables);
+
+  if (existing != NULL)
+    {
+      property_table_free (table);
+      return existing;
+    }
+  return table;
+}
+
 /**
  * ekn_interface_gtype_list_properties:
  * gtype: #GType ID for a GObject interface
@@ -302,6 +442,8 @@ ekn_extract_pixbuf_dominant_color (GdkPixbuf *pixbuf)
  * Call it like
  * `EosKnowledgePrivate.interface_gtype_list_properies(MyType.$gtype)`.
  *
+ * The list is served from the same cache as ekn_gtype_list_properties().
+ *
  * Returns: (transfer container) (array length=n_properties_returned):
  *  an array of #GParamSpec with the interface's properties
  */
@@ -309,9 +451,170 @@ GParamSpec **
 ekn_interface_gtype_list_properties(GType     gtype,
                                     unsigned *n_properties_returned)
 {
-  gpointer g_iface = g_type_default_interface_ref (gtype);
-  GParamSpec **retval =
-    g_object_interface_list_properties (g_iface, n_properties_returned);
-  g_type_default_interface_unref (g_iface);
-  return retval;
+  g_return_val_if_fail (G_TYPE_IS_INTERFACE (gtype), NULL);
+
+  EknPropertyTable *table = property_table_lookup (gtype);
+  if (n_properties_returned)
+    *n_properties_returned = table->n_pspecs;
+  GParamSpec **pspecs = g_new (GParamSpec *, table->n_pspecs + 1);
+  memcpy (pspecs, table->pspecs, (table->n_pspecs + 1) * sizeof (GParamSpec *));
+  return pspecs;
+}
+
+/**
+ * ekn_gtype_list_properties:
+ * @gtype: #GType ID for a GObject class or interface
+ * @n_properties_returned: (out): return location for array length
+ *
+ * Lists the properties of a class together with those of all the interfaces
+ * it implements, or the properties of an interface.
+ * Overridden interface properties are reported as the interface's param spec.
+ *
+ * The table is computed once per type and cached for the lifetime of the
+ * process, so this is cheap to call repeatedly.
+ *
+ * Returns: (transfer none) (array length=n_properties_returned):
+ *  an array of #GParamSpec, owned by the cache
+ */
+GParamSpec **
+ekn_gtype_list_properties (GType     gtype,
+                           unsigned *n_properties_returned)
+{
+  g_return_val_if_fail (G_TYPE_IS_OBJECT (gtype) || G_TYPE_IS_INTERFACE (gtype), NULL);
+
+  EknPropertyTable *table = property_table_lookup (gtype);
+  if (n_properties_returned)
+    *n_properties_returned = table->n_pspecs;
+  return table->pspecs;
+}
+
+/**
+ * ekn_gtype_find_property:
+ * @gtype: #GType ID for a GObject class or interface
+ * @name: name of the property, with either dashes or underscores
+ *
+ * Looks up a property by name in the cached table described in
+ * ekn_gtype_list_properties().
+ *
+ * Returns: (transfer none) (nullable): the #GParamSpec, or %NULL if @gtype
+ *  has no such property
+ */
+GParamSpec *
+ekn_gtype_find_property (GType        gtype,
+                         const gchar *name)
+{
+  g_return_val_if_fail (G_TYPE_IS_OBJECT (gtype) || G_TYPE_IS_INTERFACE (gtype), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  EknPropertyTable *table = property_table_lookup (gtype);
+
+  if (strchr (name, '_') == NULL)
+    return g_hash_table_lookup (table->by_name, name);
+
+  g_autofree gchar *canonical_name = g_strdelimit (g_strdup (name), "_", '-');
+  return g_hash_table_lookup (table->by_name, canonical_name);
+}
+
+/**
+ * ekn_title_collate_key:
+ * @title: a UTF-8 title
+ * @case_sensitive: whether titles starting with a lowercase letter should
+ *  sort before all titles starting with an uppercase one
+ *
+ * Computes a key for sorting titles in the current locale, so that the
+ * locale-aware work is done once per title instead of once per comparison.
+ * Keys are compared with strcmp(), or with `<` in JS.
+ *
+ * The key is g_utf8_collate_key() written out in hexadecimal, because
+ * collation keys aren't necessarily valid UTF-8 and couldn't be passed to JS
+ * as strings otherwise; this keeps their order.
+ *
+ * Returns: (transfer full): the collation key
+ */
+gchar *
+ekn_title_collate_key (const gchar *title,
+                       gboolean     case_sensitive)
+{
+  static const gchar hex_digits[] = "0123456789abcdef";
+
+  g_return_val_if_fail (title != NULL, NULL);
+
+  g_autofree gchar *collate_key = g_utf8_collate_key (title, -1);
+  gsize length = strlen (collate_key);
+  GString *key = g_string_sized_new (2 * length + 1);
+
+  if (case_sensitive)
+    {
+      /* Same rule as Order.Alphabetical always had: a first character that
+       * is its own uppercase counts as uppercase */
+      gunichar first = g_utf8_get_char (title);
+      g_string_append_c (key, g_unichar_toupper (first) == first ? '1' : '0');
+    }
+
+  for (gsize ix = 0; ix < length; ix++)
+    {
+      guchar byte = collate_key[ix];
+      g_string_append_c (key, hex_digits[byte >> 4]);
+      g_string_append_c (key, hex_digits[byte & 0xf]);
+    }
+
+  return g_string_free (key, FALSE);
+}
+
+typedef struct {
+  const gchar * const *keys;
+  gboolean ascending;
+} CollateSortData;
+
+static gint
+compare_collate_key_indices (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+  const CollateSortData *data = user_data;
+  guint ix_a = *(const guint *) a, ix_b = *(const guint *) b;
+
+  gint result = strcmp (data->keys[ix_a], data->keys[ix_b]);
+  if (!data->ascending)
+    result = -result;
+  if (result != 0)
+    return result;
+
+  /* Equal keys keep their original order either way */
+  return (ix_a > ix_b) - (ix_a < ix_b);
+}
+
+/**
+ * ekn_sort_collate_keys:
+ * @keys: (array length=n_keys): keys from ekn_title_collate_key()
+ * @n_keys: number of keys
+ * @ascending: %TRUE to sort in ascending order, %FALSE for descending
+ * @n_indices_returned: (out): return location for array length
+ *
+ * Sorts an array of collation keys, returning the order rather than the
+ * sorted keys, so that the caller can apply it to whatever the keys came
+ * from. The sort is stable.
+ *
+ * Returns: (transfer full) (array length=n_indices_returned): indices into
+ *  @keys in sorted order
+ */
+guint *
+ekn_sort_collate_keys (const gchar * const *keys,
+                       guint                n_keys,
+                       gboolean             ascending,
+                       guint               *n_indices_returned)
+{
+  g_return_val_if_fail (keys != NULL || n_keys == 0, NULL);
+
+  guint *indices = g_new (guint, n_keys);
+  for (guint ix = 0; ix < n_keys; ix++)
+    indices[ix] = ix;
+
+  CollateSortData data = { keys, ascending };
+  g_qsort_with_data (indices, n_keys, sizeof (guint),
+                     compare_collate_key_indices, &data);
+
+  if (n_indices_returned)
+    *n_indices_returned = n_keys;
+  return indices;
 }
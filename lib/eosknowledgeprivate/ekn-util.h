@@ -51,6 +51,20 @@ gchar* ekn_extract_pixbuf_dominant_color (GdkPixbuf *pixbuf);
 GParamSpec **ekn_interface_gtype_list_properties(GType     gtype,
                                                  unsigned *n_properties_returned);
 
+GParamSpec **ekn_gtype_list_properties (GType     gtype,
+                                        unsigned *n_properties_returned);
+
+GParamSpec *ekn_gtype_find_property (GType        gtype,
+                                     const gchar *name);
+
+gchar *ekn_title_collate_key (const gchar *title,
+                              gboolean     case_sensitive);
+
+guint *ekn_sort_collate_keys (const gchar * const *keys,
+                              guint                n_keys,
+                              gboolean             ascending,
+                              guint               *n_indices_returned);
+
 G_END_DECLS
 
 #endif /* EKN_UTIL_H */
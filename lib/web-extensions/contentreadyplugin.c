@@ -0,0 +1,140 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <webkit2/webkit-web-extension.h>
+
+#include "pluginchannel.h"
+#include "pluginjs.h"
+
+#define BUS_INTERFACE_NAME "com.endlessm.Knowledge.ContentReady"
+#define BUS_SIGNAL_NAME "ContentReady"
+#define PAGE_EXTRA_DATA_KEY "_content_ready_plugin_page_data"
+
+/* Signals when a document's text has been laid out and painted, so that the
+ * UI can show it without waiting for every image to load, and without
+ * showing a blank page either.
+ *
+ * That is taken to be the second animation frame after DOMContentLoaded,
+ * i.e. once the first frame with the parsed document has been painted.
+ * Animation frames don't run while the view is hidden, which it may well be
+ * until the content is ready, so a short timeout stands in for them then.
+ *
+ * The interface only has the signal ContentReady(s uri), emitted on the
+ * page's object path, so there is no object to register. */
+
+typedef struct {
+  GDBusConnection *connection;  /* unowned */
+} ContentReadyPluginContext;
+
+typedef struct {
+  ContentReadyPluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
+  guint64 id;
+} PageData;
+
+static const gchar watch_script[] =
+  "(function (notify) {"
+  "  var HIDDEN_TIMEOUT_MS = 100;"
+  "  var notified = false;"
+  "  function ready() {"
+  "    if (notified)"
+  "      return;"
+  "    notified = true;"
+  "    notify();"
+  "  }"
+  "  document.addEventListener('DOMContentLoaded', function () {"
+  "    requestAnimationFrame(function () { requestAnimationFrame(ready); });"
+  "    setTimeout(ready, HIDDEN_TIMEOUT_MS);"
+  "  });"
+  "})";
+
+static void
+emit_content_ready (PageData *data)
+{
+  ContentReadyPluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  const gchar *uri = webkit_web_page_get_uri (data->page);
+  g_dbus_connection_emit_signal (ctxt->connection, NULL, object_path,
+                                 BUS_INTERFACE_NAME, BUS_SIGNAL_NAME,
+                                 g_variant_new ("(s)", uri ? uri : ""),
+                                 &error);
+  if (error != NULL)
+    {
+      g_critical ("Unable to signal content ready: %s", error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+on_ready (JSContextRef      js,
+          size_t            argument_count,
+          const JSValueRef  arguments[],
+          PageData         *data)
+{
+  emit_content_ready (data);
+}
+
+/* Starts watching each new document in the main frame before it is parsed */
+static void
+on_window_object_cleared (WebKitScriptWorld         *world,
+                          WebKitWebPage             *page,
+                          WebKitFrame               *frame,
+                          ContentReadyPluginContext *ctxt)
+{
+  PageData *data = g_object_get_data (G_OBJECT (page), PAGE_EXTRA_DATA_KEY);
+  if (data == NULL || !webkit_frame_is_main_frame (frame))
+    return;
+
+  JSGlobalContextRef js =
+    webkit_frame_get_javascript_context_for_script_world (frame, world);
+  JSValueRef arguments[] = {
+    plugin_js_make_callback (js, (PluginJSCallback) on_ready, data),
+  };
+  if (!plugin_js_call_script (js, watch_script, G_N_ELEMENTS (arguments),
+                              arguments))
+    g_critical ("Couldn't watch for content being ready");
+}
+
+static void
+on_page_created (WebKitWebExtension        *extension,
+                 WebKitWebPage             *page,
+                 ContentReadyPluginContext *ctxt)
+{
+  PageData *data = g_new0 (PageData, 1);
+  data->ctxt = ctxt;
+  data->page = page;
+  data->id = webkit_web_page_get_id (page);
+  // Attach our data to the page, so it will get freed when the page is destroyed
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data, g_free);
+}
+
+static void
+on_channel_ready (GDBusConnection           *connection,
+                  ContentReadyPluginContext *ctxt)
+{
+  ctxt->connection = connection;
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  ContentReadyPluginContext *ctxt = g_new0 (ContentReadyPluginContext, 1);
+  gchar *address;
+
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
+
+  g_signal_connect (extension, "page-created",
+                    G_CALLBACK (on_page_created), ctxt);
+  g_signal_connect (webkit_script_world_get_default (), "window-object-cleared",
+                    G_CALLBACK (on_window_object_cleared), ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+  g_free (address);
+}
@@ -0,0 +1,591 @@
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <webkit2/webkit-web-extension.h>
+
+#include "findtext.h"
+#include "pluginchannel.h"
+#include "pluginjs.h"
+
+#define BUS_INTERFACE_NAME "com.endlessm.Knowledge.FindInArticle"
+#define PAGE_EXTRA_DATA_KEY "_find_plugin_page_data"
+#define HELPER_PROPERTY "__eknFind"
+#define OVERLAY_CLASS "ekn-find-overlay"
+
+/* Finds text in the article for the in-article search bar.
+ *
+ * The first search after a document loads collects the document's visible
+ * text nodes in one script evaluation, and builds an index of their folded
+ * text here; see findtext.c for how the text is folded and searched. Text
+ * whose element isn't rendered, such as collapsed sections, is left out.
+ *
+ * Matches are highlighted with boxes in an overlay, rather than by changing
+ * the document, added in batches on successive frames. Only the first matches
+ * are highlighted, as many as the UI asks for, but any match can be selected.
+ * The rectangles of the highlighted matches, in document coordinates, are
+ * returned so the UI can scroll to a match without asking again. The index is
+ * rebuilt when the document changes, since that can change its text or what
+ * is shown. */
+
+typedef struct {
+  GDBusConnection *connection;  /* unowned */
+  GDBusNodeInfo *node;  /* owned */
+  GList *pages;  /* unowned PageData */
+} FindPluginContext;
+
+typedef struct {
+  FindPluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
+  guint64 id;
+  guint registration_id;
+
+  gboolean observing;  /* the current document's mutations */
+  gboolean index_valid;
+  FindText *text;
+} PageData;
+
+static const gchar introspection_xml[] =
+  "<node>"
+    "<interface name='" BUS_INTERFACE_NAME "'>"
+      "<method name='Search'>"
+        "<arg name='query' type='s' direction='in'/>"
+        "<arg name='max_highlights' type='u' direction='in'/>"
+        "<arg name='match_count' type='u' direction='out'/>"
+        "<arg name='match_rectangles' type='a(uuuu)' direction='out'/>"
+      "</method>"
+      "<method name='SelectMatch'>"
+        "<arg name='index' type='u' direction='in'/>"
+        "<arg name='match_rectangle' type='(uuuu)' direction='out'/>"
+      "</method>"
+      "<method name='Finish'/>"
+    "</interface>"
+  "</node>";
+
+static const gchar helper_script[] =
+  "(function () {"
+  "  if (window." HELPER_PROPERTY ")"
+  "    return;"
+  "  var BATCH_SIZE = 50;"
+  "  var BOX_STYLE = 'position: absolute; pointer-events: none;"
+  "    border-radius: 2px; background-color: rgba(255, 213, 0, 0.5);';"
+  "  var CURRENT_COLOR = 'rgba(255, 140, 0, 0.7)';"
+  "  var nodes = [];"
+  "  var overlay = null, ranges = [], boxes = [], elements = [], current = -1;"
+  "  var extra = [];"  /* boxes of a selected match that isn't highlighted */
+  "  var frame = 0;"
+  "  var last_parent = null, last_parent_shown = false;"
+  "  function is_shown(element) {"
+  "    if (element !== last_parent) {"
+  "      last_parent = element;"
+  "      last_parent_shown = element.getClientRects().length > 0 &&"
+  "        getComputedStyle(element).visibility !== 'hidden';"
+  "    }"
+  "    return last_parent_shown;"
+  "  }"
+  "  function collect() {"
+  "    nodes = [];"
+  "    last_parent = null;"
+  "    var texts = [];"
+  "    if (!document.body)"
+  "      return texts;"
+  "    var walker = document.createTreeWalker(document.body, NodeFilter.SHOW_TEXT, {"
+  "      acceptNode: function (node) {"
+  "        var parent = node.parentNode.nodeName;"
+  "        if (parent === 'SCRIPT' || parent === 'STYLE' || parent === 'NOSCRIPT')"
+  "          return NodeFilter.FILTER_REJECT;"
+  "        if (!is_shown(node.parentNode))"
+  "          return NodeFilter.FILTER_REJECT;"
+  "        return NodeFilter.FILTER_ACCEPT;"
+  "      },"
+  "    });"
+  "    while (walker.nextNode()) {"
+  "      nodes.push(walker.currentNode);"
+  "      texts.push(walker.currentNode.data);"
+  "    }"
+  "    return texts;"
+  "  }"
+  "  function remove_overlay() {"
+  "    if (frame)"
+  "      cancelAnimationFrame(frame);"
+  "    frame = 0;"
+  "    if (overlay && overlay.parentNode)"
+  "      overlay.parentNode.removeChild(overlay);"
+  "    overlay = null;"
+  "    boxes = [];"
+  "    elements = [];"
+  "    extra = [];"
+  "  }"
+  "  function clear() {"
+  "    remove_overlay();"
+  "    ranges = [];"
+  "    current = -1;"
+  "  }"
+  "  function style_match(index) {"
+  "    (elements[index] || []).forEach(function (element) {"
+  "      element.style.backgroundColor = index === current ? CURRENT_COLOR : '';"
+  "    });"
+  "  }"
+  "  function make_box(r) {"
+  "    var element = document.createElement('div');"
+  "    element.style.cssText = BOX_STYLE + 'left: ' + r[0] + 'px; top: ' +"
+  "      r[1] + 'px; width: ' + r[2] + 'px; height: ' + r[3] + 'px;';"
+  "    return element;"
+  "  }"
+  "  function draw_batch(start) {"
+  "    frame = 0;"
+  "    var end = Math.min(start + BATCH_SIZE, boxes.length);"
+  "    var fragment = document.createDocumentFragment();"
+  "    for (var ix = start; ix < end; ix++) {"
+  "      elements[ix] = boxes[ix].map(function (r) {"
+  "        var element = make_box(r);"
+  "        fragment.appendChild(element);"
+  "        return element;"
+  "      });"
+  "      style_match(ix);"
+  "    }"
+  "    overlay.appendChild(fragment);"
+  "    if (end < boxes.length)"
+  "      frame = requestAnimationFrame(function () { draw_batch(end); });"
+  "  }"
+  "  function draw() {"
+  "    remove_overlay();"
+  "    var sx = window.scrollX, sy = window.scrollY, result = [];"
+  "    var range = document.createRange();"
+  "    for (var ix = 0; ix < ranges.length; ix += 4) {"
+  "      range.setStart(nodes[ranges[ix]], ranges[ix + 1]);"
+  "      range.setEnd(nodes[ranges[ix + 2]], ranges[ix + 3]);"
+  "      var bounds = range.getBoundingClientRect();"
+  "      result.push(bounds.left + sx, bounds.top + sy, bounds.width, bounds.height);"
+  "      boxes.push(Array.prototype.map.call(range.getClientRects(), function (r) {"
+  "        return [r.left + sx, r.top + sy, r.width, r.height];"
+  "      }));"
+  "    }"
+  "    overlay = document.createElement('div');"
+  "    overlay.className = '" OVERLAY_CLASS "';"
+  "    overlay.style.cssText = 'position: absolute; left: 0; top: 0;"
+  "      pointer-events: none; z-index: 2147483647;';"
+  "    document.documentElement.appendChild(overlay);"
+  "    draw_batch(0);"
+  "    return result;"
+  "  }"
+  "  window.addEventListener('resize', function () {"
+  "    if (overlay)"
+  "      draw();"
+  "  });"
+  "  Object.defineProperty(window, '" HELPER_PROPERTY "', {"
+  "    value: {"
+  "      collect: collect,"
+  "      highlight: function (new_ranges) {"
+  "        ranges = new_ranges;"
+  "        current = -1;"
+  "        return draw();"
+  "      },"
+  "      select: function (index, start_node, start_offset, end_node, end_offset) {"
+  "        var previous = current;"
+  "        current = index;"
+  "        style_match(previous);"
+  "        style_match(current);"
+  "        extra.forEach(function (element) {"
+  "          if (element.parentNode)"
+  "            element.parentNode.removeChild(element);"
+  "        });"
+  "        extra = [];"
+  "        var range = document.createRange();"
+  "        range.setStart(nodes[start_node], start_offset);"
+  "        range.setEnd(nodes[end_node], end_offset);"
+  "        var r = range.getBoundingClientRect();"
+  "        if (r.top < 0 || r.bottom > window.innerHeight) {"
+  "          window.scrollBy(0, r.top - window.innerHeight / 3);"
+  "          r = range.getBoundingClientRect();"
+  "        }"
+  "        var sx = window.scrollX, sy = window.scrollY;"
+  "        if (overlay && index >= boxes.length) {"
+  "          extra = Array.prototype.map.call(range.getClientRects(), function (c) {"
+  "            var element = make_box([c.left + sx, c.top + sy, c.width, c.height]);"
+  "            element.style.backgroundColor = CURRENT_COLOR;"
+  "            overlay.appendChild(element);"
+  "            return element;"
+  "          });"
+  "        }"
+  "        return [r.left + sx, r.top + sy, r.width, r.height];"
+  "      },"
+  "      clear: clear,"
+  "    },"
+  "  });"
+  "})()";
+
+static JSValueRef
+call_helper (PageData         *data,
+             const gchar      *name,
+             size_t            argument_count,
+             const JSValueRef  arguments[])
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (data->page);
+  JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
+  JSValueRef exc = NULL;
+
+  /* Installs the helper into the document if it isn't there yet */
+  JSStringRef script = JSStringCreateWithUTF8CString (helper_script);
+  JSEvaluateScript (js, script, NULL, NULL, 0, &exc);
+  JSStringRelease (script);
+  if (exc != NULL)
+    goto fail;
+
+  JSObjectRef window = JSContextGetGlobalObject (js);
+  JSStringRef property = JSStringCreateWithUTF8CString (HELPER_PROPERTY);
+  JSValueRef helper = JSObjectGetProperty (js, window, property, &exc);
+  JSStringRelease (property);
+  if (exc != NULL || !JSValueIsObject (js, helper))
+    goto fail;
+  JSObjectRef helper_object = JSValueToObject (js, helper, NULL);
+
+  property = JSStringCreateWithUTF8CString (name);
+  JSValueRef function = JSObjectGetProperty (js, helper_object, property, &exc);
+  JSStringRelease (property);
+  if (exc != NULL || !JSValueIsObject (js, function))
+    goto fail;
+
+  JSValueRef retval =
+    JSObjectCallAsFunction (js, JSValueToObject (js, function, NULL),
+                            helper_object, argument_count, arguments, &exc);
+  if (exc != NULL)
+    goto fail;
+  return retval;
+
+fail:
+  g_critical ("Couldn't call find helper %s", name);
+  return NULL;
+}
+
+static JSContextRef
+get_page_context (PageData *data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (data->page);
+  return webkit_frame_get_javascript_global_context (frame);
+}
+
+static void
+clear_search (PageData *data)
+{
+  find_text_clear_search (data->text);
+}
+
+/* Changes to our own overlay are ignored, so highlighting matches doesn't
+throw the index away. Attributes are watched too, since changing classes or
+styles can show or hide text. */
+static void
+on_mutation (JSContextRef      js,
+             size_t            argument_count,
+             const JSValueRef  arguments[],
+             PageData         *data)
+{
+  data->index_valid = FALSE;
+}
+
+static gboolean
+ensure_index (PageData *data)
+{
+  JSContextRef js = get_page_context (data);
+
+  if (data->index_valid)
+    return TRUE;
+
+  /* Only documents that are searched need watching */
+  if (!data->observing)
+    {
+      data->observing =
+        plugin_js_observe_mutations (js, TRUE, OVERLAY_CLASS,
+                                     (PluginJSCallback) on_mutation, data);
+      if (!data->observing)
+        g_critical ("Couldn't observe DOM mutations; find index may be stale");
+    }
+
+  find_text_reset (data->text);
+
+  JSValueRef texts_value = call_helper (data, "collect", 0, NULL);
+  if (texts_value == NULL || !JSValueIsObject (js, texts_value))
+    return FALSE;
+  JSObjectRef texts = JSValueToObject (js, texts_value, NULL);
+
+  for (guint32 node = 0; ; node++)
+    {
+      JSValueRef text_value = JSObjectGetPropertyAtIndex (js, texts, node, NULL);
+      if (!JSValueIsString (js, text_value))
+        break;
+      JSStringRef string = JSValueToStringCopy (js, text_value, NULL);
+      find_text_append (data->text,
+                        (const gunichar2 *) JSStringGetCharactersPtr (string),
+                        JSStringGetLength (string), node);
+      JSStringRelease (string);
+    }
+
+  data->index_valid = TRUE;
+  return TRUE;
+}
+
+static GVariant *
+rect_from_js (JSContextRef js,
+              JSObjectRef  numbers,
+              unsigned     index)
+{
+  double values[4];
+  for (unsigned ix = 0; ix < 4; ix++)
+    {
+      JSValueRef value = JSObjectGetPropertyAtIndex (js, numbers,
+                                                     4 * index + ix, NULL);
+      values[ix] = MAX (0, JSValueToNumber (js, value, NULL));
+    }
+  return g_variant_new ("(uuuu)", (unsigned) values[0], (unsigned) values[1],
+                        (unsigned) values[2], (unsigned) values[3]);
+}
+
+/* Highlights the first @max_highlights matches and returns their rectangles;
+the others can still be selected */
+static GVariant *
+highlight_matches (PageData *data,
+                   guint     max_highlights)
+{
+  JSContextRef js = get_page_context (data);
+  GVariantBuilder builder;
+  guint n_highlights = MIN (max_highlights,
+                            find_text_get_n_matches (data->text));
+  g_autofree JSValueRef *range_values = g_new (JSValueRef, 4 * n_highlights);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uuuu)"));
+
+  for (guint ix = 0; ix < n_highlights; ix++)
+    {
+      FindTextRange range;
+      find_text_get_match_range (data->text, ix, &range);
+      range_values[4 * ix] = JSValueMakeNumber (js, range.start_node);
+      range_values[4 * ix + 1] = JSValueMakeNumber (js, range.start_offset);
+      range_values[4 * ix + 2] = JSValueMakeNumber (js, range.end_node);
+      range_values[4 * ix + 3] = JSValueMakeNumber (js, range.end_offset);
+    }
+
+  JSValueRef arguments[] = {
+    JSObjectMakeArray (js, 4 * n_highlights, range_values, NULL),
+  };
+  JSValueRef rects_value = call_helper (data, "highlight", 1, arguments);
+  if (rects_value == NULL || !JSValueIsObject (js, rects_value))
+    return g_variant_builder_end (&builder);
+
+  JSObjectRef rects = JSValueToObject (js, rects_value, NULL);
+  for (guint ix = 0; ix < n_highlights; ix++)
+    g_variant_builder_add_value (&builder, rect_from_js (js, rects, ix));
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+search (PageData              *data,
+        GVariant              *parameters,
+        GDBusMethodInvocation *invocation)
+{
+  const gchar *query_utf8;
+  guint max_highlights;
+
+  g_variant_get (parameters, "(&su)", &query_utf8, &max_highlights);
+
+  if (!ensure_index (data))
+    {
+      g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR,
+                                                     G_DBUS_ERROR_FAILED,
+                                                     "Couldn't index the document's text");
+      return;
+    }
+
+  find_text_search (data->text, query_utf8);
+
+  if (!find_text_has_query (data->text))
+    {
+      call_helper (data, "clear", 0, NULL);
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(u@a(uuuu))", 0,
+                                                            g_variant_new_array (G_VARIANT_TYPE ("(uuuu)"), NULL, 0)));
+      return;
+    }
+
+  GVariant *rects = highlight_matches (data, max_highlights);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(u@a(uuuu))",
+                                                        find_text_get_n_matches (data->text),
+                                                        rects));
+}
+
+static void
+select_match (PageData              *data,
+              GVariant              *parameters,
+              GDBusMethodInvocation *invocation)
+{
+  JSContextRef js = get_page_context (data);
+  guint index;
+
+  g_variant_get (parameters, "(u)", &index);
+
+  JSValueRef rect_value = NULL;
+  if (index < find_text_get_n_matches (data->text))
+    {
+      FindTextRange range;
+      find_text_get_match_range (data->text, index, &range);
+      JSValueRef arguments[] = {
+        JSValueMakeNumber (js, index),
+        JSValueMakeNumber (js, range.start_node),
+        JSValueMakeNumber (js, range.start_offset),
+        JSValueMakeNumber (js, range.end_node),
+        JSValueMakeNumber (js, range.end_offset),
+      };
+      rect_value = call_helper (data, "select", G_N_ELEMENTS (arguments),
+                                arguments);
+    }
+  if (rect_value == NULL || !JSValueIsObject (js, rect_value))
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_INVALID_ARGS,
+                                             "No match %u", index);
+      return;
+    }
+
+  GVariant *rect = rect_from_js (js, JSValueToObject (js, rect_value, NULL), 0);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new_tuple (&rect, 1));
+}
+
+static void
+on_method_call (GDBusConnection       *connection,
+                const gchar           *sender,
+                const gchar           *object_path,
+                const gchar           *interface_name,
+                const gchar           *method_name,
+                GVariant              *parameters,
+                GDBusMethodInvocation *invocation,
+                PageData              *data)
+{
+  if (g_strcmp0 (method_name, "Search") == 0)
+    {
+      search (data, parameters, invocation);
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "SelectMatch") == 0)
+    {
+      select_match (data, parameters, invocation);
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "Finish") == 0)
+    {
+      clear_search (data);
+      call_helper (data, "clear", 0, NULL);
+      g_dbus_method_invocation_return_value (invocation, NULL);
+      return;
+    }
+
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                         G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method %s invoked on interface %s",
+                                         method_name, interface_name);
+}
+
+static GDBusInterfaceVTable vtable = {
+  (GDBusInterfaceMethodCallFunc) on_method_call,
+  NULL,  /* get_property */
+  NULL,  /* set_property */
+};
+
+static void
+register_page_object (PageData *data)
+{
+  FindPluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL || ctxt->node == NULL || data->registration_id != 0)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  data->registration_id =
+    g_dbus_connection_register_object (ctxt->connection, object_path,
+                                       ctxt->node->interfaces[0], &vtable,
+                                       data, NULL, &error);
+  if (data->registration_id == 0)
+    {
+      g_critical ("Error hooking up find extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+page_data_free (PageData *data)
+{
+  FindPluginContext *ctxt = data->ctxt;
+
+  if (ctxt->connection != NULL && data->registration_id != 0)
+    g_dbus_connection_unregister_object (ctxt->connection, data->registration_id);
+  ctxt->pages = g_list_remove (ctxt->pages, data);
+  find_text_free (data->text);
+  g_free (data);
+}
+
+static void
+on_document_loaded (WebKitWebPage *page,
+                    PageData      *data)
+{
+  data->observing = FALSE;
+  data->index_valid = FALSE;
+  clear_search (data);
+}
+
+static void
+on_page_created (WebKitWebExtension *extension,
+                 WebKitWebPage      *page,
+                 FindPluginContext  *ctxt)
+{
+  PageData *data = g_new0 (PageData, 1);
+  data->ctxt = ctxt;
+  data->page = page;
+  data->id = webkit_web_page_get_id (page);
+  data->text = find_text_new ();
+  // Attach our data to the page, so it will get freed when the page is destroyed
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data,
+                          (GDestroyNotify) page_data_free);
+  ctxt->pages = g_list_prepend (ctxt->pages, data);
+  register_page_object (data);
+
+  g_signal_connect (page, "document-loaded", G_CALLBACK (on_document_loaded), data);
+}
+
+static void
+on_channel_ready (GDBusConnection   *connection,
+                  FindPluginContext *ctxt)
+{
+  ctxt->connection = connection;
+  g_list_foreach (ctxt->pages, (GFunc) register_page_object, NULL);
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  FindPluginContext *ctxt = g_new0 (FindPluginContext, 1);
+  GError *error = NULL;
+  gchar *address;
+
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
+
+  ctxt->node = g_dbus_node_info_new_for_xml (introspection_xml, &error);
+  if (ctxt->node == NULL)
+    {
+      g_critical ("Error parsing find extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+
+  g_signal_connect (extension, "page-created",
+                    G_CALLBACK (on_page_created), ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+  g_free (address);
+}
@@ -0,0 +1,261 @@
+#include "findtext.h"
+
+#include <string.h>
+
+/* Text of a document, folded for the in-article search bar, and the matches
+ * of the current query in it.
+ *
+ * Text is folded to lower case without accents and with runs of whitespace
+ * collapsed. Each folded character maps back to the text node and UTF-16
+ * offset it came from; a character that decomposes into several, like a
+ * Hangul syllable into its jamo, maps all of them back to itself. Searches
+ * are done against the folded text; when the query extends the previous one,
+ * only the previous matches are checked again, so typing gets cheaper as the
+ * query grows instead of more expensive. */
+
+/* Where a folded character came from; offsets and lengths are in UTF-16
+code units, as in the DOM */
+typedef struct {
+  guint32 node;
+  guint32 offset;
+  guint32 length;
+} FoldedPosition;
+
+struct _FindText {
+  GArray *text;  /* gunichar, folded */
+  GArray *positions;  /* FoldedPosition, one per folded character */
+
+  GArray *query;  /* gunichar, folded; empty if no search active */
+  GArray *matches;  /* guint32 start indices into text */
+};
+
+FindText *
+find_text_new (void)
+{
+  FindText *self = g_new0 (FindText, 1);
+  self->text = g_array_new (FALSE, FALSE, sizeof (gunichar));
+  self->positions = g_array_new (FALSE, FALSE, sizeof (FoldedPosition));
+  self->query = g_array_new (FALSE, FALSE, sizeof (gunichar));
+  self->matches = g_array_new (FALSE, FALSE, sizeof (guint32));
+  return self;
+}
+
+void
+find_text_free (FindText *self)
+{
+  g_array_unref (self->text);
+  g_array_unref (self->positions);
+  g_array_unref (self->query);
+  g_array_unref (self->matches);
+  g_free (self);
+}
+
+void
+find_text_clear_search (FindText *self)
+{
+  g_array_set_size (self->query, 0);
+  g_array_set_size (self->matches, 0);
+}
+
+/* Forgets the text, and any search in it */
+void
+find_text_reset (FindText *self)
+{
+  g_array_set_size (self->text, 0);
+  g_array_set_size (self->positions, 0);
+  find_text_clear_search (self);
+}
+
+/* Appends the folded form of @c to @folded and returns how many characters
+it appended. Accents left over after decomposition are dropped, but every
+other character of the decomposition is kept. */
+static gsize
+fold_char (gunichar  c,
+           gunichar *folded)
+{
+  gunichar decomposition[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+
+  if (g_unichar_isspace (c))
+    {
+      folded[0] = ' ';
+      return 1;
+    }
+
+  gsize n_decomposed = g_unichar_fully_decompose (c, FALSE, decomposition,
+                                                  G_N_ELEMENTS (decomposition));
+  gsize n_folded = 0;
+  for (gsize ix = 0; ix < n_decomposed; ix++)
+    {
+      if (g_unichar_combining_class (decomposition[ix]) != 0)
+        continue;
+      folded[n_folded++] = g_unichar_tolower (decomposition[ix]);
+    }
+  return n_folded;
+}
+
+/* Appends the folded characters of a UTF-16 string to @text, and where they
+came from to @positions, if not NULL */
+static void
+fold_utf16 (const gunichar2 *chars,
+            gsize            n_chars,
+            guint32          node,
+            GArray          *text,
+            GArray          *positions)
+{
+  gsize ix = 0;
+
+  while (ix < n_chars)
+    {
+      gunichar c = chars[ix];
+      guint32 length = 1;
+      if (c >= 0xd800 && c < 0xdc00 && ix + 1 < n_chars &&
+          chars[ix + 1] >= 0xdc00 && chars[ix + 1] < 0xe000)
+        {
+          c = 0x10000 + ((c - 0xd800) << 10) + (chars[ix + 1] - 0xdc00);
+          length = 2;
+        }
+
+      gunichar folded[G_UNICHAR_MAX_DECOMPOSITION_LENGTH];
+      gsize n_folded = fold_char (c, folded);
+
+      /* Collapse runs of whitespace */
+      if (n_folded == 1 && folded[0] == ' ' && text->len > 0 &&
+          g_array_index (text, gunichar, text->len - 1) == ' ')
+        n_folded = 0;
+
+      if (n_folded == 0)
+        {
+          /* Include it in the previous character's range, if it's from the
+          same text node */
+          FoldedPosition *last = positions && positions->len > 0 ?
+            &g_array_index (positions, FoldedPosition, positions->len - 1) : NULL;
+          if (last != NULL && last->node == node)
+            last->length += length;
+        }
+
+      for (gsize folded_ix = 0; folded_ix < n_folded; folded_ix++)
+        {
+          g_array_append_val (text, folded[folded_ix]);
+          if (positions != NULL)
+            {
+              FoldedPosition position = { node, (guint32) ix, length };
+              g_array_append_val (positions, position);
+            }
+        }
+
+      ix += length;
+    }
+}
+
+/* Appends the text of a text node; nodes are numbered by the caller */
+void
+find_text_append (FindText        *self,
+                  const gunichar2 *chars,
+                  gsize            n_chars,
+                  guint32          node)
+{
+  fold_utf16 (chars, n_chars, node, self->text, self->positions);
+}
+
+static gboolean
+matches_at (FindText *self,
+            guint32   start,
+            guint     from)
+{
+  const gunichar *text = (const gunichar *) self->text->data;
+  const gunichar *query = (const gunichar *) self->query->data;
+
+  if (start + self->query->len > self->text->len)
+    return FALSE;
+  for (guint ix = from; ix < self->query->len; ix++)
+    {
+      if (text[start + ix] != query[ix])
+        return FALSE;
+    }
+  return TRUE;
+}
+
+/* Finds all matches of the new query, only looking at the previous query's
+matches if the new query extends it */
+static void
+update_matches (FindText *self,
+                GArray   *query)
+{
+  gboolean extends = self->query->len > 0 &&
+    query->len >= self->query->len &&
+    memcmp (query->data, self->query->data,
+            self->query->len * sizeof (gunichar)) == 0;
+  guint checked = extends ? self->query->len : 0;
+
+  g_array_set_size (self->query, 0);
+  g_array_append_vals (self->query, query->data, query->len);
+
+  if (extends)
+    {
+      guint kept = 0;
+      for (guint ix = 0; ix < self->matches->len; ix++)
+        {
+          guint32 start = g_array_index (self->matches, guint32, ix);
+          if (matches_at (self, start, checked))
+            g_array_index (self->matches, guint32, kept++) = start;
+        }
+      g_array_set_size (self->matches, kept);
+      return;
+    }
+
+  g_array_set_size (self->matches, 0);
+  if (query->len == 0)
+    return;
+
+  const gunichar *text = (const gunichar *) self->text->data;
+  gunichar first = g_array_index (query, gunichar, 0);
+  for (guint32 start = 0; start + query->len <= self->text->len; start++)
+    {
+      if (text[start] == first && matches_at (self, start, 1))
+        g_array_append_val (self->matches, start);
+    }
+}
+
+void
+find_text_search (FindText    *self,
+                  const gchar *query_utf8)
+{
+  glong n_chars;
+  g_autofree gunichar2 *query_utf16 = g_utf8_to_utf16 (query_utf8, -1, NULL,
+                                                       &n_chars, NULL);
+  g_autoptr(GArray) query = g_array_new (FALSE, FALSE, sizeof (gunichar));
+  if (query_utf16 != NULL)
+    fold_utf16 (query_utf16, n_chars, 0, query, NULL);
+
+  update_matches (self, query);
+}
+
+gboolean
+find_text_has_query (FindText *self)
+{
+  return self->query->len > 0;
+}
+
+guint
+find_text_get_n_matches (FindText *self)
+{
+  return self->matches->len;
+}
+
+void
+find_text_get_match_range (FindText      *self,
+                           guint          index,
+                           FindTextRange *range)
+{
+  g_return_if_fail (index < self->matches->len);
+
+  guint32 start = g_array_index (self->matches, guint32, index);
+  FoldedPosition *first = &g_array_index (self->positions, FoldedPosition,
+                                          start);
+  FoldedPosition *last = &g_array_index (self->positions, FoldedPosition,
+                                         start + self->query->len - 1);
+  range->start_node = first->node;
+  range->start_offset = first->offset;
+  range->end_node = last->node;
+  range->end_offset = last->offset + last->length;
+}
@@ -0,0 +1,39 @@
+#ifndef FIND_TEXT_H
+#define FIND_TEXT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Range of a match in the document; offsets are in UTF-16 code units, as in
+the DOM, and the end offset is exclusive */
+typedef struct {
+  guint32 start_node;
+  guint32 start_offset;
+  guint32 end_node;
+  guint32 end_offset;
+} FindTextRange;
+
+typedef struct _FindText FindText;
+
+FindText *find_text_new (void);
+void find_text_free (FindText *self);
+
+void find_text_reset (FindText *self);
+void find_text_append (FindText        *self,
+                       const gunichar2 *chars,
+                       gsize            n_chars,
+                       guint32          node);
+
+void find_text_search (FindText    *self,
+                       const gchar *query);
+void find_text_clear_search (FindText *self);
+gboolean find_text_has_query (FindText *self);
+guint find_text_get_n_matches (FindText *self);
+void find_text_get_match_range (FindText      *self,
+                                guint          index,
+                                FindTextRange *range);
+
+G_END_DECLS
+
+#endif /* FIND_TEXT_H */
@@ -1,26 +1,221 @@
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib.h>
 #include <gmodule.h>
+#include <unistd.h>
 #include <webkit2/webkit-web-extension.h>
 
-void
-webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
-                                                const GVariant     *data_from_app)
+#include "pluginchannel.h"
+
+/* Nothing needs the app's resources until the first resource:// request, so
+ * registering them is deferred until then, instead of slowing down the start
+ * of every web process.
+ *
+ * The application also sends us the resource files, already open, over the
+ * plugin channel; they are mapped straight from those file descriptors without
+ * looking up the paths again. If the first resource:// request comes before
+ * the descriptors do, the resources are loaded by path instead. */
+
+typedef struct {
+  gchar **app_resource_paths;  /* owned */
+  GArray *app_resource_fds;  /* int, owned, NULL until received */
+  gboolean registered;
+  GCancellable *cancellable;  /* owned */
+} GResourcePluginContext;
+
+static void
+close_fd (int *fd)
 {
-  g_autoptr(GVariantIter) app_resources_iter = NULL;
-  const gchar *app_resource_path;
+  close (*fd);
+}
 
-  g_variant_get ((GVariant *) data_from_app, "(sas)", NULL, &app_resources_iter);
-  while (g_variant_iter_loop (app_resources_iter, "s", &app_resource_path))
+static void
+register_resource (GResource *resource)
+{
+  g_resources_register (resource);
+  g_resource_unref (resource);
+}
+
+static GResource *
+load_resource_from_fd (int      fd,
+                       GError **error)
+{
+  GMappedFile *mapped = g_mapped_file_new_from_fd (fd, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+
+  /* The bytes keep the mapping alive */
+  GBytes *bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+  GResource *resource = g_resource_new_from_data (bytes, error);
+  g_bytes_unref (bytes);
+  return resource;
+}
+
+static void
+register_app_resources (GResourcePluginContext *ctxt)
+{
+  GError *error = NULL;
+  guint n_paths = g_strv_length (ctxt->app_resource_paths);
+  GArray *fds = ctxt->app_resource_fds;
+
+  if (fds != NULL && fds->len != n_paths)
+    {
+      g_warning ("Expected %u resource files but got %u", n_paths, fds->len);
+      fds = NULL;
+    }
+
+  for (guint ix = 0; ix < n_paths; ix++)
     {
-      GResource *app_resource = g_resource_load (app_resource_path, NULL);
-      g_resources_register (app_resource);
-      g_resource_unref (app_resource);
+      GResource *app_resource;
+      if (fds != NULL)
+        app_resource = load_resource_from_fd (g_array_index (fds, int, ix),
+                                              &error);
+      else
+        app_resource = g_resource_load (ctxt->app_resource_paths[ix], &error);
+
+      if (app_resource == NULL)
+        {
+          g_critical ("Couldn't load resource %s: %s",
+                      ctxt->app_resource_paths[ix], error->message);
+          g_clear_error (&error);
+          continue;
+        }
+      register_resource (app_resource);
     }
 
   gchar *resource_path = g_build_filename (PKGDATADIR, "eos-knowledge.gresource", NULL);
-  GResource *resource = g_resource_load (resource_path, NULL);
-  g_resources_register (resource);
-  g_resource_unref (resource);
+  GResource *resource = g_resource_load (resource_path, &error);
+  if (resource != NULL)
+    {
+      register_resource (resource);
+    }
+  else
+    {
+      g_critical ("Couldn't load resource %s: %s", resource_path,
+                  error->message);
+      g_clear_error (&error);
+    }
   g_free (resource_path);
 }
+
+static void
+ensure_resources_registered (GResourcePluginContext *ctxt)
+{
+  if (ctxt->registered)
+    return;
+
+  ctxt->registered = TRUE;
+  g_cancellable_cancel (ctxt->cancellable);
+  register_app_resources (ctxt);
+  g_clear_pointer (&ctxt->app_resource_fds, g_array_unref);
+}
+
+static gboolean
+on_send_request (WebKitWebPage          *page,
+                 WebKitURIRequest       *request,
+                 WebKitURIResponse      *redirected_response,
+                 GResourcePluginContext *ctxt)
+{
+  const gchar *uri = webkit_uri_request_get_uri (request);
+
+  if (g_str_has_prefix (uri, "resource:"))
+    ensure_resources_registered (ctxt);
+
+  return FALSE;  /* Let the request continue */
+}
+
+static void
+on_page_created (WebKitWebExtension     *extension,
+                 WebKitWebPage          *page,
+                 GResourcePluginContext *ctxt)
+{
+  g_signal_connect (page, "send-request", G_CALLBACK (on_send_request), ctxt);
+}
+
+static void
+on_resources_received (GDBusConnection        *connection,
+                       GAsyncResult           *result,
+                       GResourcePluginContext *ctxt)
+{
+  GError *error = NULL;
+  GUnixFDList *fd_list = NULL;
+
+  GVariant *reply =
+    g_dbus_connection_call_with_unix_fd_list_finish (connection, &fd_list,
+                                                     result, &error);
+  if (reply == NULL)
+    {
+      /* Cancelled because the resources were needed before they arrived */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_warning ("Couldn't get resource files from the application, "
+                   "falling back to loading them by path: %s", error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  if (!ctxt->registered)
+    {
+      g_autoptr(GVariantIter) iter = NULL;
+      gint32 handle;
+
+      ctxt->app_resource_fds = g_array_new (FALSE, FALSE, sizeof (int));
+      g_array_set_clear_func (ctxt->app_resource_fds,
+                              (GDestroyNotify) close_fd);
+
+      g_variant_get (reply, "(ah)", &iter);
+      while (g_variant_iter_next (iter, "h", &handle))
+        {
+          int fd = g_unix_fd_list_get (fd_list, handle, &error);
+          if (fd == -1)
+            {
+              g_warning ("Bad resource file from the application: %s",
+                         error->message);
+              g_clear_error (&error);
+              g_clear_pointer (&ctxt->app_resource_fds, g_array_unref);
+              break;
+            }
+          g_array_append_val (ctxt->app_resource_fds, fd);
+        }
+    }
+
+  g_variant_unref (reply);
+  g_clear_object (&fd_list);
+}
+
+static void
+on_channel_ready (GDBusConnection        *connection,
+                  GResourcePluginContext *ctxt)
+{
+  if (ctxt->registered)
+    return;
+
+  g_dbus_connection_call_with_unix_fd_list (connection, NULL,
+                                            PLUGIN_CHANNEL_OBJECT_PATH,
+                                            PLUGIN_CHANNEL_INTERFACE_NAME,
+                                            "GetResourceFiles", NULL,
+                                            G_VARIANT_TYPE ("(ah)"),
+                                            G_DBUS_CALL_FLAGS_NONE, -1,
+                                            NULL, ctxt->cancellable,
+                                            (GAsyncReadyCallback) on_resources_received,
+                                            ctxt);
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  /* Lives as long as the web process */
+  GResourcePluginContext *ctxt = g_new0 (GResourcePluginContext, 1);
+  g_autofree gchar *address = NULL;
+
+  g_variant_get ((GVariant *) data_from_app, "(s^as)", &address,
+                 &ctxt->app_resource_paths);
+  ctxt->cancellable = g_cancellable_new ();
+
+  g_signal_connect (extension, "page-created", G_CALLBACK (on_page_created),
+                    ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+}
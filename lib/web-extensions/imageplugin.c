@@ -0,0 +1,73 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <webkit2/webkit-web-extension.h>
+
+/* Defers loading and decoding of images far below the fold, so that long
+ * illustrated articles get to their first paint sooner and don't hold every
+ * image in memory.
+ *
+ * When the document has been parsed, all images are set to decode
+ * asynchronously, and the ones more than a screen below the viewport that
+ * have a size of their own and haven't received any data yet are restarted
+ * as lazily loaded images. If WebKit doesn't support lazy loading natively,
+ * their sources are put aside and restored once they come within a screen of
+ * the viewport. The script doing this is imageplugin.js, built into the
+ * extension as a resource. */
+
+#define DEFER_IMAGES_SCRIPT_PATH \
+  "/com/endlessm/knowledge/web-extensions/imageplugin.js"
+
+static gchar *defer_images_script = NULL;
+
+static void
+on_document_loaded (WebKitWebPage *page,
+                    gpointer       user_data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (page);
+  JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
+  JSValueRef exc = NULL;
+
+  if (defer_images_script == NULL)
+    return;
+
+  JSStringRef script = JSStringCreateWithUTF8CString (defer_images_script);
+  JSEvaluateScript (js, script, NULL, NULL, 0, &exc);
+  JSStringRelease (script);
+  if (exc != NULL)
+    g_critical ("Couldn't defer offscreen images");
+}
+
+static void
+on_page_created (WebKitWebExtension *extension,
+                 WebKitWebPage      *page,
+                 gpointer            user_data)
+{
+  g_signal_connect (page, "document-loaded", G_CALLBACK (on_document_loaded),
+                    NULL);
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  GError *error = NULL;
+  GBytes *bytes = g_resources_lookup_data (DEFER_IMAGES_SCRIPT_PATH,
+                                           G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                           &error);
+  if (bytes == NULL)
+    {
+      g_critical ("Couldn't load %s: %s", DEFER_IMAGES_SCRIPT_PATH,
+                  error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  gsize size;
+  const gchar *data = g_bytes_get_data (bytes, &size);
+  defer_images_script = g_strndup (data, size);
+  g_bytes_unref (bytes);
+
+  g_signal_connect (extension, "page-created", G_CALLBACK (on_page_created),
+                    NULL);
+}
@@ -0,0 +1,86 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+// Run by the image web extension when the document has been parsed; see
+// imageplugin.c. Returns the number of images that were deferred.
+
+(function () {
+    let margin = window.innerHeight;
+    let native_lazy = 'loading' in HTMLImageElement.prototype;
+    let deferred = [];
+    let n_deferred = 0;
+
+    // Images without a size of their own would collapse while they have no
+    // source, and move everything below them when they come back. Responsive
+    // images pick their source themselves, so leave them alone.
+    function can_defer(img) {
+        if (!img.hasAttribute('width') || !img.hasAttribute('height'))
+            return false;
+        if (img.hasAttribute('srcset') || img.parentNode.nodeName === 'PICTURE')
+            return false;
+        // Don't throw away data that has already arrived
+        return !img.complete && img.naturalWidth === 0;
+    }
+
+    Array.prototype.forEach.call(document.images, img => {
+        img.decoding = 'async';
+        let src = img.getAttribute('src');
+        if (!src || !can_defer(img))
+            return;
+        if (img.getBoundingClientRect().top < window.innerHeight + margin)
+            return;
+        img.removeAttribute('src');
+        n_deferred++;
+        if (native_lazy) {
+            img.loading = 'lazy';
+            img.setAttribute('src', src);
+        } else {
+            img.dataset.eknDeferredSrc = src;
+            deferred.push(img);
+        }
+    });
+    if (deferred.length === 0)
+        return n_deferred;
+
+    function restore(img) {
+        img.setAttribute('src', img.dataset.eknDeferredSrc);
+        delete img.dataset.eknDeferredSrc;
+    }
+
+    if (window.IntersectionObserver) {
+        let observer = new IntersectionObserver(entries => {
+            entries.forEach(entry => {
+                if (!entry.isIntersecting)
+                    return;
+                observer.unobserve(entry.target);
+                restore(entry.target);
+            });
+        }, {rootMargin: `${margin}px 0px`});
+        deferred.forEach(img => observer.observe(img));
+        return n_deferred;
+    }
+
+    let frame_requested = false;
+    function check() {
+        frame_requested = false;
+        deferred = deferred.filter(img => {
+            let rect = img.getBoundingClientRect();
+            if (rect.top > window.innerHeight + margin || rect.bottom < -margin)
+                return true;
+            restore(img);
+            return false;
+        });
+        if (deferred.length === 0) {
+            window.removeEventListener('scroll', queue_check);
+            window.removeEventListener('resize', queue_check);
+        }
+    }
+    function queue_check() {
+        if (frame_requested)
+            return;
+        frame_requested = true;
+        requestAnimationFrame(check);
+    }
+    window.addEventListener('scroll', queue_check, {passive: true});
+    window.addEventListener('resize', queue_check);
+    return n_deferred;
+})();
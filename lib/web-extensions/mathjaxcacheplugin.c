@@ -0,0 +1,331 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <webkit2/webkit-web-extension.h>
+
+#include "pluginchannel.h"
+#include "pluginjs.h"
+
+#define BUS_INTERFACE_NAME "com.endlessm.Knowledge.MathJaxCache"
+#define BUS_SIGNAL_NAME "MathTypeset"
+#define PAGE_EXTRA_DATA_KEY "_mathjax_cache_plugin_page_data"
+
+/* Captures the output of MathJax once it has typeset a document, and puts it
+ * back on later visits instead of typesetting again.
+ *
+ * Before any of the document's scripts run, a MathJax configuration is
+ * installed that hooks into MathJax's startup. On a first visit, once the
+ * startup typeset is done, each typeset formula's output is collected, keyed
+ * by its source, along with the styles and SVG glyphs that MathJax added, and
+ * MathTypeset(s uri, s output) is signalled with all of it as JSON.
+ *
+ * The app hands that output back with SetTypesetMath(s uri, s output) before
+ * the document at that URI is loaded again. The startup typeset is then
+ * skipped; only MathJax's preprocessors run, to find the formulas, and each
+ * of them gets its cached output. If any formula isn't in the output, the
+ * document is typeset as usual.
+ *
+ * This only works for documents that configure MathJax with
+ * text/x-mathjax-config scripts or the URL, not by setting window.MathJax
+ * themselves. Restored formulas don't have MathJax's context menu. */
+
+typedef struct {
+  GDBusConnection *connection;  /* unowned */
+  GDBusNodeInfo *node;  /* owned */
+  GList *pages;  /* unowned PageData */
+} MathJaxCachePluginContext;
+
+typedef struct {
+  MathJaxCachePluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
+  guint64 id;
+  guint registration_id;
+
+  /* Output to restore when the document at this URI is loaded */
+  gchar *pending_uri;  /* owned, nullable */
+  gchar *pending_output;  /* owned, nullable */
+} PageData;
+
+static const gchar introspection_xml[] =
+  "<node>"
+    "<interface name='" BUS_INTERFACE_NAME "'>"
+      "<signal name='" BUS_SIGNAL_NAME "'>"
+        "<arg name='uri' type='s'/>"
+        "<arg name='output' type='s'/>"
+      "</signal>"
+      "<method name='SetTypesetMath'>"
+        "<arg name='uri' type='s' direction='in'/>"
+        "<arg name='output' type='s' direction='in'/>"
+      "</method>"
+    "</interface>"
+  "</node>";
+
+static const gchar install_script[] =
+  "(function (cached, notify) {"
+  "  var RESTORED_TYPE = 'text/x-ekn-typeset-math';"
+  "  var output = cached ? JSON.parse(cached) : null;"
+  "  function key(script) {"
+  "    return script.type + '\\n' + script.text;"
+  "  }"
+  "  function capture() {"
+  "    var math = {}, count = 0;"
+  "    MathJax.Hub.getAllJax().forEach(function (jax) {"
+  "      var script = jax.SourceElement();"
+  "      var frame = script.previousElementSibling;"
+  "      if (!frame || frame.classList.contains('MathJax_Preview'))"
+  "        return;"
+  "      math[key(script)] = frame.outerHTML;"
+  "      count++;"
+  "    });"
+  "    if (count === 0)"
+  "      return;"
+  "    var styles = Array.prototype.filter.call("
+  "      document.querySelectorAll('head style'), function (style) {"
+  "        return /MathJax|mjx-/.test(style.textContent);"
+  "      }).map(function (style) { return style.outerHTML; });"
+  "    var glyphs = document.getElementById('MathJax_SVG_glyphs');"
+  "    notify(JSON.stringify({"
+  "      styles: styles,"
+  "      glyphs: glyphs ? glyphs.ownerSVGElement.outerHTML : null,"
+  "      math: math,"
+  "    }));"
+  "  }"
+  "  function restore() {"
+  "    var scripts = document.querySelectorAll('script[type^=\"math/\"]');"
+  "    for (var ix = 0; ix < scripts.length; ix++) {"
+  "      if (!output.math.hasOwnProperty(key(scripts[ix])))"
+  "        return false;"
+  "    }"
+  "    output.styles.forEach(function (html) {"
+  "      document.head.insertAdjacentHTML('beforeend', html);"
+  "    });"
+  "    if (output.glyphs) {"
+  "      var hidden = document.createElement('div');"
+  "      hidden.style.cssText = 'visibility: hidden; overflow: hidden;"
+  "        position: absolute; top: 0; height: 1px;';"
+  "      hidden.innerHTML = output.glyphs;"
+  "      document.body.insertBefore(hidden, document.body.firstChild);"
+  "    }"
+  "    Array.prototype.forEach.call(scripts, function (script) {"
+  "      var preview = script.previousElementSibling;"
+  "      if (preview && preview.classList.contains('MathJax_Preview'))"
+  "        preview.parentNode.removeChild(preview);"
+  "      script.insertAdjacentHTML('beforebegin', output.math[key(script)]);"
+  "      script.type = RESTORED_TYPE;"
+  "    });"
+  "    return true;"
+  "  }"
+  "  window.MathJax = {"
+  "    skipStartupTypeset: !!output,"
+  "    AuthorInit: function () {"
+  "      MathJax.Hub.Register.StartupHook('End', function () {"
+  "        if (!output) {"
+  "          MathJax.Hub.Queue(capture);"
+  "          return;"
+  "        }"
+  "        MathJax.Hub.Queue(['PreProcess', MathJax.Hub], function () {"
+  "          if (!restore())"
+  "            MathJax.Hub.Queue(['Process', MathJax.Hub], capture);"
+  "        });"
+  "      });"
+  "    },"
+  "  };"
+  "})";
+
+static void
+emit_math_typeset (PageData    *data,
+                   const gchar *output)
+{
+  MathJaxCachePluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  const gchar *uri = webkit_web_page_get_uri (data->page);
+  g_dbus_connection_emit_signal (ctxt->connection, NULL, object_path,
+                                 BUS_INTERFACE_NAME, BUS_SIGNAL_NAME,
+                                 g_variant_new ("(ss)", uri ? uri : "",
+                                                output),
+                                 &error);
+  if (error != NULL)
+    {
+      g_critical ("Unable to signal typeset math: %s", error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+on_captured (JSContextRef      js,
+             size_t            argument_count,
+             const JSValueRef  arguments[],
+             PageData         *data)
+{
+  if (argument_count < 1)
+    return;
+
+  JSStringRef output = JSValueToStringCopy (js, arguments[0], NULL);
+  if (output == NULL)
+    return;
+
+  g_autofree gchar *output_utf8 = plugin_js_string_to_utf8 (output);
+  JSStringRelease (output);
+  emit_math_typeset (data, output_utf8);
+}
+
+/* Configures MathJax in each new document in the main frame, before the
+ * document's own scripts run */
+static void
+on_window_object_cleared (WebKitScriptWorld         *world,
+                          WebKitWebPage             *page,
+                          WebKitFrame               *frame,
+                          MathJaxCachePluginContext *ctxt)
+{
+  PageData *data = g_object_get_data (G_OBJECT (page), PAGE_EXTRA_DATA_KEY);
+  if (data == NULL || !webkit_frame_is_main_frame (frame))
+    return;
+
+  /* Cached output is only good for the next load of its document */
+  g_autofree gchar *pending_uri = g_steal_pointer (&data->pending_uri);
+  g_autofree gchar *pending_output = g_steal_pointer (&data->pending_output);
+
+  JSGlobalContextRef js =
+    webkit_frame_get_javascript_context_for_script_world (frame, world);
+
+  JSValueRef cached = JSValueMakeNull (js);
+  if (pending_output != NULL &&
+      g_strcmp0 (pending_uri, webkit_web_page_get_uri (page)) == 0)
+    {
+      JSStringRef output = JSStringCreateWithUTF8CString (pending_output);
+      cached = JSValueMakeString (js, output);
+      JSStringRelease (output);
+    }
+
+  JSValueRef arguments[] = {
+    cached,
+    plugin_js_make_callback (js, (PluginJSCallback) on_captured, data),
+  };
+  if (!plugin_js_call_script (js, install_script, G_N_ELEMENTS (arguments),
+                              arguments))
+    g_critical ("Couldn't install MathJax cache");
+}
+
+static void
+on_method_call (GDBusConnection       *connection,
+                const gchar           *sender,
+                const gchar           *object_path,
+                const gchar           *interface_name,
+                const gchar           *method_name,
+                GVariant              *parameters,
+                GDBusMethodInvocation *invocation,
+                PageData              *data)
+{
+  if (g_strcmp0 (method_name, "SetTypesetMath") == 0)
+    {
+      g_free (data->pending_uri);
+      g_free (data->pending_output);
+      g_variant_get (parameters, "(ss)", &data->pending_uri,
+                     &data->pending_output);
+      g_dbus_method_invocation_return_value (invocation, NULL);
+      return;
+    }
+
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                         G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method %s invoked on interface %s",
+                                         method_name, interface_name);
+}
+
+static GDBusInterfaceVTable vtable = {
+  (GDBusInterfaceMethodCallFunc) on_method_call,
+  NULL,  /* get_property */
+  NULL,  /* set_property */
+};
+
+static void
+register_page_object (PageData *data)
+{
+  MathJaxCachePluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL || ctxt->node == NULL || data->registration_id != 0)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  data->registration_id =
+    g_dbus_connection_register_object (ctxt->connection, object_path,
+                                       ctxt->node->interfaces[0], &vtable,
+                                       data, NULL, &error);
+  if (data->registration_id == 0)
+    {
+      g_critical ("Error hooking up MathJax cache extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+page_data_free (PageData *data)
+{
+  MathJaxCachePluginContext *ctxt = data->ctxt;
+
+  if (ctxt->connection != NULL && data->registration_id != 0)
+    g_dbus_connection_unregister_object (ctxt->connection, data->registration_id);
+  ctxt->pages = g_list_remove (ctxt->pages, data);
+  g_free (data->pending_uri);
+  g_free (data->pending_output);
+  g_free (data);
+}
+
+static void
+on_page_created (WebKitWebExtension        *extension,
+                 WebKitWebPage             *page,
+                 MathJaxCachePluginContext *ctxt)
+{
+  PageData *data = g_new0 (PageData, 1);
+  data->ctxt = ctxt;
+  data->page = page;
+  data->id = webkit_web_page_get_id (page);
+  // Attach our data to the page, so it will get freed when the page is destroyed
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data,
+                          (GDestroyNotify) page_data_free);
+  ctxt->pages = g_list_prepend (ctxt->pages, data);
+  register_page_object (data);
+}
+
+static void
+on_channel_ready (GDBusConnection           *connection,
+                  MathJaxCachePluginContext *ctxt)
+{
+  ctxt->connection = connection;
+  g_list_foreach (ctxt->pages, (GFunc) register_page_object, NULL);
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  MathJaxCachePluginContext *ctxt = g_new0 (MathJaxCachePluginContext, 1);
+  GError *error = NULL;
+  gchar *address;
+
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
+
+  ctxt->node = g_dbus_node_info_new_for_xml (introspection_xml, &error);
+  if (ctxt->node == NULL)
+    {
+      g_critical ("Error parsing MathJax cache extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+
+  g_signal_connect (extension, "page-created",
+                    G_CALLBACK (on_page_created), ctxt);
+  g_signal_connect (webkit_script_world_get_default (), "window-object-cleared",
+                    G_CALLBACK (on_window_object_cleared), ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+  g_free (address);
+}
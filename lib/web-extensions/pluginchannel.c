@@ -0,0 +1,219 @@
+#include "pluginchannel.h"
+
+/* All our web extensions talk to the UI process over one private
+ * peer-to-peer DBus connection per web process, instead of each owning names
+ * on the session bus. The UI process runs the server and passes its address
+ * in the extensions' initialization data.
+ *
+ * Each extension is a separate module with its own copy of this code, so the
+ * channel state lives on the WebKitWebExtension, which is a singleton shared
+ * by all of them. Whichever extension is initialized first opens the
+ * connection; the others wait for it.
+ *
+ * The channel also tells the UI process which pages live in this web process,
+ * by emitting PageCreated and PageDestroyed, so that it can route calls for a
+ * page to the right connection. */
+
+#define CHANNEL_DATA_KEY "_ekn_plugin_channel"
+
+typedef struct {
+  GDBusConnection *connection;  /* owned */
+  GSList *waiters;  /* owned Waiter */
+  GArray *pending_pages;  /* guint64, announced once connected */
+} PluginChannel;
+
+typedef struct {
+  PluginChannelReadyFunc callback;
+  gpointer user_data;
+} Waiter;
+
+typedef struct {
+  PluginChannel *channel;
+  guint64 page_id;
+  guint announce_id;  /* idle that emits PageCreated, if still pending */
+} PageAnnouncement;
+
+gchar *
+plugin_channel_get_page_object_path (guint64 page_id)
+{
+  return g_strdup_printf (PLUGIN_CHANNEL_OBJECT_PATH "/%" G_GUINT64_FORMAT,
+                          page_id);
+}
+
+static void
+emit_page_signal (PluginChannel *channel,
+                  const gchar   *signal_name,
+                  guint64        page_id)
+{
+  GError *error = NULL;
+
+  if (channel->connection == NULL)
+    return;
+
+  g_dbus_connection_emit_signal (channel->connection, NULL,
+                                 PLUGIN_CHANNEL_OBJECT_PATH,
+                                 PLUGIN_CHANNEL_INTERFACE_NAME,
+                                 signal_name,
+                                 g_variant_new ("(t)", page_id),
+                                 &error);
+  if (error != NULL)
+    {
+      g_critical ("Unable to signal %s: %s", signal_name, error->message);
+      g_clear_error (&error);
+    }
+}
+
+static gboolean
+announce_page (PageAnnouncement *announcement)
+{
+  announcement->announce_id = 0;
+  emit_page_signal (announcement->channel, "PageCreated",
+                    announcement->page_id);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_page_destroyed (gpointer  data,
+                   GObject  *page_location)
+{
+  PageAnnouncement *announcement = data;
+  PluginChannel *channel = announcement->channel;
+
+  if (announcement->announce_id != 0)
+    {
+      /* Never announced, so the UI process must not hear of it at all;
+      otherwise PageDestroyed could overtake PageCreated */
+      g_source_remove (announcement->announce_id);
+    }
+  else if (channel->connection != NULL)
+    {
+      emit_page_signal (channel, "PageDestroyed", announcement->page_id);
+    }
+  else
+    {
+      for (guint ix = 0; ix < channel->pending_pages->len; ix++)
+        {
+          if (g_array_index (channel->pending_pages, guint64, ix) == announcement->page_id)
+            {
+              g_array_remove_index (channel->pending_pages, ix);
+              break;
+            }
+        }
+    }
+
+  g_free (announcement);
+}
+
+static void
+on_page_created (WebKitWebExtension *extension,
+                 WebKitWebPage      *page,
+                 PluginChannel      *channel)
+{
+  guint64 page_id = webkit_web_page_get_id (page);
+
+  /* Freed when the page is destroyed */
+  PageAnnouncement *announcement = g_new0 (PageAnnouncement, 1);
+  announcement->channel = channel;
+  announcement->page_id = page_id;
+
+  if (channel->connection == NULL)
+    {
+      g_array_append_val (channel->pending_pages, page_id);
+    }
+  else
+    {
+      /* Wait until every extension's page-created handler has registered its
+      objects for the page */
+      announcement->announce_id =
+        g_idle_add_full (G_PRIORITY_DEFAULT, (GSourceFunc) announce_page,
+                         announcement, NULL);
+    }
+
+  g_object_weak_ref (G_OBJECT (page), on_page_destroyed, announcement);
+}
+
+static void
+on_connection_ready (GObject       *source,
+                     GAsyncResult  *result,
+                     PluginChannel *channel)
+{
+  GError *error = NULL;
+  GSList *waiters, *iter;
+
+  channel->connection = g_dbus_connection_new_for_address_finish (result,
+                                                                  &error);
+  if (channel->connection == NULL)
+    {
+      g_critical ("Couldn't connect to the application: %s", error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  waiters = g_slist_reverse (channel->waiters);
+  channel->waiters = NULL;
+  for (iter = waiters; iter; iter = iter->next)
+    {
+      Waiter *waiter = iter->data;
+      waiter->callback (channel->connection, waiter->user_data);
+    }
+  g_slist_free_full (waiters, g_free);
+
+  /* Only now that everyone has registered their objects */
+  for (guint ix = 0; ix < channel->pending_pages->len; ix++)
+    emit_page_signal (channel, "PageCreated",
+                      g_array_index (channel->pending_pages, guint64, ix));
+  g_array_set_size (channel->pending_pages, 0);
+}
+
+/*
+ * plugin_channel_connect:
+ * @extension: the web extension
+ * @address: DBus address of the application's server
+ * @callback: called with the connection once it is open
+ * @user_data: data for @callback
+ *
+ * Calls @callback with the web process's connection to the application,
+ * opening it first if no other extension has done so yet. If the connection
+ * is already open, @callback is called before this function returns.
+ */
+void
+plugin_channel_connect (WebKitWebExtension     *extension,
+                        const gchar            *address,
+                        PluginChannelReadyFunc  callback,
+                        gpointer                user_data)
+{
+  PluginChannel *channel = g_object_get_data (G_OBJECT (extension),
+                                              CHANNEL_DATA_KEY);
+
+  if (channel != NULL && channel->connection != NULL)
+    {
+      callback (channel->connection, user_data);
+      return;
+    }
+
+  Waiter *waiter = g_new0 (Waiter, 1);
+  waiter->callback = callback;
+  waiter->user_data = user_data;
+
+  if (channel != NULL)
+    {
+      channel->waiters = g_slist_prepend (channel->waiters, waiter);
+      return;
+    }
+
+  /* The extension lives as long as the web process, so the channel is never
+  freed */
+  channel = g_new0 (PluginChannel, 1);
+  channel->waiters = g_slist_prepend (NULL, waiter);
+  channel->pending_pages = g_array_new (FALSE, FALSE, sizeof (guint64));
+  g_object_set_data (G_OBJECT (extension), CHANNEL_DATA_KEY, channel);
+
+  g_signal_connect (extension, "page-created", G_CALLBACK (on_page_created),
+                    channel);
+
+  g_dbus_connection_new_for_address (address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                     NULL, NULL,
+                                     (GAsyncReadyCallback) on_connection_ready,
+                                     channel);
+}
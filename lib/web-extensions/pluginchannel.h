@@ -0,0 +1,25 @@
+#ifndef PLUGIN_CHANNEL_H
+#define PLUGIN_CHANNEL_H
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <webkit2/webkit-web-extension.h>
+
+G_BEGIN_DECLS
+
+#define PLUGIN_CHANNEL_INTERFACE_NAME "com.endlessm.Knowledge.WebExtension"
+#define PLUGIN_CHANNEL_OBJECT_PATH "/com/endlessm/webview"
+
+typedef void (*PluginChannelReadyFunc) (GDBusConnection *connection,
+                                        gpointer         user_data);
+
+void plugin_channel_connect (WebKitWebExtension     *extension,
+                             const gchar            *address,
+                             PluginChannelReadyFunc  callback,
+                             gpointer                user_data);
+
+gchar *plugin_channel_get_page_object_path (guint64 page_id);
+
+G_END_DECLS
+
+#endif /* PLUGIN_CHANNEL_H */
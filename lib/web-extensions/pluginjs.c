@@ -0,0 +1,162 @@
+#include "pluginjs.h"
+
+/* Helpers for running JS from our web extensions with JavaScriptCore, and for
+ * having it call back into C.
+ *
+ * Native callbacks are JS function objects of one shared class, whose private
+ * data says what to call. The callback's user data must outlive the function
+ * object; passing page data is fine for functions handed to the page's
+ * documents, since documents go away before their page. */
+
+typedef struct {
+  PluginJSCallback callback;
+  gpointer user_data;
+} Closure;
+
+/* There is no DOM API for MutationObserver, so one is installed from JS */
+static const gchar observe_mutations_script[] =
+  "(function (callback, attributes, ignored_class) {"
+  "  function is_ignored(node) {"
+  "    return node.nodeType === Node.ELEMENT_NODE &&"
+  "      node.classList.contains(ignored_class);"
+  "  }"
+  "  function in_ignored(node) {"
+  "    for (; node; node = node.parentNode) {"
+  "      if (is_ignored(node))"
+  "        return true;"
+  "    }"
+  "    return false;"
+  "  }"
+  "  function is_ignored_record(record) {"
+  "    if (in_ignored(record.target))"
+  "      return true;"
+  "    var changed = Array.prototype.concat.call("
+  "      Array.prototype.slice.call(record.addedNodes),"
+  "      Array.prototype.slice.call(record.removedNodes));"
+  "    return changed.length > 0 && changed.every(is_ignored);"
+  "  }"
+  "  new MutationObserver(function (records) {"
+  "    if (!ignored_class || !records.every(is_ignored_record))"
+  "      callback();"
+  "  }).observe(document, {"
+  "    attributes: attributes, characterData: true, childList: true,"
+  "    subtree: true,"
+  "  });"
+  "})";
+
+gchar *
+plugin_js_string_to_utf8 (JSStringRef string)
+{
+  gsize size = JSStringGetMaximumUTF8CStringSize (string);
+  gchar *retval = g_malloc (size);
+  JSStringGetUTF8CString (string, retval, size);
+  return retval;
+}
+
+/* Returns NULL if the script throws or doesn't evaluate to an object */
+JSObjectRef
+plugin_js_evaluate_object (JSContextRef  js,
+                           const gchar  *script)
+{
+  JSValueRef exc = NULL;
+  JSStringRef script_string = JSStringCreateWithUTF8CString (script);
+  JSValueRef value = JSEvaluateScript (js, script_string, NULL, NULL, 0, &exc);
+  JSStringRelease (script_string);
+  if (exc != NULL || !JSValueIsObject (js, value))
+    return NULL;
+  return JSValueToObject (js, value, NULL);
+}
+
+static JSValueRef
+on_callback_called (JSContextRef     js,
+                    JSObjectRef      function,
+                    JSObjectRef      this_object,
+                    size_t           argument_count,
+                    const JSValueRef arguments[],
+                    JSValueRef      *exception)
+{
+  Closure *closure = JSObjectGetPrivate (function);
+  if (closure != NULL)
+    closure->callback (js, argument_count, arguments, closure->user_data);
+  return JSValueMakeUndefined (js);
+}
+
+static void
+on_callback_finalized (JSObjectRef function)
+{
+  g_free (JSObjectGetPrivate (function));
+}
+
+static JSClassRef
+get_callback_class (void)
+{
+  static JSClassRef klass = NULL;
+
+  if (klass == NULL)
+    {
+      JSClassDefinition definition = kJSClassDefinitionEmpty;
+      definition.className = "EknPluginCallback";
+      definition.callAsFunction = on_callback_called;
+      definition.finalize = on_callback_finalized;
+      klass = JSClassCreate (&definition);
+    }
+  return klass;
+}
+
+/* Makes a JS function that calls @callback with its arguments */
+JSObjectRef
+plugin_js_make_callback (JSContextRef     js,
+                         PluginJSCallback callback,
+                         gpointer         user_data)
+{
+  Closure *closure = g_new0 (Closure, 1);
+  closure->callback = callback;
+  closure->user_data = user_data;
+  return JSObjectMake (js, get_callback_class (), closure);
+}
+
+/* Evaluates @script, which must evaluate to a function, and calls it with
+@arguments. Returns FALSE if either throws. */
+gboolean
+plugin_js_call_script (JSContextRef      js,
+                       const gchar      *script,
+                       size_t            argument_count,
+                       const JSValueRef  arguments[])
+{
+  JSObjectRef function = plugin_js_evaluate_object (js, script);
+  if (function == NULL)
+    return FALSE;
+
+  JSValueRef exc = NULL;
+  JSObjectCallAsFunction (js, function, NULL, argument_count, arguments, &exc);
+  return exc == NULL;
+}
+
+/* Calls @callback after each batch of changes to the document. Changes to
+attributes are only included if @attributes is TRUE. If @ignored_class is not
+NULL, batches that only add or remove elements of that class, or only change
+things inside them, are ignored; that's for a plugin's own overlays. */
+gboolean
+plugin_js_observe_mutations (JSContextRef      js,
+                             gboolean          attributes,
+                             const gchar      *ignored_class,
+                             PluginJSCallback  callback,
+                             gpointer          user_data)
+{
+  JSValueRef ignored_class_value = JSValueMakeNull (js);
+  if (ignored_class != NULL)
+    {
+      JSStringRef ignored_class_string =
+        JSStringCreateWithUTF8CString (ignored_class);
+      ignored_class_value = JSValueMakeString (js, ignored_class_string);
+      JSStringRelease (ignored_class_string);
+    }
+
+  JSValueRef arguments[] = {
+    plugin_js_make_callback (js, callback, user_data),
+    JSValueMakeBoolean (js, attributes),
+    ignored_class_value,
+  };
+  return plugin_js_call_script (js, observe_mutations_script,
+                                G_N_ELEMENTS (arguments), arguments);
+}
@@ -0,0 +1,36 @@
+#ifndef PLUGIN_JS_H
+#define PLUGIN_JS_H
+
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+
+G_BEGIN_DECLS
+
+typedef void (*PluginJSCallback) (JSContextRef      js,
+                                  size_t            argument_count,
+                                  const JSValueRef  arguments[],
+                                  gpointer          user_data);
+
+gchar *plugin_js_string_to_utf8 (JSStringRef string);
+
+JSObjectRef plugin_js_evaluate_object (JSContextRef  js,
+                                       const gchar  *script);
+
+JSObjectRef plugin_js_make_callback (JSContextRef     js,
+                                     PluginJSCallback callback,
+                                     gpointer         user_data);
+
+gboolean plugin_js_call_script (JSContextRef      js,
+                                const gchar      *script,
+                                size_t            argument_count,
+                                const JSValueRef  arguments[]);
+
+gboolean plugin_js_observe_mutations (JSContextRef      js,
+                                      gboolean          attributes,
+                                      const gchar      *ignored_class,
+                                      PluginJSCallback  callback,
+                                      gpointer          user_data);
+
+G_END_DECLS
+
+#endif /* PLUGIN_JS_H */
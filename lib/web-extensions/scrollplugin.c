@@ -1,51 +1,155 @@
 #include <gio/gio.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <JavaScriptCore/JavaScript.h>
 #include <webkit2/webkit-web-extension.h>
 #include <webkitdom/webkitdom.h>
 
+#include "pluginchannel.h"
+#include "pluginjs.h"
+#include "scrollstate.h"
+
 #define BUS_INTERFACE_NAME "com.endlessm.Knowledge.WebviewScroll"
 #define BUS_SIGNAL_NAME "ScrollChanged"
-#define EXTENSION_EXTRA_DATA_KEY "_scroll_plugin_extension_data"
 #define PAGE_EXTRA_DATA_KEY "_scroll_plugin_page_data"
 
+/* Scroll events are coalesced and signalled at most this many times per
+ * second, about once per frame. Can be overridden with the
+ * EKN_SCROLL_PLUGIN_MAX_RATE environment variable; 0 signals on every
+ * scroll event. */
+#define DEFAULT_MAX_RATE 60
+/* Changes smaller than this many pixels are not signalled. Can be overridden
+ * with the EKN_SCROLL_PLUGIN_THRESHOLD environment variable. */
+#define DEFAULT_THRESHOLD 1
+/* Cached layout metrics are read again after this long anyway, in case the
+ * layout changed in a way that we were not notified of. */
+#define METRICS_MAX_AGE_USEC (G_USEC_PER_SEC)
+
+typedef struct {
+  GDBusConnection *connection;  /* unowned */
+  GDBusNodeInfo *node;  /* owned */
+  GList *pages;  /* unowned PageData */
+  guint flush_interval;  /* ms */
+  gint threshold;  /* px */
+} ScrollPluginContext;
+
 typedef struct {
-  WebKitWebExtension *extension;
+  ScrollPluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
   guint64 id;
-} ExtensionAndId;
+  guint registration_id;
+  guint flush_id;
+
+  /* Layout metrics, cached until resize or DOM mutation, since reading them
+  can force a layout */
+  gboolean metrics_valid;
+  gint64 metrics_time;
+  gint max_scroll_height;
+  gint max_scroll_width;
+
+  /* Last values signalled */
+  gboolean signalled;
+  ScrollState last;
 
-static gchar *
-get_object_path (guint64 id) {
-  return g_strdup_printf("/com/endlessm/webview/%" G_GUINT64_FORMAT, id);
+  /* Counters for tests, see GetCounters */
+  guint scroll_events;
+  guint flushes;
+  guint signals_emitted;
+  guint layout_reads;
+} PageData;
+
+static const gchar introspection_xml[] =
+  "<node>"
+    "<interface name='" BUS_INTERFACE_NAME "'>"
+      "<signal name='" BUS_SIGNAL_NAME "'>"
+        "<arg name='scroll_top' type='(i)'/>"
+        "<arg name='max_scroll_top' type='(i)'/>"
+        "<arg name='scroll_left' type='(i)'/>"
+        "<arg name='max_scroll_left' type='(i)'/>"
+      "</signal>"
+      "<method name='GetCounters'>"
+        "<arg name='counters' type='a{su}' direction='out'/>"
+      "</method>"
+    "</interface>"
+  "</node>";
+
+static guint
+get_env_uint (const gchar *name,
+              guint        default_value)
+{
+  const gchar *value = g_getenv (name);
+  gchar *end;
+  guint64 retval;
+
+  if (value == NULL)
+    return default_value;
+  retval = g_ascii_strtoull (value, &end, 10);
+  if (*value == '\0' || *end != '\0' || retval > G_MAXINT)
+    {
+      g_warning ("Ignoring invalid value for %s: %s", name, value);
+      return default_value;
+    }
+  return (guint) retval;
 }
 
-static gboolean
-signal_scroll (WebKitDOMDocument *document,
-               WebKitDOMEvent    *event,
-               ExtensionAndId    *data)
+static void
+update_metrics (PageData         *data,
+                WebKitDOMElement *body)
 {
-  GDBusConnection *connection = g_object_get_data (G_OBJECT (data->extension),
-                                                   EXTENSION_EXTRA_DATA_KEY);
-  if (!connection)
-    return FALSE;
+  gint64 now = g_get_monotonic_time ();
 
-  WebKitDOMElement *body = WEBKIT_DOM_ELEMENT (webkit_dom_document_get_body (document));
+  if (data->metrics_valid && now - data->metrics_time < METRICS_MAX_AGE_USEC)
+    return;
 
-  gint max_scroll_height = webkit_dom_element_get_scroll_height (body) -
+  data->max_scroll_height = webkit_dom_element_get_scroll_height (body) -
     (gint) webkit_dom_element_get_client_height (body);
-  gint max_scroll_width = webkit_dom_element_get_scroll_width (body) -
+  data->max_scroll_width = webkit_dom_element_get_scroll_width (body) -
     (gint) webkit_dom_element_get_client_width (body);
+  data->metrics_valid = TRUE;
+  data->metrics_time = now;
+  data->layout_reads++;
+}
+
+static void
+flush_scroll (PageData *data)
+{
+  ScrollPluginContext *ctxt = data->ctxt;
+
+  data->flushes++;
+
+  if (!ctxt->connection)
+    return;
+
+  WebKitDOMDocument *document = webkit_web_page_get_dom_document (data->page);
+  if (!document)
+    return;
+  WebKitDOMHTMLElement *body = webkit_dom_document_get_body (document);
+  if (!body)
+    return;
+
+  update_metrics (data, WEBKIT_DOM_ELEMENT (body));
+
+  ScrollState current = {
+    .scroll_top = webkit_dom_element_get_scroll_top (WEBKIT_DOM_ELEMENT (body)),
+    .max_scroll_top = data->max_scroll_height,
+    .scroll_left = webkit_dom_element_get_scroll_left (WEBKIT_DOM_ELEMENT (body)),
+    .max_scroll_left = data->max_scroll_width,
+  };
+
+  if (!scroll_state_should_signal (data->signalled ? &data->last : NULL,
+                                   &current, ctxt->threshold))
+    return;
 
   GVariant *params = g_variant_new ("((i)(i)(i)(i))",
-    webkit_dom_element_get_scroll_top (body),
-    max_scroll_height,
-    webkit_dom_element_get_scroll_left (body),
-    max_scroll_width);
+    current.scroll_top,
+    current.max_scroll_top,
+    current.scroll_left,
+    current.max_scroll_left);
 
-  g_autofree gchar *object_path = get_object_path (data->id);
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
 
   GError *error = NULL;
-  g_dbus_connection_emit_signal (connection,
+  g_dbus_connection_emit_signal (ctxt->connection,
                                  NULL,
                                  object_path,
                                  BUS_INTERFACE_NAME,
@@ -54,64 +158,256 @@ signal_scroll (WebKitDOMDocument *document,
                                  &error);
 
   if (error)
-    g_critical ("Unable to signal scroll change: %s\n", error->message);
+    {
+      g_critical ("Unable to signal scroll change: %s\n", error->message);
+      g_clear_error (&error);
+      return;
+    }
+
+  data->signalled = TRUE;
+  data->last = current;
+  data->signals_emitted++;
+}
+
+static void
+cancel_flush (PageData *data)
+{
+  if (data->flush_id != 0)
+    {
+      g_source_remove (data->flush_id);
+      data->flush_id = 0;
+    }
+}
+
+static gboolean
+on_flush_timeout (PageData *data)
+{
+  data->flush_id = 0;
+  flush_scroll (data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_flush (PageData *data)
+{
+  if (data->flush_id != 0)
+    return;
+
+  if (data->ctxt->flush_interval == 0)
+    {
+      flush_scroll (data);
+      return;
+    }
+
+  data->flush_id = g_timeout_add (data->ctxt->flush_interval,
+                                  (GSourceFunc) on_flush_timeout, data);
+}
+
+static void
+invalidate_metrics (PageData *data)
+{
+  data->metrics_valid = FALSE;
+  queue_flush (data);
+}
+
+static gboolean
+on_scroll (WebKitDOMEventTarget *target,
+           WebKitDOMEvent       *event,
+           PageData             *data)
+{
+  data->scroll_events++;
+  queue_flush (data);
+  return FALSE;
+}
 
+static gboolean
+on_layout_changed (WebKitDOMEventTarget *target,
+                   WebKitDOMEvent       *event,
+                   PageData             *data)
+{
+  invalidate_metrics (data);
   return FALSE;
 }
 
 static void
-on_document_loaded (WebKitWebPage  *page,
-                    ExtensionAndId *data)
+on_mutation (JSContextRef      js,
+             size_t            argument_count,
+             const JSValueRef  arguments[],
+             PageData         *data)
+{
+  invalidate_metrics (data);
+}
+
+/* The observer goes away with the document, and the document goes away
+before the page, so the page data outlives it. */
+static void
+observe_mutations (PageData *data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (data->page);
+  JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
+
+  if (!plugin_js_observe_mutations (js, TRUE, NULL,
+                                    (PluginJSCallback) on_mutation, data))
+    g_critical ("Couldn't observe DOM mutations; scroll extents may be stale");
+}
+
+static void
+on_document_loaded (WebKitWebPage *page,
+                    PageData      *data)
 {
   WebKitDOMDocument *document = webkit_web_page_get_dom_document (page);
+  WebKitDOMDOMWindow *window = webkit_dom_document_get_default_view (document);
+
+  data->metrics_valid = FALSE;
+  data->signalled = FALSE;
 
   webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (document),
                                               "scroll",
-                                              G_CALLBACK (signal_scroll),
+                                              G_CALLBACK (on_scroll),
                                               FALSE,
                                               data);
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (window),
+                                              "resize",
+                                              G_CALLBACK (on_layout_changed),
+                                              FALSE,
+                                              data);
+  /* Images and other subresources finishing loading can change the layout.
+  The load event doesn't bubble, so capture it. */
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (document),
+                                              "load",
+                                              G_CALLBACK (on_layout_changed),
+                                              TRUE,
+                                              data);
+  observe_mutations (data);
 
   // Always let the client know about the scroll status
-  signal_scroll (document, NULL, data);
+  cancel_flush (data);
+  flush_scroll (data);
 }
 
 static void
-on_page_created (WebKitWebExtension   *extension,
-                 WebKitWebPage        *page)
+on_method_call (GDBusConnection       *connection,
+                const gchar           *sender,
+                const gchar           *object_path,
+                const gchar           *interface_name,
+                const gchar           *method_name,
+                GVariant              *parameters,
+                GDBusMethodInvocation *invocation,
+                PageData              *data)
 {
-  ExtensionAndId *data = g_new0 (ExtensionAndId, 1);
-  data->extension = extension;
+  if (g_strcmp0 (method_name, "GetCounters") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_METHOD,
+                                             "Unknown method %s invoked on interface %s",
+                                             method_name, interface_name);
+      return;
+    }
+
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{su}"));
+  g_variant_builder_add (&builder, "{su}", "scroll-events", data->scroll_events);
+  g_variant_builder_add (&builder, "{su}", "flushes", data->flushes);
+  g_variant_builder_add (&builder, "{su}", "signals-emitted", data->signals_emitted);
+  g_variant_builder_add (&builder, "{su}", "layout-reads", data->layout_reads);
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(a{su})", &builder));
+}
+
+static GDBusInterfaceVTable vtable = {
+  (GDBusInterfaceMethodCallFunc) on_method_call,
+  NULL,  /* get_property */
+  NULL,  /* set_property */
+};
+
+static void
+register_page_object (PageData *data)
+{
+  ScrollPluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL || ctxt->node == NULL || data->registration_id != 0)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  data->registration_id =
+    g_dbus_connection_register_object (ctxt->connection, object_path,
+                                       ctxt->node->interfaces[0], &vtable,
+                                       data, NULL, &error);
+  if (data->registration_id == 0)
+    {
+      g_critical ("Error hooking up scroll extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+page_data_free (PageData *data)
+{
+  ScrollPluginContext *ctxt = data->ctxt;
+
+  cancel_flush (data);
+  if (ctxt->connection != NULL && data->registration_id != 0)
+    g_dbus_connection_unregister_object (ctxt->connection, data->registration_id);
+  ctxt->pages = g_list_remove (ctxt->pages, data);
+  g_free (data);
+}
+
+static void
+on_page_created (WebKitWebExtension  *extension,
+                 WebKitWebPage       *page,
+                 ScrollPluginContext *ctxt)
+{
+  PageData *data = g_new0 (PageData, 1);
+  data->ctxt = ctxt;
+  data->page = page;
   data->id = webkit_web_page_get_id (page);
   // Attach our data to the page, so it will get freed when the page is destroyed
-  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data, g_free);
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data,
+                          (GDestroyNotify) page_data_free);
+  ctxt->pages = g_list_prepend (ctxt->pages, data);
+  register_page_object (data);
 
   g_signal_connect (page, "document-loaded", G_CALLBACK (on_document_loaded), data);
 }
 
 static void
-on_bus_acquired (GDBusConnection      *connection,
-                 const gchar          *name,
-                 WebKitWebExtension   *extension)
+on_channel_ready (GDBusConnection     *connection,
+                  ScrollPluginContext *ctxt)
 {
-  g_object_set_data (G_OBJECT (extension), EXTENSION_EXTRA_DATA_KEY, connection);
+  ctxt->connection = connection;
+  g_list_foreach (ctxt->pages, (GFunc) register_page_object, NULL);
 }
 
 void
 webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
                                                 const GVariant     *data_from_app)
 {
-  gchar *well_known_name;
-  g_variant_get ((GVariant *) data_from_app, "(sas)", &well_known_name, NULL);
+  ScrollPluginContext *ctxt = g_new0 (ScrollPluginContext, 1);
+  GError *error = NULL;
+  gchar *address;
+  guint max_rate;
+
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
+
+  max_rate = get_env_uint ("EKN_SCROLL_PLUGIN_MAX_RATE", DEFAULT_MAX_RATE);
+  ctxt->flush_interval = max_rate ? MAX (1000 / max_rate, 1) : 0;
+  ctxt->threshold = MAX (get_env_uint ("EKN_SCROLL_PLUGIN_THRESHOLD",
+                                       DEFAULT_THRESHOLD), 1);
+
+  ctxt->node = g_dbus_node_info_new_for_xml (introspection_xml, &error);
+  if (ctxt->node == NULL)
+    {
+      g_critical ("Error parsing scroll extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
 
   g_signal_connect (extension, "page-created",
-                    G_CALLBACK (on_page_created), NULL);
-
-  g_bus_own_name (G_BUS_TYPE_SESSION,
-                  well_known_name,
-                  G_BUS_NAME_OWNER_FLAGS_NONE,
-                  (GBusAcquiredCallback) on_bus_acquired,
-                  NULL,
-                  NULL,
-                  extension,
-                  NULL);
+                    G_CALLBACK (on_page_created), ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+  g_free (address);
 }
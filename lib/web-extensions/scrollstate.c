@@ -0,0 +1,42 @@
+#include "scrollstate.h"
+
+#include <stdlib.h>
+
+/* Decides which scroll changes are worth signalling, kept apart from the
+plugin so that it can be tested without a web process */
+
+static gboolean
+exceeds_threshold (gint old_value,
+                   gint new_value,
+                   gint threshold)
+{
+  return abs (new_value - old_value) >= threshold;
+}
+
+/* @signalled is the state that was last signalled, or NULL if nothing was
+signalled yet for this document. Moves smaller than @threshold pixels are
+left out, except for reaching the top or bottom, which is always signalled
+exactly; changes in the extents are always signalled. */
+gboolean
+scroll_state_should_signal (const ScrollState *signalled,
+                            const ScrollState *current,
+                            gint               threshold)
+{
+  if (signalled == NULL)
+    return TRUE;
+
+  if (current->max_scroll_top != signalled->max_scroll_top ||
+      current->max_scroll_left != signalled->max_scroll_left)
+    return TRUE;
+
+  gboolean at_edge = current->scroll_top != signalled->scroll_top &&
+    (current->scroll_top == 0 ||
+     current->scroll_top == current->max_scroll_top);
+  if (at_edge)
+    return TRUE;
+
+  return exceeds_threshold (signalled->scroll_top, current->scroll_top,
+                            threshold) ||
+    exceeds_threshold (signalled->scroll_left, current->scroll_left,
+                       threshold);
+}
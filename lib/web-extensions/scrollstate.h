@@ -0,0 +1,23 @@
+#ifndef SCROLL_STATE_H
+#define SCROLL_STATE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Scroll position and extents of a page, in pixels, as signalled by the
+scroll plugin */
+typedef struct {
+  gint scroll_top;
+  gint max_scroll_top;
+  gint scroll_left;
+  gint max_scroll_left;
+} ScrollState;
+
+gboolean scroll_state_should_signal (const ScrollState *signalled,
+                                     const ScrollState *current,
+                                     gint               threshold);
+
+G_END_DECLS
+
+#endif /* SCROLL_STATE_H */
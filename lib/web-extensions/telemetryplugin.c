@@ -0,0 +1,441 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <webkit2/webkit-web-extension.h>
+
+#include "pluginchannel.h"
+#include "pluginjs.h"
+
+#define BUS_INTERFACE_NAME "com.endlessm.Knowledge.Telemetry"
+#define BUS_SIGNAL_NAME "MetricsReady"
+#define PAGE_EXTRA_DATA_KEY "_telemetry_plugin_page_data"
+#define COLLECTOR_PROPERTY "__eknTelemetry"
+
+/* Records load metrics for each document shown in a page, so that they can
+ * be collected per article.
+ *
+ * Most metrics are recorded from JS, by a collector installed in each new
+ * document before any of the page's scripts run. All times are in
+ * milliseconds since the start of navigation, as in the Performance API.
+ *
+ * - response-end, dom-interactive, dom-content-loaded, load-event-end:
+ *   navigation timing
+ * - first-paint, first-contentful-paint: from paint timing if available,
+ *   otherwise estimated as the first frame after DOMContentLoaded
+ * - long-tasks, long-task-time: main thread stalls of more than 50 ms while
+ *   loading, from the long task API if available, otherwise measured as gaps
+ *   between animation frames
+ * - mutation-batches: DOM mutation callbacks while loading; WebKit doesn't
+ *   expose style or layout recalculation counts, but these are what trigger
+ *   them
+ * - mathjax-complete: when MathJax finished typesetting, if the document
+ *   uses it
+ * - ekn-requests: number of ekn:// subresource requests, counted here
+ *
+ * Once the load and any MathJax typesetting is done, the metrics are final
+ * and MetricsReady is signalled with them.
+ *
+ * The collector observes every mutation in the document, so nothing is
+ * recorded for a page until the app calls EnableMetrics on it; that takes
+ * effect from the next document loaded in the page. */
+
+typedef struct {
+  GDBusConnection *connection;  /* unowned */
+  GDBusNodeInfo *node;  /* owned */
+  GList *pages;  /* unowned PageData */
+} TelemetryPluginContext;
+
+typedef struct {
+  TelemetryPluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
+  guint64 id;
+  guint registration_id;
+
+  gboolean enabled;
+  guint ekn_requests;
+} PageData;
+
+static const gchar introspection_xml[] =
+  "<node>"
+    "<interface name='" BUS_INTERFACE_NAME "'>"
+      "<signal name='" BUS_SIGNAL_NAME "'>"
+        "<arg name='uri' type='s'/>"
+        "<arg name='metrics' type='a{sd}'/>"
+      "</signal>"
+      "<method name='EnableMetrics'/>"
+      "<method name='GetMetrics'>"
+        "<arg name='uri' type='s' direction='out'/>"
+        "<arg name='metrics' type='a{sd}' direction='out'/>"
+      "</method>"
+      "<method name='GetResourceTimings'>"
+        "<arg name='timings' type='a(sdd)' direction='out'/>"
+      "</method>"
+    "</interface>"
+  "</node>";
+
+static const gchar collector_script[] =
+  "(function (notify) {"
+  "  var LONG_TASK_MS = 50;"
+  "  var metrics = {'long-tasks': 0, 'long-task-time': 0, 'mutation-batches': 0};"
+  "  var resources = [];"
+  "  var loading = true;"
+  "  var supported = (window.PerformanceObserver &&"
+  "    PerformanceObserver.supportedEntryTypes) || [];"
+  "  function observe(type, callback) {"
+  "    if (supported.indexOf(type) === -1)"
+  "      return false;"
+  "    new PerformanceObserver(function (list) {"
+  "      list.getEntries().forEach(callback);"
+  "    }).observe({type: type, buffered: true});"
+  "    return true;"
+  "  }"
+  "  observe('resource', function (entry) {"
+  "    if (/^ekn(\\+zim)?:/.test(entry.name))"
+  "      resources.push(entry);"
+  "  });"
+  "  var have_paint = observe('paint', function (entry) {"
+  "    metrics[entry.name] = entry.startTime;"
+  "  });"
+  "  var have_long_tasks = observe('longtask', function (entry) {"
+  "    if (!loading) return;"
+  "    metrics['long-tasks']++;"
+  "    metrics['long-task-time'] += entry.duration;"
+  "  });"
+  "  if (!have_long_tasks) {"
+  "    var last_frame = performance.now();"
+  "    requestAnimationFrame(function frame(now) {"
+  "      if (now - last_frame > LONG_TASK_MS) {"
+  "        metrics['long-tasks']++;"
+  "        metrics['long-task-time'] += now - last_frame;"
+  "      }"
+  "      last_frame = now;"
+  "      if (loading) requestAnimationFrame(frame);"
+  "    });"
+  "  }"
+  "  var observer = new MutationObserver(function () {"
+  "    metrics['mutation-batches']++;"
+  "  });"
+  "  observer.observe(document, {"
+  "    attributes: true, characterData: true, childList: true, subtree: true,"
+  "  });"
+  "  document.addEventListener('DOMContentLoaded', function () {"
+  "    if (have_paint) return;"
+  "    requestAnimationFrame(function (now) {"
+  "      metrics['first-paint'] = metrics['first-contentful-paint'] = now;"
+  "    });"
+  "  });"
+  "  function finish() {"
+  "    var timing = performance.timing, start = timing.navigationStart;"
+  "    metrics['response-end'] = timing.responseEnd - start;"
+  "    metrics['dom-interactive'] = timing.domInteractive - start;"
+  "    metrics['dom-content-loaded'] = timing.domContentLoadedEventEnd - start;"
+  "    metrics['load-event-end'] = timing.loadEventEnd - start;"
+  "    loading = false;"
+  "    observer.disconnect();"
+  "    notify();"
+  "  }"
+  "  window.addEventListener('load', function () {"
+  "    setTimeout(function () {"
+  "      if (window.MathJax && MathJax.Hub) {"
+  "        MathJax.Hub.Queue(function () {"
+  "          metrics['mathjax-complete'] = performance.now();"
+  "          finish();"
+  "        });"
+  "      } else {"
+  "        finish();"
+  "      }"
+  "    }, 0);"
+  "  });"
+  "  Object.defineProperty(window, '" COLLECTOR_PROPERTY "', {"
+  "    value: {"
+  "      metrics: metrics,"
+  "      resources: function () {"
+  "        return resources.map(function (entry) {"
+  "          return [entry.name, entry.startTime, entry.duration];"
+  "        });"
+  "      },"
+  "    },"
+  "  });"
+  "})";
+
+static JSGlobalContextRef
+get_page_context (PageData *data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (data->page);
+  return webkit_frame_get_javascript_global_context (frame);
+}
+
+/* Reads the numeric properties of the collector's metrics object */
+static GVariant *
+build_metrics (PageData *data)
+{
+  JSGlobalContextRef js = get_page_context (data);
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sd}"));
+  g_variant_builder_add (&builder, "{sd}", "ekn-requests",
+                         (double) data->ekn_requests);
+
+  JSObjectRef metrics = plugin_js_evaluate_object (js,
+                                                   "window." COLLECTOR_PROPERTY ".metrics");
+  if (metrics == NULL)
+    return g_variant_builder_end (&builder);
+
+  JSPropertyNameArrayRef names = JSObjectCopyPropertyNames (js, metrics);
+  size_t n_names = JSPropertyNameArrayGetCount (names);
+  for (size_t ix = 0; ix < n_names; ix++)
+    {
+      JSStringRef name = JSPropertyNameArrayGetNameAtIndex (names, ix);
+      JSValueRef exc = NULL;
+      JSValueRef value = JSObjectGetProperty (js, metrics, name, &exc);
+      if (exc != NULL || !JSValueIsNumber (js, value))
+        continue;
+
+      g_autofree gchar *key = plugin_js_string_to_utf8 (name);
+      g_variant_builder_add (&builder, "{sd}", key,
+                             JSValueToNumber (js, value, NULL));
+    }
+  JSPropertyNameArrayRelease (names);
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+build_resource_timings (PageData *data)
+{
+  JSGlobalContextRef js = get_page_context (data);
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sdd)"));
+
+  JSObjectRef entries = plugin_js_evaluate_object (js,
+                                                   "window." COLLECTOR_PROPERTY ".resources()");
+  if (entries == NULL)
+    return g_variant_builder_end (&builder);
+
+  for (unsigned ix = 0; ; ix++)
+    {
+      JSValueRef exc = NULL;
+      JSValueRef entry_value = JSObjectGetPropertyAtIndex (js, entries, ix, &exc);
+      if (exc != NULL || !JSValueIsObject (js, entry_value))
+        break;
+      JSObjectRef entry = JSValueToObject (js, entry_value, NULL);
+
+      JSStringRef name = JSValueToStringCopy (js,
+        JSObjectGetPropertyAtIndex (js, entry, 0, NULL), NULL);
+      if (name == NULL)
+        break;
+      g_autofree gchar *uri = plugin_js_string_to_utf8 (name);
+      JSStringRelease (name);
+
+      double start = JSValueToNumber (js,
+        JSObjectGetPropertyAtIndex (js, entry, 1, NULL), NULL);
+      double duration = JSValueToNumber (js,
+        JSObjectGetPropertyAtIndex (js, entry, 2, NULL), NULL);
+      g_variant_builder_add (&builder, "(sdd)", uri, start, duration);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+emit_metrics_ready (PageData *data)
+{
+  TelemetryPluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  const gchar *uri = webkit_web_page_get_uri (data->page);
+  g_dbus_connection_emit_signal (ctxt->connection, NULL, object_path,
+                                 BUS_INTERFACE_NAME, BUS_SIGNAL_NAME,
+                                 g_variant_new ("(s@a{sd})", uri ? uri : "",
+                                                build_metrics (data)),
+                                 &error);
+  if (error != NULL)
+    {
+      g_critical ("Unable to signal load metrics: %s", error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+on_collector_done (JSContextRef      js,
+                   size_t            argument_count,
+                   const JSValueRef  arguments[],
+                   PageData         *data)
+{
+  emit_metrics_ready (data);
+}
+
+/* Installs the collector into each new document in the main frame, before
+the document's own scripts run */
+static void
+on_window_object_cleared (WebKitScriptWorld      *world,
+                          WebKitWebPage          *page,
+                          WebKitFrame            *frame,
+                          TelemetryPluginContext *ctxt)
+{
+  PageData *data = g_object_get_data (G_OBJECT (page), PAGE_EXTRA_DATA_KEY);
+  if (data == NULL || !data->enabled || !webkit_frame_is_main_frame (frame))
+    return;
+
+  data->ekn_requests = 0;
+
+  JSGlobalContextRef js =
+    webkit_frame_get_javascript_context_for_script_world (frame, world);
+  JSValueRef arguments[] = {
+    plugin_js_make_callback (js, (PluginJSCallback) on_collector_done, data),
+  };
+  if (!plugin_js_call_script (js, collector_script, G_N_ELEMENTS (arguments),
+                              arguments))
+    g_critical ("Couldn't install load metrics collector");
+}
+
+static gboolean
+on_send_request (WebKitWebPage     *page,
+                 WebKitURIRequest  *request,
+                 WebKitURIResponse *redirected_response,
+                 PageData          *data)
+{
+  if (!data->enabled)
+    return FALSE;
+
+  const gchar *uri = webkit_uri_request_get_uri (request);
+  if (g_str_has_prefix (uri, "ekn:") || g_str_has_prefix (uri, "ekn+zim:"))
+    data->ekn_requests++;
+  return FALSE;  /* Let the request continue */
+}
+
+static void
+on_method_call (GDBusConnection       *connection,
+                const gchar           *sender,
+                const gchar           *object_path,
+                const gchar           *interface_name,
+                const gchar           *method_name,
+                GVariant              *parameters,
+                GDBusMethodInvocation *invocation,
+                PageData              *data)
+{
+  if (g_strcmp0 (method_name, "EnableMetrics") == 0)
+    {
+      data->enabled = TRUE;
+      g_dbus_method_invocation_return_value (invocation, NULL);
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "GetMetrics") == 0)
+    {
+      const gchar *uri = webkit_web_page_get_uri (data->page);
+      g_dbus_method_invocation_return_value (invocation,
+        g_variant_new ("(s@a{sd})", uri ? uri : "", build_metrics (data)));
+      return;
+    }
+
+  if (g_strcmp0 (method_name, "GetResourceTimings") == 0)
+    {
+      g_dbus_method_invocation_return_value (invocation,
+        g_variant_new ("(@a(sdd))", build_resource_timings (data)));
+      return;
+    }
+
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                         G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method %s invoked on interface %s",
+                                         method_name, interface_name);
+}
+
+static GDBusInterfaceVTable vtable = {
+  (GDBusInterfaceMethodCallFunc) on_method_call,
+  NULL,  /* get_property */
+  NULL,  /* set_property */
+};
+
+static void
+register_page_object (PageData *data)
+{
+  TelemetryPluginContext *ctxt = data->ctxt;
+  GError *error = NULL;
+
+  if (ctxt->connection == NULL || ctxt->node == NULL || data->registration_id != 0)
+    return;
+
+  g_autofree gchar *object_path = plugin_channel_get_page_object_path (data->id);
+  data->registration_id =
+    g_dbus_connection_register_object (ctxt->connection, object_path,
+                                       ctxt->node->interfaces[0], &vtable,
+                                       data, NULL, &error);
+  if (data->registration_id == 0)
+    {
+      g_critical ("Error hooking up telemetry extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+page_data_free (PageData *data)
+{
+  TelemetryPluginContext *ctxt = data->ctxt;
+
+  if (ctxt->connection != NULL && data->registration_id != 0)
+    g_dbus_connection_unregister_object (ctxt->connection, data->registration_id);
+  ctxt->pages = g_list_remove (ctxt->pages, data);
+  g_free (data);
+}
+
+static void
+on_page_created (WebKitWebExtension     *extension,
+                 WebKitWebPage          *page,
+                 TelemetryPluginContext *ctxt)
+{
+  PageData *data = g_new0 (PageData, 1);
+  data->ctxt = ctxt;
+  data->page = page;
+  data->id = webkit_web_page_get_id (page);
+  // Attach our data to the page, so it will get freed when the page is destroyed
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, data,
+                          (GDestroyNotify) page_data_free);
+  ctxt->pages = g_list_prepend (ctxt->pages, data);
+  register_page_object (data);
+
+  g_signal_connect (page, "send-request", G_CALLBACK (on_send_request), data);
+}
+
+static void
+on_channel_ready (GDBusConnection        *connection,
+                  TelemetryPluginContext *ctxt)
+{
+  ctxt->connection = connection;
+  g_list_foreach (ctxt->pages, (GFunc) register_page_object, NULL);
+}
+
+void
+webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
+                                                const GVariant     *data_from_app)
+{
+  TelemetryPluginContext *ctxt = g_new0 (TelemetryPluginContext, 1);
+  GError *error = NULL;
+  gchar *address;
+
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
+
+  ctxt->node = g_dbus_node_info_new_for_xml (introspection_xml, &error);
+  if (ctxt->node == NULL)
+    {
+      g_critical ("Error parsing telemetry extension DBus interface: %s",
+                  error->message);
+      g_clear_error (&error);
+    }
+
+  g_signal_connect (extension, "page-created",
+                    G_CALLBACK (on_page_created), ctxt);
+  g_signal_connect (webkit_script_world_get_default (), "window-object-cleared",
+                    G_CALLBACK (on_window_object_cleared), ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
+  g_free (address);
+}
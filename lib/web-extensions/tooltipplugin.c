@@ -4,15 +4,38 @@
 #include <webkit2/webkit-web-extension.h>
 #include <webkitdom/webkitdom.h>
 
+#include "pluginchannel.h"
+#include "pluginjs.h"
+
 #define BUS_INTERFACE_NAME "com.endlessm.Knowledge.TooltipCoordinates"
-#define OBJECT_PATH "/com/endlessm/webview"
+#define PAGE_EXTRA_DATA_KEY "_tooltip_plugin_page_data"
+
+/* Height of the horizontal bands that the link index is divided into */
+#define BAND_HEIGHT 32
 
 typedef struct {
-  guint bus_id;
-  gchar *base_name;  /* owned */
-  WebKitWebPage *page;  /* unowned */
+  GDBusConnection *connection;  /* unowned */
+  GList *pages;  /* unowned TooltipPluginPage */
 } TooltipPluginContext;
 
+typedef struct {
+  double left, top, width, height;
+} LinkRect;
+
+typedef struct {
+  TooltipPluginContext *ctxt;
+  WebKitWebPage *page;  /* unowned */
+  guint registration_id;
+
+  /* Spatial index of link rectangles, in document coordinates so that it
+  stays valid while scrolling. Resizes, subresource loads and DOM mutations
+  only mark it invalid; it is rebuilt by the next lookup, so pages that are
+  never hovered never pay for it. */
+  GArray *link_rects;  /* LinkRect */
+  GPtrArray *bands;  /* GArray of guint indices into link_rects, or NULL */
+  gboolean index_valid;
+} TooltipPluginPage;
+
 static const gchar introspection_xml[] =
   "<node>"
     "<interface name='" BUS_INTERFACE_NAME "'>"
@@ -20,15 +43,27 @@ static const gchar introspection_xml[] =
         "<arg name='pointer_coordinates' type='(uu)' direction='in'/>"
         "<arg name='dom_element_rectangle' type='(uuuu)' direction='out'/>"
       "</method>"
+      "<method name='GetCoordinatesBatch'>"
+        "<arg name='pointer_coordinates' type='a(uu)' direction='in'/>"
+        "<arg name='link_rectangles' type='a(uuuu)' direction='out'/>"
+      "</method>"
     "</interface>"
   "</node>";
 
-static void
-tooltip_plugin_context_free (TooltipPluginContext *ctxt)
-{
-  g_clear_pointer (&ctxt->base_name, g_free);
-  g_free (ctxt);
-}
+static const gchar collect_link_rects_script[] =
+  "(function () {"
+  "  var result = [], sx = window.scrollX, sy = window.scrollY;"
+  "  var links = document.querySelectorAll('a[href]');"
+  "  for (var i = 0; i < links.length; i++) {"
+  "    var rects = links[i].getClientRects();"
+  "    for (var j = 0; j < rects.length; j++) {"
+  "      var r = rects[j];"
+  "      if (r.width > 0 && r.height > 0)"
+  "        result.push(r.left + sx, r.top + sy, r.width, r.height);"
+  "    }"
+  "  }"
+  "  return result;"
+  "})()";
 
 static JSObjectRef
 get_object_property (JSContextRef js,
@@ -101,40 +136,25 @@ call_object_function (JSContextRef js,
   return object;
 }
 
-static void
-on_method_call (GDBusConnection       *connection,
-                const gchar           *sender,
-                const gchar           *object_path,
-                const gchar           *interface_name,
-                const gchar           *method_name,
-                GVariant              *parameters,
-                GDBusMethodInvocation *invocation,
-                WebKitWebPage         *page)
+/* Fallback for when the index has no link at the given point: hit-test the
+DOM directly */
+static gboolean
+get_element_rect_at_point (WebKitWebPage *page,
+                           guint          x,
+                           guint          y,
+                           LinkRect      *rect_out)
 {
-  guint x, y;
-
-  if (strcmp (method_name, "GetCoordinates") != 0)
-    {
-      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
-                                             G_DBUS_ERROR_UNKNOWN_METHOD,
-                                             "Unknown method %s invoked on interface %s",
-                                             method_name, interface_name);
-      return;
-    }
-
-  g_variant_get (parameters, "((uu))", &x, &y);
-
   WebKitFrame *frame = webkit_web_page_get_main_frame (page);
   JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
 
   JSObjectRef window = JSContextGetGlobalObject (js);
   JSObjectRef document = get_object_property (js, window, "document");
   if (document == NULL)
-    goto fail;
+    return FALSE;
   JSObjectRef element_from_point = get_object_property (js, document,
                                                         "elementFromPoint");
   if (element_from_point == NULL)
-    goto fail;
+    return FALSE;
 
   JSValueRef arguments[] = {
     JSValueMakeNumber (js, x),
@@ -143,35 +163,38 @@ on_method_call (GDBusConnection       *connection,
   JSObjectRef element = call_object_function (js, element_from_point, document,
                                               2, arguments);
   if (element == NULL)
-    goto fail;
+    return FALSE;
 
   JSObjectRef get_client_rects = get_object_property (js, element,
                                                       "getClientRects");
   if (get_client_rects == NULL)
-    goto fail;
+    return FALSE;
 
   JSObjectRef rectlist = call_object_function (js, get_client_rects, element, 0,
                                                NULL);
   if (rectlist == NULL)
-    goto fail;
+    return FALSE;
 
-  double num_rects, left, top, width, height;
+  double num_rects;
   gboolean found = FALSE;
   if (!get_number_property (js, rectlist, "length", &num_rects))
-    goto fail;
+    return FALSE;
   for (int ix = 0; ix < (int) num_rects; ix++)
     {
-      gchar *ix_string = g_strdup_printf ("%d", ix);
-      JSObjectRef rect = get_object_property (js, rectlist, ix_string);
-      g_free (ix_string);
-
-      if (!get_number_property (js, rect, "left", &left)
-          || !get_number_property (js, rect, "top", &top)
-          || !get_number_property (js, rect, "width", &width)
-          || !get_number_property (js, rect, "height", &height))
-        goto fail;
-
-      if (x >= left && x <= left + width && y >= top && y <= top + height)
+      JSValueRef exc = NULL;
+      JSValueRef rect_value = JSObjectGetPropertyAtIndex (js, rectlist, ix, &exc);
+      JSObjectRef rect = exc == NULL ? JSValueToObject (js, rect_value, &exc) : NULL;
+      if (rect == NULL)
+        return FALSE;
+
+      if (!get_number_property (js, rect, "left", &rect_out->left)
+          || !get_number_property (js, rect, "top", &rect_out->top)
+          || !get_number_property (js, rect, "width", &rect_out->width)
+          || !get_number_property (js, rect, "height", &rect_out->height))
+        return FALSE;
+
+      if (x >= rect_out->left && x <= rect_out->left + rect_out->width &&
+          y >= rect_out->top && y <= rect_out->top + rect_out->height)
         {
           found = TRUE;
           break;
@@ -181,20 +204,264 @@ on_method_call (GDBusConnection       *connection,
     g_critical ("There was no client rectangle containing the pointer "
                 "coordinates.");
 
-  /* Left and top can be negative if the element is scrolled partway off the
-  screen. */
-  GVariant *retval = g_variant_new ("((uuuu))",
-                                    (unsigned) MAX(0, left),
-                                    (unsigned) MAX(0, top),
-                                    (unsigned) width, (unsigned) height);
-  g_dbus_method_invocation_return_value (invocation, retval);
-  /* Takes ownership of retval */
+  return TRUE;
+}
+
+static void
+free_band (GArray *indices)
+{
+  if (indices != NULL)
+    g_array_unref (indices);
+}
+
+static void
+clear_link_index (TooltipPluginPage *page_data)
+{
+  g_array_set_size (page_data->link_rects, 0);
+  g_ptr_array_set_size (page_data->bands, 0);
+  page_data->index_valid = FALSE;
+}
+
+static void
+add_to_band (TooltipPluginPage *page_data,
+             guint              band,
+             guint              rect_index)
+{
+  if (band >= page_data->bands->len)
+    g_ptr_array_set_size (page_data->bands, band + 1);
+
+  GArray *indices = g_ptr_array_index (page_data->bands, band);
+  if (indices == NULL)
+    {
+      indices = g_array_new (FALSE, FALSE, sizeof (guint));
+      page_data->bands->pdata[band] = indices;
+    }
+  g_array_append_val (indices, rect_index);
+}
+
+/* Gets all the link rectangles from the DOM in one script evaluation, and
+buckets them by the horizontal bands they overlap */
+static void
+build_link_index (TooltipPluginPage *page_data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (page_data->page);
+  JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
+  JSValueRef exc = NULL;
+  double length;
+
+  clear_link_index (page_data);
+
+  JSObjectRef numbers = plugin_js_evaluate_object (js, collect_link_rects_script);
+  if (numbers == NULL)
+    goto fail;
+  if (!get_number_property (js, numbers, "length", &length))
+    goto fail;
+
+  for (guint ix = 0; ix + 3 < (guint) length; ix += 4)
+    {
+      double values[4];
+      for (guint field = 0; field < 4; field++)
+        {
+          JSValueRef number = JSObjectGetPropertyAtIndex (js, numbers,
+                                                          ix + field, &exc);
+          if (exc != NULL)
+            goto fail;
+          values[field] = JSValueToNumber (js, number, &exc);
+          if (exc != NULL)
+            goto fail;
+        }
+
+      LinkRect rect = { values[0], values[1], values[2], values[3] };
+      guint rect_index = page_data->link_rects->len;
+      g_array_append_val (page_data->link_rects, rect);
+
+      guint first_band = (guint) MAX (0, rect.top) / BAND_HEIGHT;
+      guint last_band = (guint) MAX (0, rect.top + rect.height) / BAND_HEIGHT;
+      for (guint band = first_band; band <= last_band; band++)
+        add_to_band (page_data, band, rect_index);
+    }
+
+  page_data->index_valid = TRUE;
   return;
 
 fail:
-  g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR,
-                                                 G_DBUS_ERROR_FAILED,
-                                                 "Something went wrong interfacing with JavaScriptCore");
+  g_critical ("Couldn't index link rectangles");
+  clear_link_index (page_data);
+}
+
+static gboolean
+lookup_link_rect (TooltipPluginPage *page_data,
+                  guint              x,
+                  guint              y,
+                  LinkRect          *rect_out)
+{
+  WebKitDOMDocument *document = webkit_web_page_get_dom_document (page_data->page);
+  if (document == NULL)
+    return FALSE;
+  WebKitDOMDOMWindow *window = webkit_dom_document_get_default_view (document);
+
+  if (!page_data->index_valid)
+    build_link_index (page_data);
+
+  /* The index is in document coordinates, the pointer is in the viewport */
+  double scroll_x = webkit_dom_dom_window_get_scroll_x (window);
+  double scroll_y = webkit_dom_dom_window_get_scroll_y (window);
+  double doc_x = x + scroll_x;
+  double doc_y = y + scroll_y;
+
+  if (doc_y < 0)
+    return FALSE;
+  guint band = (guint) doc_y / BAND_HEIGHT;
+  if (band >= page_data->bands->len)
+    return FALSE;
+  GArray *indices = g_ptr_array_index (page_data->bands, band);
+  if (indices == NULL)
+    return FALSE;
+
+  for (guint ix = 0; ix < indices->len; ix++)
+    {
+      LinkRect *rect = &g_array_index (page_data->link_rects, LinkRect,
+                                       g_array_index (indices, guint, ix));
+      if (doc_x >= rect->left && doc_x <= rect->left + rect->width &&
+          doc_y >= rect->top && doc_y <= rect->top + rect->height)
+        {
+          rect_out->left = rect->left - scroll_x;
+          rect_out->top = rect->top - scroll_y;
+          rect_out->width = rect->width;
+          rect_out->height = rect->height;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static GVariant *
+link_rect_to_variant (const LinkRect *rect)
+{
+  /* Left and top can be negative if the element is scrolled partway off the
+  screen. */
+  return g_variant_new ("(uuuu)",
+                        (unsigned) MAX (0, rect->left),
+                        (unsigned) MAX (0, rect->top),
+                        (unsigned) rect->width, (unsigned) rect->height);
+}
+
+static void
+on_method_call (GDBusConnection       *connection,
+                const gchar           *sender,
+                const gchar           *object_path,
+                const gchar           *interface_name,
+                const gchar           *method_name,
+                GVariant              *parameters,
+                GDBusMethodInvocation *invocation,
+                TooltipPluginPage     *page_data)
+{
+  LinkRect rect = { 0, 0, 0, 0 };
+  guint x, y;
+
+  if (strcmp (method_name, "GetCoordinates") == 0)
+    {
+      g_variant_get (parameters, "((uu))", &x, &y);
+
+      if (!lookup_link_rect (page_data, x, y, &rect) &&
+          !get_element_rect_at_point (page_data->page, x, y, &rect))
+        {
+          g_dbus_method_invocation_return_error_literal (invocation, G_DBUS_ERROR,
+                                                         G_DBUS_ERROR_FAILED,
+                                                         "Something went wrong interfacing with JavaScriptCore");
+          return;
+        }
+
+      /* Takes ownership of the floating variant */
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new_tuple ((GVariant *[]) { link_rect_to_variant (&rect) }, 1));
+      return;
+    }
+
+  if (strcmp (method_name, "GetCoordinatesBatch") == 0)
+    {
+      /* Only answers from the index, so that prefetching stays cheap; points
+      not on a link get an empty rectangle at the point */
+      g_autoptr(GVariantIter) iter = NULL;
+      GVariantBuilder builder;
+
+      g_variant_get (parameters, "(a(uu))", &iter);
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uuuu)"));
+      while (g_variant_iter_next (iter, "(uu)", &x, &y))
+        {
+          if (!lookup_link_rect (page_data, x, y, &rect))
+            rect = (LinkRect) { x, y, 0, 0 };
+          g_variant_builder_add_value (&builder, link_rect_to_variant (&rect));
+        }
+      g_dbus_method_invocation_return_value (invocation,
+                                             g_variant_new ("(a(uuuu))", &builder));
+      return;
+    }
+
+  g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                         G_DBUS_ERROR_UNKNOWN_METHOD,
+                                         "Unknown method %s invoked on interface %s",
+                                         method_name, interface_name);
+}
+
+static void
+invalidate_link_index (TooltipPluginPage *page_data)
+{
+  page_data->index_valid = FALSE;
+}
+
+static gboolean
+on_layout_changed (WebKitDOMEventTarget *target,
+                   WebKitDOMEvent       *event,
+                   TooltipPluginPage    *page_data)
+{
+  invalidate_link_index (page_data);
+  return FALSE;
+}
+
+static void
+on_mutation (JSContextRef       js,
+             size_t             argument_count,
+             const JSValueRef   arguments[],
+             TooltipPluginPage *page_data)
+{
+  invalidate_link_index (page_data);
+}
+
+static void
+observe_mutations (TooltipPluginPage *page_data)
+{
+  WebKitFrame *frame = webkit_web_page_get_main_frame (page_data->page);
+  JSGlobalContextRef js = webkit_frame_get_javascript_global_context (frame);
+
+  if (!plugin_js_observe_mutations (js, TRUE, NULL,
+                                    (PluginJSCallback) on_mutation, page_data))
+    g_critical ("Couldn't observe DOM mutations; link index may be stale");
+}
+
+static void
+on_document_loaded (WebKitWebPage     *page,
+                    TooltipPluginPage *page_data)
+{
+  WebKitDOMDocument *document = webkit_web_page_get_dom_document (page);
+  WebKitDOMDOMWindow *window = webkit_dom_document_get_default_view (document);
+
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (window),
+                                              "resize",
+                                              G_CALLBACK (on_layout_changed),
+                                              FALSE,
+                                              page_data);
+  /* Images finishing loading move links around. The load event doesn't
+  bubble, so capture it. */
+  webkit_dom_event_target_add_event_listener (WEBKIT_DOM_EVENT_TARGET (document),
+                                              "load",
+                                              G_CALLBACK (on_layout_changed),
+                                              TRUE,
+                                              page_data);
+  observe_mutations (page_data);
+
+  invalidate_link_index (page_data);
 }
 
 static GDBusInterfaceVTable vtable = {
@@ -204,14 +471,17 @@ static GDBusInterfaceVTable vtable = {
 };
 
 static void
-on_bus_acquired (GDBusConnection      *connection,
-                 const gchar          *name,
-                 TooltipPluginContext *ctxt)
+register_page_object (TooltipPluginPage *page_data)
 {
+  TooltipPluginContext *ctxt = page_data->ctxt;
   GError *error = NULL;
-  g_autoptr (GDBusNodeInfo) node;
+  g_autoptr (GDBusNodeInfo) node = NULL;
+  g_autofree gchar *object_path = NULL;
   GDBusInterfaceInfo *interface;
 
+  if (ctxt->connection == NULL || page_data->registration_id != 0)
+    return;
+
   node = g_dbus_node_info_new_for_xml (introspection_xml, &error);
   if (node == NULL)
     goto fail;
@@ -219,13 +489,18 @@ on_bus_acquired (GDBusConnection      *connection,
   if (interface == NULL)
     goto fail;
 
-  ctxt->bus_id = g_dbus_connection_register_object (connection,
-                                                    OBJECT_PATH,
-                                                    interface,
-                                                    &vtable,
-                                                    ctxt->page, NULL,
-                                                    &error);
-  if (ctxt->bus_id == 0)
+  /* The ID is known to the main process and the web process. So we can
+  address a specific web page over DBus. */
+  object_path =
+    plugin_channel_get_page_object_path (webkit_web_page_get_id (page_data->page));
+  page_data->registration_id =
+    g_dbus_connection_register_object (ctxt->connection,
+                                       object_path,
+                                       interface,
+                                       &vtable,
+                                       page_data, NULL,
+                                       &error);
+  if (page_data->registration_id == 0)
     goto fail;
 
   return;
@@ -244,17 +519,28 @@ fail:
 }
 
 static void
-on_name_lost (GDBusConnection      *connection,
-              const gchar          *name,
-              TooltipPluginContext *ctxt)
+tooltip_plugin_page_free (TooltipPluginPage *page_data)
 {
-  if (connection == NULL) {
-    g_error("Couldn't connect to DBus for name %s", name);
-    return;
-  }
+  TooltipPluginContext *ctxt = page_data->ctxt;
 
-  if (!g_dbus_connection_unregister_object (connection, ctxt->bus_id))
+  if (ctxt->connection != NULL && page_data->registration_id != 0 &&
+      !g_dbus_connection_unregister_object (ctxt->connection,
+                                            page_data->registration_id))
     g_critical ("Trouble unregistering object");
+
+  g_array_unref (page_data->link_rects);
+  g_ptr_array_unref (page_data->bands);
+
+  ctxt->pages = g_list_remove (ctxt->pages, page_data);
+  g_free (page_data);
+}
+
+static void
+on_channel_ready (GDBusConnection      *connection,
+                  TooltipPluginContext *ctxt)
+{
+  ctxt->connection = connection;
+  g_list_foreach (ctxt->pages, (GFunc) register_page_object, NULL);
 }
 
 static void
@@ -262,23 +548,20 @@ on_page_created (WebKitWebExtension   *extension,
                  WebKitWebPage        *page,
                  TooltipPluginContext *ctxt)
 {
-  ctxt->page = page;
-
-  /* The ID is known to the main process and the web process. So we can address
-  a specific web page over DBus. */
-  guint64 id = webkit_web_page_get_id (ctxt->page);
-  gchar *well_known_name = g_strdup_printf ("%s-%" G_GUINT64_FORMAT,
-                                            ctxt->base_name, id);
-
-  g_bus_own_name (G_BUS_TYPE_SESSION,
-                  well_known_name,
-                  G_BUS_NAME_OWNER_FLAGS_NONE,
-                  (GBusAcquiredCallback) on_bus_acquired,
-                  NULL,
-                  (GBusNameLostCallback) on_name_lost,
-                  ctxt, (GDestroyNotify) tooltip_plugin_context_free);
-
-  g_free (well_known_name);
+  TooltipPluginPage *page_data = g_new0 (TooltipPluginPage, 1);
+  page_data->ctxt = ctxt;
+  page_data->page = page;
+  page_data->link_rects = g_array_new (FALSE, FALSE, sizeof (LinkRect));
+  page_data->bands = g_ptr_array_new_with_free_func ((GDestroyNotify) free_band);
+  /* Freed along with the page */
+  g_object_set_data_full (G_OBJECT (page), PAGE_EXTRA_DATA_KEY, page_data,
+                          (GDestroyNotify) tooltip_plugin_page_free);
+  ctxt->pages = g_list_prepend (ctxt->pages, page_data);
+
+  register_page_object (page_data);
+
+  g_signal_connect (page, "document-loaded", G_CALLBACK (on_document_loaded),
+                    page_data);
 }
 
 void
@@ -286,8 +569,12 @@ webkit_web_extension_initialize_with_user_data (WebKitWebExtension *extension,
                                                 const GVariant     *data_from_app)
 {
   TooltipPluginContext *ctxt = g_new0 (TooltipPluginContext, 1);
-  g_variant_get ((GVariant *) data_from_app, "(sas)", &ctxt->base_name, NULL);
+  g_autofree gchar *address = NULL;
+  g_variant_get ((GVariant *) data_from_app, "(sas)", &address, NULL);
 
   g_signal_connect (extension, "page-created", G_CALLBACK (on_page_created),
                     ctxt);
+
+  plugin_channel_connect (extension, address,
+                          (PluginChannelReadyFunc) on_channel_ready, ctxt);
 }
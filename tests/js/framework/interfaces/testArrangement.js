@@ -39,6 +39,24 @@ describe('Arrangement interface', function () {
         factory.get_last_created('card').emit('clicked');
     });
 
+    it('packs only the cards for appended models', function () {
+        let models = Minimal.add_cards(arrangement, 2);
+        spyOn(arrangement, 'pack_card').and.callThrough();
+        spyOn(arrangement, 'unpack_card').and.callThrough();
+        let more = [new DModel.Content(), new DModel.Content()];
+        arrangement.append_models(more);
+        expect(arrangement.unpack_card).not.toHaveBeenCalled();
+        expect(arrangement.pack_card.calls.count()).toBe(2);
+        expect(arrangement.get_models()).toEqual(models.concat(more));
+    });
+
+    it('does not append cards beyond the max', function () {
+        arrangement.max_cards = 3;
+        Minimal.add_cards(arrangement, 2);
+        arrangement.append_models([new DModel.Content(), new DModel.Content()]);
+        expect(arrangement.get_count()).toBe(3);
+    });
+
     it('does not create cards for cards beyond the max', function () {
         spyOn(arrangement, 'pack_card');
         arrangement.max_cards = 1;
@@ -40,6 +40,27 @@ describe('Order interface', function () {
         })).toEqual(SORTED);
     });
 
+    it('sorts an array of models into a new array', function () {
+        let factory = new MockFactory.MockFactory({
+            type: Minimal.MinimalOrder,
+            slots: {
+                'sub-order': {
+                    type: Minimal.MinimalOrder,
+                    properties: {
+                        'model-prop': 'synopsis',
+                    },
+                },
+            },
+        });
+        let order = factory.create_root_module();
+        let models = UNSORTED.map(props => new DModel.Content(props));
+
+        expect(order.sort(models).map((model) => {
+            return { title: model.title, synopsis: model.synopsis };
+        })).toEqual(SORTED);
+        expect(models[0].title).toEqual(UNSORTED[0].title);
+    });
+
     it('gives a hint to a Xapian query', function () {
         let factory = new MockFactory.MockFactory({
             type: Minimal.MinimalXapianOrder,
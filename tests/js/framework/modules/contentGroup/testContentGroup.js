@@ -62,6 +62,28 @@ describe('ContentGroup.ContentGroup', function () {
         expect(factory.get_created('arrangement.card').length).toBe(5);
     });
 
+    it('only packs the new cards when the selection loads more', function () {
+        selection.queue_load_more(5);
+        spyOn(arrangement, 'set_models').and.callThrough();
+        spyOn(arrangement, 'pack_card').and.callThrough();
+        selection.queue_load_more(3);
+        expect(arrangement.set_models).not.toHaveBeenCalled();
+        expect(arrangement.pack_card.calls.count()).toBe(3);
+        expect(arrangement.get_models()).toEqual(selection.get_models());
+    });
+
+    it('sets all the models again when the selection was reset', function () {
+        selection.queue_load_more(5);
+        spyOn(selection, 'get_changes').and.returnValue({
+            reset: true,
+            inserted: [0, 1, 2, 3, 4, 5],
+        });
+        spyOn(arrangement, 'set_models').and.callThrough();
+        selection.queue_load_more(1);
+        expect(arrangement.set_models).toHaveBeenCalled();
+        expect(arrangement.get_count()).toBe(6);
+    });
+
     it('dispatches item clicked', function () {
         let model = new DModel.Content();
         selection.get_models.and.returnValue([model]);
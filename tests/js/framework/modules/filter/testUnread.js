@@ -39,6 +39,10 @@ describe('Filter.Unread', function () {
             printerr('returned excluded ids =', query.excluded_ids);
             expect(query.excluded_ids).toContain('read');
         });
+
+        it('needs no filtering after the query', function () {
+            expect(filter.can_modify_xapian_query()).toBeTruthy();
+        });
     });
 
     describe('inverse mode', function () {
@@ -62,3 +66,42 @@ describe('Filter.Unread', function () {
         });
     });
 });
+
+describe('Filter.Unread with a long reading history', function () {
+    let filter, history_model;
+
+    beforeEach(function () {
+        history_model = MockReadingHistoryModel.mock_default();
+        for (let ix = 0; ix < 50000; ix++)
+            history_model.mark_article_read(`ekn:///${ix}`);
+        [filter] = MockFactory.setup_tree({
+            type: Unread.Unread,
+        });
+    });
+
+    it('only excludes the most recently read articles in the query', function () {
+        let query = filter.modify_xapian_query(new DModel.Query());
+        expect(query.excluded_ids.length).toBe(Unread.MAX_EXCLUDED_IDS);
+        expect(query.excluded_ids).toContain('ekn:///49999');
+        expect(query.excluded_ids).not.toContain('ekn:///0');
+    });
+
+    it('asks for results to be filtered after the query', function () {
+        expect(filter.can_modify_xapian_query()).toBeFalsy();
+    });
+
+    it('needs no filtering after the query when inverted', function () {
+        [filter] = MockFactory.setup_tree({
+            type: Unread.Unread,
+            properties: {
+                invert: true,
+            },
+        });
+        expect(filter.can_modify_xapian_query()).toBeTruthy();
+    });
+
+    it('still filters out the articles read long ago', function () {
+        expect(filter.include(new DModel.Content({id: 'ekn:///0'}))).toBeFalsy();
+        expect(filter.include(new DModel.Content({id: 'ekn:///50000'}))).toBeTruthy();
+    });
+});
@@ -4,7 +4,6 @@ const Utils = imports.tests.utils;
 Utils.register_gresource();
 
 const Actions = imports.framework.actions;
-const AppUtils = imports.framework.utils;
 const ArticleStack = imports.framework.modules.layout.articleStack;
 const Box = imports.framework.modules.layout.box;
 const ContentGroup = imports.framework.modules.contentGroup.contentGroup;
@@ -62,7 +61,6 @@ describe('Layout.ArticleStack', function () {
         });
 
         module = factory.get_created('contents')[0];
-        spyOn(AppUtils, 'get_web_plugin_dbus_name').and.returnValue('test0');
 
         article_model = new DModel.Article();
         store.set_current_item_from_props({
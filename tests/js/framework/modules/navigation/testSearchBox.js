@@ -15,9 +15,10 @@ const MockEngine = imports.tests.mockEngine;
 const MockReadingHistoryModel = imports.tests.mockReadingHistoryModel;
 const Pages = imports.framework.pages;
 const SearchBox = imports.framework.modules.navigation.searchBox;
+const TitleIndex = imports.framework.titleIndex;
 
 describe('Navigation.SearchBox', function () {
-    let box, engine, dispatcher, store, reading_history;
+    let box, engine, dispatcher, store, reading_history, title_index;
 
     beforeEach(function () {
         jasmine.addMatchers(CssClassMatcher.customMatchers);
@@ -26,6 +27,9 @@ describe('Navigation.SearchBox', function () {
         dispatcher = MockDispatcher.mock_default();
         store = new HistoryStore.HistoryStore();
         HistoryStore.set_default(store);
+        title_index = new TitleIndex.TitleIndex();
+        title_index.build([]);
+        TitleIndex.set_default(title_index);
         box = new SearchBox.SearchBox();
     });
 
@@ -71,6 +75,22 @@ describe('Navigation.SearchBox', function () {
         expect(engine.query).toHaveBeenCalled();
     });
 
+    it('starts loading the title index when text is typed', function () {
+        spyOn(title_index, 'load');
+        engine.query.and.returnValue(Promise.resolve({models: []}));
+        box.text = 'foo';
+        expect(title_index.load).toHaveBeenCalled();
+    });
+
+    it('starts loading the title index when focused', function () {
+        spyOn(title_index, 'load');
+        let win = new Gtk.OffscreenWindow();
+        win.add(box);
+        win.show_all();
+        box.grab_focus();
+        expect(title_index.load).toHaveBeenCalled();
+    });
+
     it('dispatches autocomplete-selected when a item is selected', function () {
         let model = new DModel.Content({
             id: 'ekn://aaaabbbbccccdddd',
@@ -85,4 +105,93 @@ describe('Navigation.SearchBox', function () {
         expect(payload.context).toEqual([ model ]);
         expect(payload.search_terms).toEqual('foo');
     });
+
+    describe('with titles in the title index', function () {
+        const TITLES = ['Éclair', 'Eclipse', 'Eel', 'Ecuador', 'Echidna',
+            'Ecology'];
+
+        beforeEach(function () {
+            title_index.build(TITLES.map((title, ix) => {
+                return {id: `ekn:///${ix}`, title};
+            }));
+            spyOn(box, 'set_menu_items');
+        });
+
+        it('suggests titles without querying the engine', function () {
+            box.text = 'ec';
+            expect(engine.query).not.toHaveBeenCalled();
+            let [items] = box.set_menu_items.calls.mostRecent().args;
+            expect(items.map(item => item.title)).toEqual(['Echidna', 'Éclair',
+                'Eclipse', 'Ecology', 'Ecuador']);
+        });
+
+        it('queries the engine when there are not enough titles', function (done) {
+            let model = new DModel.Content({
+                id: 'ekn:///full-text',
+                title: 'Pastry',
+            });
+            engine.query.and.returnValue(Promise.resolve({models: [model]}));
+            box.text = 'ecl';
+            expect(engine.query).toHaveBeenCalled();
+            Utils.update_gui();
+            setTimeout(() => {
+                let [items] = box.set_menu_items.calls.mostRecent().args;
+                expect(items.map(item => item.title))
+                    .toEqual(['Éclair', 'Eclipse', 'Pastry']);
+                done();
+            });
+        });
+
+        it('looks up the models of suggested titles when one is selected', function (done) {
+            let model = new DModel.Content({
+                id: 'ekn:///1',
+                title: 'Eclipse',
+            });
+            engine.get_object.and.callFake(id =>
+                Promise.resolve(id === model.id ? model : new DModel.Content({id})));
+            engine.query.and.returnValue(Promise.resolve({models: []}));
+            box.text = 'ecl';
+            box.emit('menu-item-selected', 'ekn:///1');
+            setTimeout(() => {
+                let payload = dispatcher.last_payload_with_type(Actions.ITEM_CLICKED);
+                expect(payload.model).toBe(model);
+                expect(payload.context.map(model => model.id))
+                    .toEqual(['ekn:///0', 'ekn:///1']);
+                done();
+            });
+        });
+    });
+
+    describe('while the title index is building', function () {
+        let model;
+
+        beforeEach(function () {
+            model = new DModel.Content({
+                id: 'ekn:///eclipse',
+                title: 'Eclipse',
+            });
+            engine.query.and.callFake(query => {
+                if (query.search_terms)
+                    return Promise.resolve({models: [model]});
+                // Building the index never finishes
+                return new Promise(() => {});
+            });
+            title_index = new TitleIndex.TitleIndex();
+            spyOn(title_index, 'get_key').and.returnValue(null);
+            TitleIndex.set_default(title_index);
+            title_index.load();
+            spyOn(box, 'set_menu_items');
+        });
+
+        it('falls back to querying the database', function (done) {
+            box.text = 'ecl';
+            let [query] = engine.query.calls.mostRecent().args;
+            expect(query.search_terms).toEqual('ecl');
+            setTimeout(() => {
+                let [items] = box.set_menu_items.calls.mostRecent().args;
+                expect(items).toEqual([{id: 'ekn:///eclipse', title: 'Eclipse'}]);
+                done();
+            });
+        });
+    });
 });
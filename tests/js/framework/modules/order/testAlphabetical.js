@@ -34,6 +34,35 @@ describe('Order.Alphabetical', function () {
             expect(models.sort(order.compare.bind(order))
                 .map(model => model.title)).toEqual(SORTED_TITLES);
         });
+
+        it('sorts many models at once in the same order', function () {
+            expect(order.sort(models).map(model => model.title))
+                .toEqual(SORTED_TITLES);
+        });
+
+        it('keeps models with the same title in their original order', function () {
+            let jellyfish = models.filter(model => model.title === 'Jellyfish');
+            expect(order.sort(models).filter(model => model.title === 'Jellyfish'))
+                .toEqual(jellyfish);
+        });
+    });
+
+    describe('case sensitive', function () {
+        beforeEach(function () {
+            order = factory.create_root_module({
+                'case-sensitive': true,
+            });
+            models = ['Banana', 'cherry', 'Apple', 'avocado']
+                .map(title => new DModel.Content({title}));
+        });
+
+        it('sorts lowercase titles before uppercase ones', function () {
+            const SORTED = ['avocado', 'cherry', 'Apple', 'Banana'];
+            expect(models.sort(order.compare.bind(order))
+                .map(model => model.title)).toEqual(SORTED);
+            expect(order.sort(models).map(model => model.title))
+                .toEqual(SORTED);
+        });
     });
 
     describe('descending', function () {
@@ -45,7 +74,12 @@ describe('Order.Alphabetical', function () {
 
         it('sorts models by title', function () {
             expect(models.sort(order.compare.bind(order))
-                .map(model => model.title)).toEqual(SORTED_TITLES.reverse());
+                .map(model => model.title)).toEqual(SORTED_TITLES.slice().reverse());
+        });
+
+        it('sorts many models at once in the same order', function () {
+            expect(order.sort(models).map(model => model.title))
+                .toEqual(SORTED_TITLES.slice().reverse());
         });
     });
 });
@@ -0,0 +1,111 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+const {DModel} = imports.gi;
+
+const HistoryStore = imports.framework.historyStore;
+const Minimal = imports.tests.minimal;
+const MockFactory = imports.tests.mockFactory;
+const Module = imports.framework.interfaces.module;
+const Selection = imports.framework.modules.selection.selection;
+
+const TitledSelection = new Module.Class({
+    Name: 'TitledSelection',
+    Extends: Selection.Selection,
+
+    add_titles: function (titles) {
+        let next_id = this.get_models().length;
+        titles.forEach(title => this.add_model(new DModel.Content({
+            id: `ekn:///${next_id++}`,
+            title,
+        })));
+        this.emit_models_when_not_animating();
+    },
+});
+
+describe('Selection', function () {
+    let selection;
+
+    function get_titles () {
+        return selection.get_models().map(model => model.title);
+    }
+
+    beforeEach(function () {
+        HistoryStore.set_default(new HistoryStore.HistoryStore());
+    });
+
+    describe('with an order', function () {
+        beforeEach(function () {
+            [selection] = MockFactory.setup_tree({
+                type: TitledSelection,
+                slots: {
+                    'order': { type: Minimal.MinimalOrder },
+                },
+            });
+        });
+
+        it('keeps models in order as they are added', function () {
+            selection.add_titles(['D', 'B']);
+            selection.add_titles(['E', 'A', 'C']);
+            expect(get_titles()).toEqual(['A', 'B', 'C', 'D', 'E']);
+        });
+
+        it('sorts each batch of added models at once', function () {
+            spyOn(selection._order, 'sort').and.callThrough();
+            selection.add_titles(['D', 'B']);
+            expect(selection._order.sort.calls.count()).toBe(1);
+            expect(selection._order.sort.calls.argsFor(0)[0].length).toBe(2);
+            selection.add_titles(['E', 'A', 'C']);
+            expect(selection._order.sort.calls.count()).toBe(2);
+            expect(get_titles()).toEqual(['A', 'B', 'C', 'D', 'E']);
+        });
+
+        it('keeps models that compare equal in the order they were added', function () {
+            selection.add_titles(['B', 'A']);
+            selection.add_titles(['A', 'B']);
+            expect(selection.get_models().map(model => model.id)).toEqual([
+                'ekn:///1',
+                'ekn:///2',
+                'ekn:///0',
+                'ekn:///3',
+            ]);
+        });
+
+        it('reports the positions of the models added since the last change', function () {
+            selection.add_titles(['D', 'B']);
+            expect(selection.get_changes()).toEqual({
+                reset: false,
+                inserted: [0, 1],
+            });
+            selection.add_titles(['E', 'A', 'C']);
+            expect(selection.get_changes()).toEqual({
+                reset: false,
+                inserted: [0, 2, 4],
+            });
+        });
+
+        it('reports a reset when cleared', function () {
+            selection.add_titles(['B', 'A']);
+            selection.clear();
+            expect(get_titles()).toEqual([]);
+            expect(selection.get_changes()).toEqual({
+                reset: true,
+                inserted: [],
+            });
+        });
+    });
+
+    describe('without an order', function () {
+        beforeEach(function () {
+            [selection] = MockFactory.setup_tree({
+                type: TitledSelection,
+            });
+        });
+
+        it('keeps models in the order they were added', function () {
+            selection.add_titles(['B', 'C']);
+            selection.add_titles(['A']);
+            expect(get_titles()).toEqual(['B', 'C', 'A']);
+            expect(selection.get_changes().inserted).toEqual([2]);
+        });
+    });
+});
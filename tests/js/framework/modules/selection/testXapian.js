@@ -6,6 +6,8 @@ const Minimal = imports.tests.minimal;
 const Module = imports.framework.interfaces.module;
 const MockEngine = imports.tests.mockEngine;
 const MockFactory = imports.tests.mockFactory;
+const MockReadingHistoryModel = imports.tests.mockReadingHistoryModel;
+const Unread = imports.framework.modules.filter.unread;
 const Xapian = imports.framework.modules.selection.xapian;
 
 var SampleXapianSelection = new Module.Class({
@@ -76,3 +78,85 @@ describe('Selection.Xapian superclass', function () {
         })
     });
 });
+
+describe('Selection.Xapian with a filter that Xapian cannot do', function () {
+    let engine, selection;
+
+    beforeEach(function () {
+        engine = MockEngine.mock_default();
+        // Every other result is filtered out
+        let next_id = 0;
+        engine.query.and.callFake(query => {
+            let models = [];
+            for (let ix = 0; ix < query.limit; ix++) {
+                models.push(new DModel.Content({
+                    id: `ekn:///${next_id++}`,
+                    title: ix % 2 ? '0Filter me out' : 'Keep me',
+                }));
+            }
+            return Promise.resolve({models, upper_bound: 1000});
+        });
+        [selection] = MockFactory.setup_tree({
+            type: SampleXapianSelection,
+            slots: {
+                'filter': { type: Minimal.TitleFilter },
+            },
+        });
+    });
+
+    it('sizes the next query from how many results the filter accepted', function (done) {
+        selection.queue_load_more(4);
+        let id = selection.connect('notify::round-trips', () => {
+            selection.disconnect(id);
+            const [first_query] = engine.query.calls.mostRecent().args;
+            expect(first_query.limit).toBe(12);
+            expect(selection.round_trips).toBe(1);
+
+            // 4 of the 7 results looked at were accepted
+            selection.queue_load_more(4);
+            const [second_query] = engine.query.calls.mostRecent().args;
+            expect(second_query.limit).toBe(9);
+            done();
+        });
+    });
+});
+
+describe('Selection.Xapian with a long reading history', function () {
+    let engine, selection;
+
+    beforeEach(function () {
+        engine = MockEngine.mock_default();
+        let next_id = 0;
+        engine.query.and.callFake(query => {
+            let models = [];
+            for (let ix = 0; ix < query.limit; ix++)
+                models.push(new DModel.Content({id: `ekn:///${next_id++}`}));
+            return Promise.resolve({models, upper_bound: 10000});
+        });
+        // Nine out of ten articles are read, far more than can be excluded
+        // in the query
+        let history_model = MockReadingHistoryModel.mock_default();
+        for (let ix = 0; ix < 5000; ix++) {
+            if (ix % 10)
+                history_model.mark_article_read(`ekn:///${ix}`);
+        }
+        [selection] = MockFactory.setup_tree({
+            type: SampleXapianSelection,
+            slots: {
+                'filter': { type: Unread.Unread },
+            },
+        });
+    });
+
+    it('fetches more to make up for read articles', function (done) {
+        selection.queue_load_more(5);
+        let id = selection.connect('notify::round-trips', () => {
+            selection.disconnect(id);
+            const [first_query] = engine.query.calls.first().args;
+            expect(first_query.limit).toBeGreaterThan(5);
+            expect(selection.get_models().length).toBe(5);
+            expect(selection.round_trips).toBeLessThan(3);
+            done();
+        });
+    });
+});
@@ -135,11 +135,21 @@ describe('View.Document', function () {
             });
             spyOn(view, '_create_webview').and.returnValue(new MockWidgets.MockEknWebview());
             view.load_content_promise().then(done);
-            view.content_view.emit('load-changed', WebKit2.LoadEvent.COMMITTED);
+            view.content_view.emit('content-ready');
         });
 
         it('can be loaded', function () {});
 
+        it('also shows the content when the load finishes', function (done) {
+            let other_view = new Document({
+                model: html_model,
+            });
+            spyOn(other_view, '_create_webview').and.returnValue(new MockWidgets.MockEknWebview());
+            other_view.load_content_promise().then(done);
+            other_view.content_view.emit('load-changed', WebKit2.LoadEvent.COMMITTED);
+            other_view.content_view.emit('load-changed', WebKit2.LoadEvent.FINISHED);
+        });
+
         describe('table of contents', function () {
             let win;
             const TOP_BOTTOM_BAR_HEIGHT = 36 + 30;
@@ -1,6 +1,7 @@
 const {DModel, Gio} = imports.gi;
 const ByteArray = imports.byteArray;
 
+const AppUtils = imports.framework.utils;
 const ArticleHTMLRenderer = imports.framework.articleHTMLRenderer;
 const Utils = imports.tests.utils;
 const MockApplication = imports.tests.mockApplication;
@@ -21,6 +22,7 @@ describe('Article HTML Renderer', function () {
             read_uri: () => [true, html_gbytes, 'text/html']
         });
 
+        ArticleHTMLRenderer._compiled_wrappers.clear();
         renderer = new ArticleHTMLRenderer.ArticleHTMLRenderer();
         wikipedia_model = new DModel.Article({
             source_uri: 'http://en.wikipedia.org/wiki/When_It_Hits_the_Fan',
@@ -118,6 +120,41 @@ describe('Article HTML Renderer', function () {
         expect(html).toMatch('<p>dummy html</p>');
     });
 
+    it('renders the wrapper template only once per configuration', function () {
+        spyOn(renderer._renderer, 'render_mustache_document_from_file').and.callThrough();
+        all_models.forEach(m => renderer.render(m));
+        expect(renderer._renderer.render_mustache_document_from_file.calls.count())
+            .toBe(1);
+
+        renderer.set_custom_css_files(['custom.css']);
+        all_models.forEach(m => renderer.render(m));
+        expect(renderer._renderer.render_mustache_document_from_file.calls.count())
+            .toBe(2);
+    });
+
+    it('fills in the base URI of each article', function () {
+        let model = new DModel.Article({
+            id: 'ekn:///0123456789abcdef',
+            content_type: 'text/html',
+            title: 'Title',
+        });
+        expect(renderer.render(model)).toMatch('<base href="ekn:///0123456789abcdef/">');
+    });
+
+    it('renders the same html in a worker thread', function (done) {
+        spyOn(wikihow_model, 'get_content_stream').and.callFake(() =>
+            Gio.MemoryInputStream.new_from_bytes(ByteArray.toGBytes(
+                ByteArray.fromString('<html><body><p>dummy html</p></body></html>'))));
+        renderer.render_async(wikihow_model).then((chunks) => {
+            let html = chunks.map(chunk =>
+                ByteArray.toString(ByteArray.fromGBytes(chunk))).join('');
+            expect(html).toMatch('<p>dummy html</p>');
+            expect(html).toMatch('Wikihow &amp; title');
+            expect(html).toEqual(renderer.render(wikihow_model));
+            done();
+        });
+    });
+
     describe('Model with custom tags', function () {
         let model;
         let setModel;
@@ -203,6 +240,37 @@ describe('Article HTML Renderer', function () {
         it('includes cross-links in the metadata', function () {
             expect(renderer.render(model)).toMatch('crosslink_init\\(\\["ekn://some_uri"');
         });
+
+        it('resolves each outgoing link only once', function () {
+            let linky_model = new DModel.Article({
+                content_type: 'text/html',
+                title: 'Linky title',
+                outgoing_links: [
+                    'http://repeated.link',
+                    'http://repeated.link',
+                ],
+            });
+            expect(renderer.render(linky_model)).toMatch('crosslink_init\\(\\[null,\\s*null\\]');
+            renderer.render(linky_model);
+            expect(engine.test_link.calls.count()).toBeLessThan(2);
+        });
+
+        it('resolves links again when the content changes', function () {
+            let version_spy = spyOn(AppUtils, 'get_content_version');
+            let linky_model = new DModel.Article({
+                content_type: 'text/html',
+                title: 'Linky title',
+                outgoing_links: ['http://versioned.link'],
+            });
+            version_spy.and.returnValue('');
+            renderer.render(linky_model);
+            renderer.render(linky_model);
+            expect(engine.test_link.calls.count()).toBe(1);
+
+            version_spy.and.returnValue('shard:2');
+            renderer.render(linky_model);
+            expect(engine.test_link.calls.count()).toBe(2);
+        });
     });
 
     describe('Server templated content', function () {
@@ -0,0 +1,100 @@
+const {Gio, GLib, Gtk, WebKit2} = imports.gi;
+
+const ByteArray = imports.byteArray;
+
+const SRCDIR = GLib.getenv('G_TEST_SRCDIR') || GLib.get_current_dir() + '/tests';
+const SCRIPT_PATH = SRCDIR + '/../lib/web-extensions/imageplugin.js';
+// Requests to this scheme never finish, so images stay as they were when the
+// script ran
+const PENDING_SCHEME = 'ekn-test-pending';
+
+Gtk.init(null);
+
+// Runs the image web extension's script at the end of a page, as it is run
+// when the document has been parsed, and reports the result in the title
+function run_script_in_page(view, body) {
+    let [, contents] = Gio.File.new_for_path(SCRIPT_PATH).load_contents(null);
+    let script = ByteArray.toString(contents);
+    let html = `<html><body style="margin: 0">${body}<script>
+        var n_deferred = ${script};
+        document.title = JSON.stringify({
+            n_deferred: n_deferred,
+            deferred: Array.prototype.filter.call(document.images, img =>
+                img.loading === 'lazy' || 'eknDeferredSrc' in img.dataset)
+            .map(img => img.id),
+            async: Array.prototype.every.call(document.images, img =>
+                img.decoding === 'async'),
+        });
+    </script></body></html>`;
+    return new Promise(resolve => {
+        let id = view.connect('notify::title', () => {
+            view.disconnect(id);
+            resolve(JSON.parse(view.title));
+        });
+        view.load_html(html, `${PENDING_SCHEME}:///article`);
+    });
+}
+
+describe('Image web extension script', function () {
+    let view, win, pending_requests;
+
+    beforeEach(function () {
+        pending_requests = [];
+        let context = new WebKit2.WebContext();
+        context.register_uri_scheme(PENDING_SCHEME,
+            req => pending_requests.push(req));
+        view = new WebKit2.WebView({web_context: context});
+        win = new Gtk.OffscreenWindow();
+        win.set_size_request(800, 600);
+        win.add(view);
+        win.show_all();
+    });
+
+    afterEach(function () {
+        pending_requests.forEach(req => req.finish_error(new Gio.IOErrorEnum({
+            message: 'Test finished',
+            code: Gio.IOErrorEnum.CANCELLED,
+        })));
+        win.destroy();
+    });
+
+    it('defers sized images far below the fold', function (done) {
+        run_script_in_page(view, `
+            <img id="above" width="10" height="10" src="${PENDING_SCHEME}:///above.png">
+            <div style="height: 5000px"></div>
+            <img id="below" width="10" height="10" src="${PENDING_SCHEME}:///below.png">
+        `).then(({n_deferred, deferred, async}) => {
+            expect(n_deferred).toBe(1);
+            expect(deferred).toEqual(['below']);
+            expect(async).toBeTruthy();
+            done();
+        });
+    });
+
+    it('leaves images without a size of their own alone', function (done) {
+        run_script_in_page(view, `
+            <div style="height: 5000px"></div>
+            <img id="unsized" src="${PENDING_SCHEME}:///unsized.png">
+            <img id="width-only" width="10" src="${PENDING_SCHEME}:///width.png">
+        `).then(({n_deferred, deferred}) => {
+            expect(n_deferred).toBe(0);
+            expect(deferred).toEqual([]);
+            done();
+        });
+    });
+
+    it('leaves responsive images alone', function (done) {
+        run_script_in_page(view, `
+            <div style="height: 5000px"></div>
+            <img id="srcset" width="10" height="10" src="${PENDING_SCHEME}:///a.png"
+                srcset="${PENDING_SCHEME}:///a-2x.png 2x">
+            <picture>
+                <img id="picture" width="10" height="10" src="${PENDING_SCHEME}:///b.png">
+            </picture>
+        `).then(({n_deferred}) => {
+            expect(n_deferred).toBe(0);
+            done();
+        });
+    });
+
+});
@@ -221,3 +221,74 @@ describe('Syntactic sugar metaclass', function () {
         expect(widget).toHaveCssClass('MyInitGObjectInterface');
     });
 });
+
+describe('Cached property tables', function () {
+    const MyCachedInterface = new Lang.Interface({
+        Name: 'MyCachedInterface',
+        GTypeName: 'MyCachedInterface',
+        Requires: [GObject.Object],
+        Properties: {
+            'iface-prop': GObject.ParamSpec.boolean('iface-prop', '', '',
+                GObject.ParamFlags.READWRITE, false),
+        },
+    });
+    const MyCachedClass = new Knowledge.Class({
+        Name: 'MyCachedClass',
+        Extends: GObject.Object,
+        Implements: [MyCachedInterface],
+        Properties: {
+            'class-prop': GObject.ParamSpec.int('class-prop', '', '',
+                GObject.ParamFlags.READWRITE, 0, 10, 5),
+        },
+    });
+
+    it('lists properties of the class and its interfaces', function () {
+        let names = EosKnowledgePrivate.gtype_list_properties(MyCachedClass.$gtype)
+            .map(pspec => pspec.name);
+        expect(names).toContain('class-prop');
+        expect(names).toContain('iface-prop');
+        expect(names.filter(name => name === 'iface-prop').length).toBe(1);
+    });
+
+    it('reports overridden properties with the class as owner', function () {
+        let pspec = EosKnowledgePrivate.gtype_find_property(MyCachedClass.$gtype,
+            'iface-prop');
+        expect(pspec.owner_type.name).toEqual('EknMyCachedClass');
+        let gobject_pspec = GObject.Object.find_property.call(MyCachedClass,
+            'iface-prop');
+        expect(pspec.owner_type.name).toEqual(gobject_pspec.owner_type.name);
+    });
+
+    it('reports the value type and flags of overridden interface properties', function () {
+        let pspec = EosKnowledgePrivate.gtype_list_properties(MyCachedClass.$gtype)
+            .filter(pspec => pspec.name === 'iface-prop')[0];
+        expect(pspec.value_type).toEqual(GObject.TYPE_BOOLEAN);
+        expect(pspec.flags & GObject.ParamFlags.READWRITE)
+            .toEqual(GObject.ParamFlags.READWRITE);
+        expect(pspec.get_default_value()).toBe(false);
+    });
+
+    it('lists the same property names as GObject', function () {
+        let names = EosKnowledgePrivate.gtype_list_properties(MyCachedClass.$gtype)
+            .map(pspec => pspec.name).sort();
+        let gobject_names = GObject.Object.list_properties.call(MyCachedClass)
+            .map(pspec => pspec.name).sort();
+        expect(names).toEqual(gobject_names);
+    });
+
+    it('finds properties by name with dashes or underscores', function () {
+        let pspec = EosKnowledgePrivate.gtype_find_property(MyCachedClass.$gtype,
+            'class_prop');
+        expect(pspec.name).toEqual('class-prop');
+        expect(EosKnowledgePrivate.gtype_find_property(MyCachedClass.$gtype,
+            'no-such-prop')).toBeNull();
+    });
+
+    it('returns the same table on repeated calls', function () {
+        let first = EosKnowledgePrivate.gtype_find_property(MyCachedClass.$gtype,
+            'class-prop');
+        let second = EosKnowledgePrivate.gtype_find_property(MyCachedClass.$gtype,
+            'class-prop');
+        expect(first).toBe(second);
+    });
+});
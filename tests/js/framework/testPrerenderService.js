@@ -0,0 +1,139 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+const {DModel, Gio, GLib} = imports.gi;
+const ByteArray = imports.byteArray;
+
+const PrerenderService = imports.framework.prerenderService;
+const RenderCache = imports.framework.renderCache;
+
+describe('Prerender service', function () {
+    let service, cache, renderer, article;
+
+    // Rendering and storing involve async I/O, so give them some time
+    function wait_for_prerender () {
+        return new Promise(resolve => GLib.timeout_add(GLib.PRIORITY_LOW + 1, 100, () => {
+            resolve();
+            return GLib.SOURCE_REMOVE;
+        }));
+    }
+
+    beforeEach(function () {
+        spyOn(DModel.Engine.get_default(), 'get_domain').and.returnValue({
+            get_shards: () => [],
+        });
+        cache = new RenderCache.RenderCache({
+            cache_dir: Gio.File.new_for_path(GLib.dir_make_tmp(null)),
+        });
+        renderer = {
+            get_cache_key: () => 'renderer',
+            render_async: jasmine.createSpy('render_async').and.callFake(() =>
+                Promise.resolve([ByteArray.toGBytes(ByteArray.fromString('<html>'))])),
+        };
+        service = new PrerenderService.PrerenderService({
+            cache: cache,
+            max_candidates: 2,
+        });
+        service.add_renderer(renderer);
+        article = new DModel.Article({
+            id: 'ekn:///0123456789abcdef',
+        });
+    });
+
+    it('renders hinted articles into the cache', function (done) {
+        service.hint(article);
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async).toHaveBeenCalled();
+            return cache.lookup(cache.get_key(article, renderer));
+        })
+        .then(chunks => {
+            expect(chunks).not.toBeNull();
+            done();
+        });
+    });
+
+    it('renders hinted articles for each renderer configuration', function (done) {
+        let other_renderer = {
+            get_cache_key: () => 'other renderer',
+            render_async: jasmine.createSpy('render_async').and.callFake(() =>
+                Promise.resolve([ByteArray.toGBytes(ByteArray.fromString('<html>'))])),
+        };
+        let same_renderer = {
+            get_cache_key: () => 'renderer',
+            render_async: jasmine.createSpy('render_async'),
+        };
+        service.add_renderer(other_renderer);
+        service.add_renderer(same_renderer);
+        service.hint(article);
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async).toHaveBeenCalled();
+            expect(other_renderer.render_async).toHaveBeenCalled();
+            expect(same_renderer.render_async).not.toHaveBeenCalled();
+            return cache.lookup(cache.get_key(article, other_renderer));
+        })
+        .then(chunks => {
+            expect(chunks).not.toBeNull();
+            done();
+        });
+    });
+
+    it('stops rendering for renderers that are removed', function (done) {
+        let other_renderer = {
+            get_cache_key: () => 'other renderer',
+            render_async: jasmine.createSpy('render_async'),
+        };
+        service.add_renderer(other_renderer);
+        service.remove_renderer(other_renderer);
+        service.hint(article);
+        wait_for_prerender()
+        .then(() => {
+            expect(other_renderer.render_async).not.toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('ignores models that are not articles', function (done) {
+        service.hint(new DModel.Set({
+            id: 'ekn:///fedcba9876543210',
+        }));
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async).not.toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('does not render articles that are already cached', function (done) {
+        cache.store(cache.get_key(article, renderer), [ByteArray.toGBytes(ByteArray.fromString('<html>'))]);
+        service.hint(article);
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async).not.toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('drops hints when cancelled', function (done) {
+        service.hint(article);
+        service.cancel();
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async).not.toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('stops rendering when the memory budget is spent', function (done) {
+        service.memory_budget = 1;
+        service.hint(article);
+        service.hint(new DModel.Article({
+            id: 'ekn:///fedcba9876543210',
+        }));
+        wait_for_prerender()
+        .then(() => {
+            expect(renderer.render_async.calls.count()).toBe(1);
+            done();
+        });
+    });
+});
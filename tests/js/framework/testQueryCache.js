@@ -0,0 +1,119 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+const {DModel} = imports.gi;
+
+const MockEngine = imports.tests.mockEngine;
+const QueryCache = imports.framework.queryCache;
+
+describe('Query cache', function () {
+    let cache, engine;
+
+    beforeEach(function () {
+        engine = MockEngine.mock_default();
+        cache = new QueryCache.QueryCache({
+            max_entries: 2,
+        });
+    });
+
+    it('gives the same key to queries with tags in a different order', function () {
+        let query1 = new DModel.Query({
+            tags_match_any: ['a', 'b'],
+        });
+        let query2 = new DModel.Query({
+            tags_match_any: ['b', 'a'],
+        });
+        expect(cache.get_key(query1)).toEqual(cache.get_key(query2));
+    });
+
+    it('gives different keys to queries for different results', function () {
+        let query1 = new DModel.Query({
+            tags_match_any: ['a'],
+        });
+        let query2 = new DModel.Query({
+            tags_match_any: ['a'],
+            offset: 10,
+        });
+        expect(cache.get_key(query1)).not.toEqual(cache.get_key(query2));
+    });
+
+    it('shares a query that is still running', function (done) {
+        let query = new DModel.Query({limit: 5});
+        Promise.all([
+            cache.query(query),
+            cache.query(DModel.Query.new_from_object(query, {})),
+        ])
+        .then(([results1, results2]) => {
+            expect(engine.query.calls.count()).toBe(1);
+            expect(results1).toBe(results2);
+            expect(cache.get_stats().in_flight_hits).toBe(1);
+            done();
+        });
+    });
+
+    it('answers a finished query from the cache', function (done) {
+        let query = new DModel.Query({limit: 5});
+        cache.query(query)
+        .then(() => cache.query(query))
+        .then(() => {
+            expect(engine.query.calls.count()).toBe(1);
+            expect(cache.get_stats()).toEqual({
+                hits: 1,
+                in_flight_hits: 0,
+                misses: 1,
+            });
+            done();
+        });
+    });
+
+    it('throws away the least recently used results', function (done) {
+        let queries = [1, 2, 3].map(limit => new DModel.Query({limit}));
+        cache.query(queries[0])
+        .then(() => cache.query(queries[1]))
+        .then(() => cache.query(queries[2]))
+        .then(() => cache.query(queries[0]))
+        .then(() => {
+            expect(engine.query.calls.count()).toBe(4);
+            done();
+        });
+    });
+
+    it('does not keep failed queries', function (done) {
+        let query = new DModel.Query({limit: 5});
+        engine.query.and.returnValue(Promise.reject(new Error('asplode')));
+        cache.query(query)
+        .catch(() => {
+            engine.query.and.callThrough();
+            return cache.query(query);
+        })
+        .then(() => {
+            expect(engine.query.calls.count()).toBe(2);
+            done();
+        });
+    });
+
+    it('throws away results when the engine changes', function (done) {
+        let query = new DModel.Query({limit: 5});
+        cache.query(query)
+        .then(() => {
+            engine = MockEngine.mock_default();
+            return cache.query(query);
+        })
+        .then(() => {
+            expect(engine.query).toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('throws away results when invalidated', function (done) {
+        let query = new DModel.Query({limit: 5});
+        cache.query(query)
+        .then(() => {
+            cache.invalidate();
+            return cache.query(query);
+        })
+        .then(() => {
+            expect(engine.query.calls.count()).toBe(2);
+            done();
+        });
+    });
+});
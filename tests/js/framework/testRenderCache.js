@@ -0,0 +1,113 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+const {DModel, Gio, GLib} = imports.gi;
+const ByteArray = imports.byteArray;
+
+const RenderCache = imports.framework.renderCache;
+
+function chunks_of (...strings) {
+    return strings.map(string => ByteArray.toGBytes(ByteArray.fromString(string)));
+}
+
+function string_of (chunks) {
+    return chunks.map(chunk => ByteArray.toString(ByteArray.fromGBytes(chunk)))
+        .join('');
+}
+
+describe('Render cache', function () {
+    let cache, cache_dir, renderer, model;
+
+    beforeEach(function () {
+        spyOn(DModel.Engine.get_default(), 'get_domain').and.returnValue({
+            get_shards: () => [],
+        });
+        cache_dir = Gio.File.new_for_path(GLib.dir_make_tmp(null));
+        cache = new RenderCache.RenderCache({
+            cache_dir: cache_dir,
+            memory_limit: 10,
+            disk_limit: 20,
+        });
+        renderer = {
+            get_cache_key: () => 'renderer',
+        };
+        model = new DModel.Article({
+            id: 'ekn:///0123456789abcdef',
+        });
+    });
+
+    it('keys documents by renderer options', function () {
+        let other_renderer = {
+            get_cache_key: () => 'other renderer',
+        };
+        expect(cache.get_key(model, renderer))
+            .not.toEqual(cache.get_key(model, other_renderer));
+        expect(cache.get_key(model, renderer))
+            .toEqual(cache.get_key(model, renderer));
+    });
+
+    it('counts a miss for documents it does not have', function (done) {
+        cache.lookup('nothing').then(html => {
+            expect(html).toBeNull();
+            expect(cache.get_stats().misses).toBe(1);
+            done();
+        });
+    });
+
+    it('counts the size of all chunks of a document', function () {
+        expect(RenderCache.get_size(chunks_of('12345', '678'))).toBe(8);
+    });
+
+    it('returns stored documents from memory', function (done) {
+        cache.store('key', chunks_of('<html>'));
+        cache.lookup('key').then(html => {
+            expect(string_of(html)).toEqual('<html>');
+            expect(cache.get_stats().memory_hits).toBe(1);
+            done();
+        });
+    });
+
+    it('evicts the least recently used documents from memory', function (done) {
+        cache.store('first', chunks_of('12345'))
+        .then(() => cache.store('second', chunks_of('12345')))
+        .then(() => cache.lookup('first'))
+        .then(() => cache.store('third', chunks_of('12345')))
+        .then(() => cache.lookup('first'))
+        .then(() => cache.lookup('second'))
+        .then(() => {
+            let stats = cache.get_stats();
+            expect(stats.memory_hits).toBe(2);
+            expect(stats.disk_hits).toBe(1);
+            done();
+        });
+    });
+
+    it('keeps documents on disk for the next session', function (done) {
+        cache.store('key', chunks_of('<html>', '</html>'))
+        .then(() => {
+            let next_cache = new RenderCache.RenderCache({
+                cache_dir: cache_dir,
+            });
+            return next_cache.lookup('key')
+            .then(html => {
+                expect(string_of(html)).toEqual('<html></html>');
+                expect(next_cache.get_stats().disk_hits).toBe(1);
+                done();
+            });
+        });
+    });
+
+    it('keeps the disk usage under the limit', function (done) {
+        cache.store('first', chunks_of('1234567890'))
+        .then(() => cache.store('second', chunks_of('1234567890')))
+        .then(() => cache.store('third', chunks_of('1234567890')))
+        .then(() => cache.lookup('first'))
+        .then(html => {
+            expect(html).toBeNull();
+            return cache.lookup('second');
+        })
+        .then(html => {
+            expect(string_of(html)).toEqual('1234567890');
+            done();
+        });
+    });
+});
@@ -0,0 +1,143 @@
+// Copyright 2018 Endless Mobile, Inc.
+
+const {DModel, Gio, GLib} = imports.gi;
+
+const MockEngine = imports.tests.mockEngine;
+const TitleIndex = imports.framework.titleIndex;
+const Utils = imports.framework.utils;
+
+describe('Title index', function () {
+    let index, cache_dir, engine;
+
+    const MODELS = [
+        {id: 'ekn:///paris', title: 'Paris'},
+        {id: 'ekn:///parasol', title: 'Parasol'},
+        {id: 'ekn:///pare', title: 'Paré', original_title: 'Ambroise Paré'},
+        {id: 'ekn:///pastry', title: 'Pâtisserie', original_title: 'Pastry'},
+        {id: 'ekn:///london', title: 'London'},
+    ];
+
+    beforeEach(function () {
+        engine = MockEngine.mock_default();
+        cache_dir = Gio.File.new_for_path(GLib.dir_make_tmp(null));
+        index = new TitleIndex.TitleIndex({cache_dir});
+    });
+
+    it('folds accents and case', function () {
+        expect(TitleIndex.fold('Ambroise Paré')).toEqual('ambroise pare');
+        expect(TitleIndex.fold('PÂTISSERIE')).toEqual('patisserie');
+    });
+
+    describe('when built', function () {
+        beforeEach(function () {
+            index.build(MODELS);
+        });
+
+        it('finds titles by prefix in alphabetical order', function () {
+            expect(index.lookup('par', 10).map(({title}) => title))
+                .toEqual(['Parasol', 'Paré', 'Paris']);
+        });
+
+        it('ignores accents and case in the text', function () {
+            expect(index.lookup('PATIS', 10)).toEqual([
+                {id: 'ekn:///pastry', title: 'Pâtisserie'},
+            ]);
+        });
+
+        it('finds articles by their original title', function () {
+            expect(index.lookup('ambroise', 10)).toEqual([
+                {id: 'ekn:///pare', title: 'Ambroise Paré'},
+            ]);
+        });
+
+        it('returns each article once', function () {
+            expect(index.lookup('pa', 10).map(({id}) => id)).toEqual([
+                'ekn:///parasol',
+                'ekn:///pare',
+                'ekn:///paris',
+                'ekn:///pastry',
+            ]);
+        });
+
+        it('returns at most the limit', function () {
+            expect(index.lookup('pa', 2).length).toBe(2);
+        });
+
+        it('returns nothing for empty text', function () {
+            expect(index.lookup(' ', 10)).toEqual([]);
+        });
+    });
+
+    it('is not available until loaded', function () {
+        expect(index.lookup('par', 10)).toBeNull();
+    });
+
+    it('does not start building on lookup', function () {
+        index.lookup('par', 10);
+        expect(engine.query).not.toHaveBeenCalled();
+    });
+
+    describe('when loaded', function () {
+        beforeEach(function () {
+            spyOn(Utils, 'get_content_version').and.returnValue('shard:1');
+            engine.query.and.callFake(() => Promise.resolve({
+                models: MODELS.map(props => new DModel.Content(props)),
+                upper_bound: MODELS.length,
+            }));
+        });
+
+        it('builds itself from all articles', function (done) {
+            index.load().then(() => {
+                expect(engine.query).toHaveBeenCalled();
+                let [query] = engine.query.calls.mostRecent().args;
+                expect(query.tags_match_any).toEqual(['EknArticleObject']);
+                expect(index.lookup('lon', 10)).toEqual([
+                    {id: 'ekn:///london', title: 'London'},
+                ]);
+                done();
+            });
+        });
+
+        it('is read from disk for the same content', function (done) {
+            index.load().then(() => {
+                let file = cache_dir.get_child(index.get_key() + '.gvariant');
+                expect(file.query_exists(null)).toBe(true);
+
+                engine.query.calls.reset();
+                let other_index = new TitleIndex.TitleIndex({cache_dir});
+                other_index.load().then(() => {
+                    expect(engine.query).not.toHaveBeenCalled();
+                    expect(other_index.lookup('lon', 10)).toEqual([
+                        {id: 'ekn:///london', title: 'London'},
+                    ]);
+                    done();
+                });
+            });
+        });
+
+        it('is only built once for the same content', function (done) {
+            index.load();
+            index.load().then(() => {
+                expect(engine.query.calls.count()).toBe(1);
+                done();
+            });
+        });
+
+        it('is built again when the content changes', function (done) {
+            index.load().then(() => {
+                Utils.get_content_version.and.returnValue('shard:2');
+                expect(index.lookup('lon', 10)).toBeNull();
+
+                engine.query.calls.reset();
+                return index.load();
+            })
+            .then(() => {
+                expect(engine.query).toHaveBeenCalled();
+                expect(index.lookup('lon', 10)).toEqual([
+                    {id: 'ekn:///london', title: 'London'},
+                ]);
+                done();
+            });
+        });
+    });
+});
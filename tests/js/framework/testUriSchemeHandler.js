@@ -0,0 +1,55 @@
+const EosKnowledgePrivate = imports.gi.EosKnowledgePrivate;
+
+const {ByteRange, UriSchemeHandler} = EosKnowledgePrivate;
+const LENGTH = 1000;
+
+describe('URI scheme handler', function () {
+    describe('parsing byte ranges', function () {
+        function parse (header) {
+            return UriSchemeHandler.parse_range(header, LENGTH);
+        }
+
+        it('serves everything if no range is asked for', function () {
+            expect(parse(null)[0]).toEqual(ByteRange.NONE);
+            expect(parse('items=0-10')[0]).toEqual(ByteRange.NONE);
+        });
+
+        it('parses a closed range', function () {
+            expect(parse('bytes=0-99')).toEqual([ByteRange.SATISFIABLE, 0, 99]);
+        });
+
+        it('clips the end of a range to the content', function () {
+            expect(parse('bytes=900-2000'))
+                .toEqual([ByteRange.SATISFIABLE, 900, 999]);
+        });
+
+        it('parses an open-ended range', function () {
+            expect(parse('bytes=500-')).toEqual([ByteRange.SATISFIABLE, 500, 999]);
+        });
+
+        it('parses a suffix range', function () {
+            expect(parse('bytes=-100')).toEqual([ByteRange.SATISFIABLE, 900, 999]);
+        });
+
+        it('clips a suffix range longer than the content', function () {
+            expect(parse('bytes=-2000')).toEqual([ByteRange.SATISFIABLE, 0, 999]);
+        });
+
+        it('rejects an empty suffix range', function () {
+            expect(parse('bytes=-0')[0]).toEqual(ByteRange.UNSATISFIABLE);
+        });
+
+        it('rejects a range starting past the end', function () {
+            expect(parse(`bytes=${LENGTH}-`)[0]).toEqual(ByteRange.UNSATISFIABLE);
+            expect(parse('bytes=2000-3000')[0]).toEqual(ByteRange.UNSATISFIABLE);
+        });
+
+        it('serves everything for a backwards range', function () {
+            expect(parse('bytes=20-10')[0]).toEqual(ByteRange.NONE);
+        });
+
+        it('serves everything for multiple ranges', function () {
+            expect(parse('bytes=0-9,20-29')).toEqual([ByteRange.NONE, 0, 0]);
+        });
+    });
+});
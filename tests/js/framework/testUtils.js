@@ -2,7 +2,7 @@
 
 const EosKnowledgePrivate = imports.gi.EosKnowledgePrivate;
 
-const GObject = imports.gi.GObject;
+const {DModel, GLib, GObject} = imports.gi;
 const Knowledge = imports.framework.knowledge;
 const Utils = imports.framework.utils;
 
@@ -204,4 +204,57 @@ describe('Utilities:', function () {
             expect(uri.query.param2).toEqual('value2');
         });
     });
+
+    describe('Content version', function () {
+        let domain, shard_path;
+
+        beforeEach(function () {
+            let fd;
+            [fd, shard_path] = GLib.file_open_tmp('testUtilsXXXXXX.shard');
+            GLib.close(fd);
+            domain = {
+                get_shards: jasmine.createSpy('get_shards')
+                    .and.returnValue([{path: shard_path}]),
+                get_subscription_ids: () => ['subscription'],
+            };
+            spyOn(DModel.Engine.get_default(), 'get_domain')
+                .and.callFake(() => domain);
+        });
+
+        afterEach(function () {
+            GLib.unlink(shard_path);
+        });
+
+        it('identifies the shards', function () {
+            expect(Utils.get_content_version()).toContain(shard_path);
+        });
+
+        it('identifies shards that cannot be read by their path', function () {
+            let missing_path = shard_path + '.missing';
+            domain.get_shards.and.returnValue([{path: missing_path}]);
+            expect(Utils.get_content_version()).toEqual(missing_path);
+        });
+
+        it('is only computed once for the same content', function () {
+            let version = Utils.get_content_version();
+            expect(Utils.get_content_version()).toEqual(version);
+            expect(domain.get_shards.calls.count()).toBe(1);
+        });
+
+        it('is computed again when the subscriptions change', function () {
+            Utils.get_content_version();
+            domain.get_subscription_ids = () => ['other subscription'];
+            domain.get_shards.and.returnValue([]);
+            expect(Utils.get_content_version()).toEqual('');
+        });
+
+        it('is computed again when the domain changes', function () {
+            Utils.get_content_version();
+            domain = {
+                get_shards: () => [],
+                get_subscription_ids: () => ['subscription'],
+            };
+            expect(Utils.get_content_version()).toEqual('');
+        });
+    });
 });
@@ -0,0 +1,147 @@
+const {Gio, GLib} = imports.gi;
+
+const WebExtensionChannel = imports.framework.webExtensionChannel;
+
+const CHANNEL_INTERFACE_NAME = 'com.endlessm.Knowledge.WebExtension';
+const CHANNEL_OBJECT_PATH = '/com/endlessm/webview';
+const PAGE_ID = 42;
+const TEST_INTERFACE = '\
+    <node> \
+        <interface name="com.endlessm.Knowledge.Test"> \
+            <method name="Ping"/> \
+            <signal name="Pong"/> \
+        </interface> \
+    </node>';
+
+describe('Web extension channel', function () {
+    let channel, client;
+
+    function announce(signal, page_id) {
+        client.emit_signal(null, CHANNEL_OBJECT_PATH, CHANNEL_INTERFACE_NAME,
+            signal, new GLib.Variant('(t)', [page_id]));
+        client.flush_sync(null);
+    }
+
+    beforeEach(function () {
+        channel = new WebExtensionChannel.WebExtensionChannel();
+        client = Gio.DBusConnection.new_for_address_sync(channel.address,
+            Gio.DBusConnectionFlags.AUTHENTICATION_CLIENT, null, null);
+    });
+
+    afterEach(function () {
+        client.close_sync(null);
+    });
+
+    it('has a peer-to-peer address', function () {
+        expect(channel.address).toMatch(/^unix:/);
+    });
+
+    it('resolves a proxy once the page is announced', function (done) {
+        channel.get_proxy(PAGE_ID, TEST_INTERFACE).then(proxy => {
+            expect(proxy.g_object_path).toEqual(CHANNEL_OBJECT_PATH + '/' + PAGE_ID);
+            expect(channel.has_page(PAGE_ID)).toBeTruthy();
+            done();
+        });
+        announce('PageCreated', PAGE_ID);
+    });
+
+    it('reuses the same proxy for a page', function (done) {
+        announce('PageCreated', PAGE_ID);
+        channel.get_proxy(PAGE_ID, TEST_INTERFACE).then(first =>
+            channel.get_proxy(PAGE_ID, TEST_INTERFACE).then(second => {
+                expect(second).toBe(first);
+                done();
+            }));
+    });
+
+    it('forgets pages when they are destroyed', function (done) {
+        announce('PageCreated', PAGE_ID);
+        channel.get_proxy(PAGE_ID, TEST_INTERFACE).then(() => {
+            announce('PageDestroyed', PAGE_ID);
+            GLib.timeout_add(GLib.PRIORITY_DEFAULT, 100, () => {
+                expect(channel.has_page(PAGE_ID)).toBeFalsy();
+                done();
+                return GLib.SOURCE_REMOVE;
+            });
+        });
+    });
+
+    it('keeps page signals connected when the page is announced again', function (done) {
+        let callback = jasmine.createSpy('callback');
+        channel.connect_page_signal(PAGE_ID, TEST_INTERFACE, 'Pong', callback);
+        let pong = () => {
+            client.emit_signal(null, CHANNEL_OBJECT_PATH + '/' + PAGE_ID,
+                'com.endlessm.Knowledge.Test', 'Pong', null);
+            client.flush_sync(null);
+        };
+        let then_after = (ms, func) => GLib.timeout_add(GLib.PRIORITY_DEFAULT,
+            ms, () => {
+                func();
+                return GLib.SOURCE_REMOVE;
+            });
+
+        announce('PageCreated', PAGE_ID);
+        then_after(100, () => {
+            pong();
+            then_after(100, () => {
+                expect(callback.calls.count()).toBe(1);
+                announce('PageDestroyed', PAGE_ID);
+                announce('PageCreated', PAGE_ID);
+                then_after(100, () => {
+                    pong();
+                    then_after(100, () => {
+                        expect(callback.calls.count()).toBe(2);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+
+    it('rejects proxies of a page that is released', function (done) {
+        channel.get_proxy(PAGE_ID, TEST_INTERFACE).catch(e => {
+            expect(e.matches(Gio.IOErrorEnum, Gio.IOErrorEnum.CANCELLED)).toBeTruthy();
+            done();
+        });
+        channel.release_page(PAGE_ID);
+    });
+
+    it('sends the resource files to web processes', function (done) {
+        let [fd, path] = GLib.file_open_tmp('testWebExtensionChannelXXXXXX.gresource');
+        GLib.close(fd);
+        GLib.file_set_contents(path, 'not really a gresource');
+        channel.set_resource_files([path]);
+
+        client.call_with_unix_fd_list(null, CHANNEL_OBJECT_PATH,
+            CHANNEL_INTERFACE_NAME, 'GetResourceFiles', null,
+            new GLib.VariantType('(ah)'), Gio.DBusCallFlags.NONE, -1, null,
+            null, (conn, result) => {
+                let [reply, fd_list] = conn.call_with_unix_fd_list_finish(result);
+                let [handles] = reply.deep_unpack();
+                expect(handles.length).toBe(1);
+                expect(fd_list.get_length()).toBe(1);
+                GLib.unlink(path);
+                done();
+            });
+    });
+
+    it('leaves out resource files that cannot be opened', function (done) {
+        let [fd, path] = GLib.file_open_tmp('testWebExtensionChannelXXXXXX.gresource');
+        GLib.close(fd);
+        GLib.file_set_contents(path, 'not really a gresource');
+        expect(() => channel.set_resource_files(['/nonexistent.gresource', path]))
+            .not.toThrow();
+
+        client.call_with_unix_fd_list(null, CHANNEL_OBJECT_PATH,
+            CHANNEL_INTERFACE_NAME, 'GetResourceFiles', null,
+            new GLib.VariantType('(ah)'), Gio.DBusCallFlags.NONE, -1, null,
+            null, (conn, result) => {
+                let [reply, fd_list] = conn.call_with_unix_fd_list_finish(result);
+                let [handles] = reply.deep_unpack();
+                expect(handles.length).toBe(1);
+                expect(fd_list.get_length()).toBe(1);
+                GLib.unlink(path);
+                done();
+            });
+    });
+});
@@ -0,0 +1,118 @@
+const {DModel, GLib} = imports.gi;
+const ByteArray = imports.byteArray;
+
+const EknWebview = imports.framework.widgets.eknWebview;
+const RenderCache = imports.framework.renderCache;
+const WebExtensionChannel = imports.framework.webExtensionChannel;
+
+const PAGE_ID = 7;
+
+// Constructing a real webview needs an application; these methods only need
+// the page ID and the renderer, so call them on a stand-in
+function call_webview_method(name, ...args) {
+    let prototype = EknWebview.EknWebview.prototype;
+    let webview = {
+        renderer: {get_cache_key: () => 'renderer'},
+        get_page_id: () => PAGE_ID,
+        _get_telemetry_proxy: prototype._get_telemetry_proxy,
+        enable_load_metrics: prototype.enable_load_metrics,
+        _get_mathjax_cache_proxy: prototype._get_mathjax_cache_proxy,
+    };
+    return prototype[name].apply(webview, args);
+}
+
+describe('Webview load metrics', function () {
+    let proxy;
+
+    beforeEach(function () {
+        proxy = jasmine.createSpyObj('TelemetryProxy',
+            ['EnableMetricsRemote', 'GetMetricsRemote', 'connectSignal']);
+        spyOn(WebExtensionChannel.get_default(), 'get_proxy')
+            .and.returnValue(Promise.resolve(proxy));
+    });
+
+    it('asks the page for its metrics', function (done) {
+        proxy.GetMetricsRemote.and.callFake(callback =>
+            callback(['ekn:///abc', {'first-paint': 120}], null));
+        call_webview_method('get_load_metrics').then(({uri, metrics}) => {
+            expect(WebExtensionChannel.get_default().get_proxy)
+                .toHaveBeenCalledWith(PAGE_ID, jasmine.any(String));
+            expect(uri).toEqual('ekn:///abc');
+            expect(metrics).toEqual({'first-paint': 120});
+            done();
+        });
+    });
+
+    it('rejects if the page cannot be asked', function (done) {
+        let error = new GLib.Error(GLib.quark_from_string('test'), 0, 'failed');
+        proxy.GetMetricsRemote.and.callFake(callback => callback(null, error));
+        call_webview_method('get_load_metrics').catch(e => {
+            expect(e).toBe(error);
+            done();
+        });
+    });
+
+    it('asks the page to record metrics', function (done) {
+        proxy.EnableMetricsRemote.and.callFake(callback => callback([], null));
+        call_webview_method('enable_load_metrics').then(() => {
+            expect(proxy.EnableMetricsRemote).toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('enables metrics when connecting to them', function (done) {
+        spyOn(WebExtensionChannel.get_default(), 'connect_page_signal');
+        proxy.EnableMetricsRemote.and.callFake(callback => callback([], null));
+        call_webview_method('connect_load_metrics', () => {}).then(() => {
+            expect(proxy.EnableMetricsRemote).toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('calls back with metrics when each document is loaded', function () {
+        let channel = WebExtensionChannel.get_default();
+        spyOn(channel, 'connect_page_signal');
+        let callback = jasmine.createSpy('callback');
+        call_webview_method('connect_load_metrics', callback);
+        let [page_id, , name, handler] =
+            channel.connect_page_signal.calls.mostRecent().args;
+        expect(page_id).toBe(PAGE_ID);
+        expect(name).toEqual('MetricsReady');
+        handler(proxy, ':1.0', ['ekn:///abc', {'load': 300}]);
+        expect(callback).toHaveBeenCalledWith('ekn:///abc', {'load': 300});
+    });
+});
+
+describe('Webview typeset math', function () {
+    let channel, model;
+
+    beforeEach(function () {
+        spyOn(DModel.Engine.get_default(), 'get_domain').and.returnValue({
+            get_shards: () => [],
+        });
+        spyOn(RenderCache.RenderCache.prototype, 'lookup').and.returnValue(
+            Promise.resolve([ByteArray.toGBytes(ByteArray.fromString('math'))]));
+        channel = WebExtensionChannel.get_default();
+        model = new DModel.Article({id: 'ekn:///0123456789abcdef'});
+    });
+
+    it('does not wait for a web process that has not announced the page', function (done) {
+        spyOn(channel, 'has_page').and.returnValue(false);
+        spyOn(channel, 'get_proxy');
+        call_webview_method('_restore_typeset_math', 'ekn:///abc', model)
+        .then(() => {
+            expect(channel.get_proxy).not.toHaveBeenCalled();
+            done();
+        });
+    });
+
+    it('gives up on a web process that does not answer', function (done) {
+        spyOn(channel, 'has_page').and.returnValue(true);
+        spyOn(channel, 'get_proxy').and.returnValue(new Promise(() => {}));
+        call_webview_method('_restore_typeset_math', 'ekn:///abc', model)
+        .then(() => {
+            expect(channel.get_proxy).toHaveBeenCalled();
+            done();
+        });
+    });
+});
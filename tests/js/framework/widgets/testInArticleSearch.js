@@ -0,0 +1,58 @@
+const {Gtk} = imports.gi;
+
+Gtk.init(null);
+
+const InArticleSearch = imports.framework.widgets.inArticleSearch;
+const WebExtensionChannel = imports.framework.webExtensionChannel;
+
+const N_MATCHES = 300;
+const N_HIGHLIGHTED = 200;
+
+describe('In-article search', function () {
+    let search, proxy;
+
+    function selected_indices() {
+        return proxy.SelectMatchRemote.calls.allArgs().map(([index]) => index);
+    }
+
+    beforeEach(function (done) {
+        proxy = jasmine.createSpyObj('FindProxy',
+            ['SearchRemote', 'SelectMatchRemote', 'FinishRemote']);
+        let rects = [];
+        for (let ix = 0; ix < N_HIGHLIGHTED; ix++)
+            rects.push([0, 20 * ix, 50, 20]);
+        proxy.SearchRemote.and.callFake((query, max_highlights, callback) =>
+            callback([N_MATCHES, rects.slice(0, max_highlights)], null));
+        spyOn(WebExtensionChannel.get_default(), 'get_proxy')
+            .and.returnValue(Promise.resolve(proxy));
+
+        search = new InArticleSearch.InArticleSearch({get_page_id: () => 7});
+        search.search_changed();
+        setTimeout(done);
+    });
+
+    it('selects the first match', function () {
+        expect(selected_indices()).toEqual([0]);
+    });
+
+    it('can step to matches that are not highlighted', function (done) {
+        for (let ix = 0; ix < N_HIGHLIGHTED; ix++)
+            search.search_next();
+        setTimeout(() => {
+            expect(selected_indices().pop()).toBe(N_HIGHLIGHTED);
+            done();
+        });
+    });
+
+    it('wraps around after the last match', function (done) {
+        search.search_previous();
+        setTimeout(() => {
+            expect(selected_indices().pop()).toBe(N_MATCHES - 1);
+            search.search_next();
+            setTimeout(() => {
+                expect(selected_indices().pop()).toBe(0);
+                done();
+            });
+        });
+    });
+});
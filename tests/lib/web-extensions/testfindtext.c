@@ -0,0 +1,149 @@
+#include <glib.h>
+
+#include "findtext.h"
+
+static void
+append_utf8 (FindText    *text,
+             const gchar *utf8,
+             guint32      node)
+{
+  glong n_chars;
+  g_autofree gunichar2 *utf16 = g_utf8_to_utf16 (utf8, -1, NULL, &n_chars,
+                                                 NULL);
+  g_assert_nonnull (utf16);
+  find_text_append (text, utf16, n_chars, node);
+}
+
+static void
+assert_match_range (FindText *text,
+                    guint     index,
+                    guint32   start_node,
+                    guint32   start_offset,
+                    guint32   end_node,
+                    guint32   end_offset)
+{
+  FindTextRange range;
+  find_text_get_match_range (text, index, &range);
+  g_assert_cmpuint (range.start_node, ==, start_node);
+  g_assert_cmpuint (range.start_offset, ==, start_offset);
+  g_assert_cmpuint (range.end_node, ==, end_node);
+  g_assert_cmpuint (range.end_offset, ==, end_offset);
+}
+
+static void
+test_folds_case_and_accents (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "Un \xc3\x89" "clair", 0);  /* Éclair, precomposed */
+
+  find_text_search (text, "ECLAIR");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 3, 0, 9);
+
+  find_text_search (text, "\xc3\xa9" "clair");  /* éclair */
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+
+  find_text_free (text);
+}
+
+static void
+test_includes_combining_marks_in_range (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "cafe\xcc\x81 noir", 0);  /* e + combining acute */
+
+  find_text_search (text, "cafe");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 0, 0, 5);
+
+  find_text_free (text);
+}
+
+static void
+test_keeps_hangul_jamo (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "\xed\x95\xad\xea\xb5\xac", 0);  /* 항구 */
+
+  /* 한 and 항 share their first jamo, but are different syllables */
+  find_text_search (text, "\xed\x95\x9c");  /* 한 */
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 0);
+
+  find_text_search (text, "\xea\xb5\xac");  /* 구 */
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 1, 0, 2);
+
+  find_text_free (text);
+}
+
+static void
+test_collapses_whitespace_across_nodes (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "foo \n", 0);
+  append_utf8 (text, "  bar", 1);
+
+  find_text_search (text, "foo bar");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 0, 1, 5);
+
+  find_text_free (text);
+}
+
+static void
+test_counts_surrogate_pairs (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "a\xf0\x9f\x98\x80" "b", 0);  /* a, U+1F600, b */
+
+  find_text_search (text, "b");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 3, 0, 4);
+
+  find_text_search (text, "\xf0\x9f\x98\x80");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 1, 0, 3);
+
+  find_text_free (text);
+}
+
+static void
+test_narrows_extended_queries (void)
+{
+  FindText *text = find_text_new ();
+  append_utf8 (text, "ab abc abd", 0);
+
+  find_text_search (text, "ab");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 3);
+
+  find_text_search (text, "abd");
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 1);
+  assert_match_range (text, 0, 0, 7, 0, 10);
+
+  find_text_search (text, "");
+  g_assert_false (find_text_has_query (text));
+  g_assert_cmpuint (find_text_get_n_matches (text), ==, 0);
+
+  find_text_free (text);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/findtext/folds-case-and-accents",
+                   test_folds_case_and_accents);
+  g_test_add_func ("/findtext/includes-combining-marks-in-range",
+                   test_includes_combining_marks_in_range);
+  g_test_add_func ("/findtext/keeps-hangul-jamo", test_keeps_hangul_jamo);
+  g_test_add_func ("/findtext/collapses-whitespace-across-nodes",
+                   test_collapses_whitespace_across_nodes);
+  g_test_add_func ("/findtext/counts-surrogate-pairs",
+                   test_counts_surrogate_pairs);
+  g_test_add_func ("/findtext/narrows-extended-queries",
+                   test_narrows_extended_queries);
+
+  return g_test_run ();
+}
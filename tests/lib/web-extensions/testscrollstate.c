@@ -0,0 +1,101 @@
+#include <glib.h>
+
+#include "scrollstate.h"
+
+#define THRESHOLD 10
+
+static const ScrollState signalled = {
+  .scroll_top = 500,
+  .max_scroll_top = 2000,
+  .scroll_left = 0,
+  .max_scroll_left = 0,
+};
+
+static void
+test_signals_first_state (void)
+{
+  ScrollState current = signalled;
+  g_assert_true (scroll_state_should_signal (NULL, &current, THRESHOLD));
+}
+
+static void
+test_skips_unchanged_state (void)
+{
+  ScrollState current = signalled;
+  g_assert_false (scroll_state_should_signal (&signalled, &current,
+                                              THRESHOLD));
+}
+
+static void
+test_skips_moves_below_threshold (void)
+{
+  ScrollState current = signalled;
+  current.scroll_top += THRESHOLD - 1;
+  g_assert_false (scroll_state_should_signal (&signalled, &current,
+                                              THRESHOLD));
+  current.scroll_top = signalled.scroll_top - (THRESHOLD - 1);
+  g_assert_false (scroll_state_should_signal (&signalled, &current,
+                                              THRESHOLD));
+}
+
+static void
+test_signals_moves_at_threshold (void)
+{
+  ScrollState current = signalled;
+  current.scroll_top += THRESHOLD;
+  g_assert_true (scroll_state_should_signal (&signalled, &current,
+                                             THRESHOLD));
+
+  current = signalled;
+  current.scroll_left += THRESHOLD;
+  g_assert_true (scroll_state_should_signal (&signalled, &current,
+                                             THRESHOLD));
+}
+
+static void
+test_signals_reaching_edges (void)
+{
+  ScrollState near_top = signalled;
+  near_top.scroll_top = 1;
+  ScrollState top = signalled;
+  top.scroll_top = 0;
+  g_assert_true (scroll_state_should_signal (&near_top, &top, THRESHOLD));
+
+  ScrollState near_bottom = signalled;
+  near_bottom.scroll_top = signalled.max_scroll_top - 1;
+  ScrollState bottom = signalled;
+  bottom.scroll_top = signalled.max_scroll_top;
+  g_assert_true (scroll_state_should_signal (&near_bottom, &bottom,
+                                             THRESHOLD));
+}
+
+static void
+test_signals_extent_changes (void)
+{
+  ScrollState current = signalled;
+  current.max_scroll_top += 1;
+  g_assert_true (scroll_state_should_signal (&signalled, &current,
+                                             THRESHOLD));
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/scrollstate/signals-first-state",
+                   test_signals_first_state);
+  g_test_add_func ("/scrollstate/skips-unchanged-state",
+                   test_skips_unchanged_state);
+  g_test_add_func ("/scrollstate/skips-moves-below-threshold",
+                   test_skips_moves_below_threshold);
+  g_test_add_func ("/scrollstate/signals-moves-at-threshold",
+                   test_signals_moves_at_threshold);
+  g_test_add_func ("/scrollstate/signals-reaching-edges",
+                   test_signals_reaching_edges);
+  g_test_add_func ("/scrollstate/signals-extent-changes",
+                   test_signals_extent_changes);
+
+  return g_test_run ();
+}
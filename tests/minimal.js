@@ -144,7 +144,7 @@ var MinimalSelection = new Module.Class({
             let model = new DModel.Content();
             this.add_model(model);
         }
-        this.emit('models-changed');
+        this._emit_models_changed();
     },
 
     simulate_error: function () {
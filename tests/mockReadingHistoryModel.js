@@ -30,6 +30,10 @@ var MockReadingHistoryModel = new Knowledge.Class({
     get_read_articles: function () {
         return this._read_articles;
     },
+
+    get_recently_read_articles: function (limit) {
+        return [...this._read_articles].slice(-limit).reverse();
+    },
 });
 
 // Creates a new MockReadingHistoryModel and sets it up as the singleton. Use
@@ -38,6 +38,7 @@ var MockEknWebview = new Knowledge.Class({
         'load-failed': {
             param_types: [ GObject.TYPE_UINT, GObject.TYPE_STRING ],
         },
+        'content-ready': {},
         'decide-policy': {
             param_types: [ GObject.TYPE_OBJECT, WebKit2.PolicyDecisionType.$gtype ],
         },